@@ -1,4 +1,34 @@
+#ifndef EPSILON
 #define EPSILON 0.001f
+#endif
+
+// Bounces per ray, always passed by the host so the CPU backend traces the same paths
+#ifndef MAX_BOUNCES
+#define MAX_BOUNCES 3
+#endif
+
+// Pixel format of the image, see PixelFormat.h
+#define OUTPUT_RGBA8 0
+#define OUTPUT_BGRA8 1
+#define OUTPUT_RGBA16F 2
+#define OUTPUT_RGBA32F 3
+
+#ifndef OUTPUT_FORMAT
+#define OUTPUT_FORMAT OUTPUT_RGBA8
+#endif
+
+#if OUTPUT_FORMAT == OUTPUT_RGBA16F
+#define OUTPUT_PIXEL half
+#elif OUTPUT_FORMAT == OUTPUT_RGBA32F
+#define OUTPUT_PIXEL float4
+#else
+#define OUTPUT_PIXEL uchar4
+#endif
+
+// Node width of the uploaded BVH, 2 for the binary BVHNode layout or 4 / 8 for WideBVHNode
+#ifndef BVH_WIDTH
+#define BVH_WIDTH 2
+#endif
 
 typedef struct
 {
@@ -16,17 +46,13 @@ typedef struct
     float pad_1;
 } Material;
 
-typedef struct 
+// Intersection layout with precomputed edges, the w components hold the shared vertex indices
+typedef struct
 {
     float4 vertex_0;
-    float4 vertex_1;
-    float4 vertex_2;
-    float4 normal_0;
-    float4 normal_1;
-    float4 normal_2;
-    int materialIndex;
-    int _padding[3];
-} Triangle;
+    float4 edge_1;
+    float4 edge_2;
+} TriangleAccel;
 
 typedef struct
 {
@@ -43,35 +69,75 @@ typedef struct
     int mCount;
 } BVHNode;
 
-float3 compute_barycentric(float3 p, float3 v0, float3 v1, float3 v2) 
+// Path of the wavefront kernels, one per pixel while a sample pass is in flight
+typedef struct
 {
-    float3 v0v1 = v1 - v0;
-    float3 v0v2 = v2 - v0;
-    float3 v0p = p - v0;
+    float4 origin;
+    float4 direction;
+    float4 throughput;
+    int pixel_index;
+    int alive;
+    uint rng;
+    int pad_1;
+} PathState;
 
-    float d00 = dot(v0v1, v0v1);
-    float d01 = dot(v0v1, v0v2);
-    float d11 = dot(v0v2, v0v2);
-    float d20 = dot(v0p, v0v1);
-    float d21 = dot(v0p, v0v2);
+// Node of the light tree, see LightTree.h
+typedef struct
+{
+    float4 bounds;
+    float intensity;
+    int left;
+    int right;
+    int light;
+} LightTreeNode;
 
-    float denom = d00 * d11 - d01 * d01;
-    float v = (d11 * d20 - d01 * d21) / denom;
-    float w = (d00 * d21 - d01 * d20) / denom;
-    float u = 1.0f - v - w;
+// Instance of a bottom level BVH, see InstancedScene.h
+typedef struct
+{
+    float4 world_to_object[3];
+    int root;
+    int pad_0;
+    int pad_1;
+    int pad_2;
+} Instance;
 
-    return (float3)(u, v, w);
-}
+// Closest hit of a queued path, hit_idx is -1 on a miss
+typedef struct
+{
+    float t_min;
+    float u;
+    float v;
+    int hit_idx;
+    int instance_idx;
+    int pad_0;
+    int pad_1;
+    int pad_2;
+} PathHit;
+
+#if BVH_WIDTH > 2
+typedef struct
+{
+    float origin[3];
+    uchar exponent[3];
+    uchar child_count;
+    int children[BVH_WIDTH];
+    uchar quantized_min[3][BVH_WIDTH];
+    uchar quantized_max[3][BVH_WIDTH];
+} WideBVHNode;
+
+#define BVH_NODE WideBVHNode
+#else
+#define BVH_NODE BVHNode
+#endif
 
 bool ray_triangle_intersect(Ray ray,
-                            Triangle tri,
+                            const __global TriangleAccel* tri,
                             float* t,
-                            float3* hit_point,
-                            float3* hit_normal)
+                            float2* barycentric)
 {
-    // Compute edges of the tri and the determinant (using MllerTrumbore algorithm)
-    float3 e1 = (tri.vertex_1 - tri.vertex_0).xyz;
-    float3 e2 = (tri.vertex_2 - tri.vertex_0).xyz;
+    // Moller-Trumbore with the edges precomputed on the host
+    float3 e1 = tri->edge_1.xyz;
+    float3 e2 = tri->edge_2.xyz;
 
     float3 h = cross(ray.direction, e2);
     float a = dot(e1, h);
@@ -79,7 +145,7 @@ bool ray_triangle_intersect(Ray ray,
         return false;
 
     float f = 1.0f / a;
-    float3 s = ray.origin - tri.vertex_0.xyz;
+    float3 s = ray.origin - tri->vertex_0.xyz;
     float u = f * dot(s, h);
     if (u < 0.0f || u > 1.0f) 
         return false;
@@ -92,51 +158,568 @@ bool ray_triangle_intersect(Ray ray,
     float det = f * dot(e2, q);
     if (det > 1e-6 && det < *t)
     {
-        float w = 1 - u - v;
-
-        *hit_point = ray.origin + det * ray.direction;
         *t = det;
+        *barycentric = (float2)(u, v);
+        return true;
+    }
+    return false;
+}
+
+float3 decode_normal(uint encoded)
+{
+    // Octahedral mapping, 16 bits per component
+    float2 e = (float2)((float)(encoded & 0xFFFFu), (float)(encoded >> 16)) / 65535.0f * 2.0f - 1.0f;
+    float3 n = (float3)(e.x, e.y, 1.0f - fabs(e.x) - fabs(e.y));
+    float t = fmax(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return normalize(n);
+}
 
-        // Compute barycentric coordinates
-        float3 barycentric = compute_barycentric(*hit_point, tri.vertex_0.xyz, tri.vertex_1.xyz, tri.vertex_2.xyz);
+float3 interpolate_normal(const __global TriangleAccel* tri,
+                          const __global uint* normals,
+                          float2 barycentric)
+{
+    float3 n0 = decode_normal(normals[as_uint(tri->vertex_0.w)]);
+    float3 n1 = decode_normal(normals[as_uint(tri->edge_1.w)]);
+    float3 n2 = decode_normal(normals[as_uint(tri->edge_2.w)]);
 
-        //*hit_normal = normalize(cross(e1, e2));
-        //*hit_normal = normalize(tri.normal_0.xyz * w + tri.normal_1.xyz * u + tri.normal_2.xyz * v);
-        *hit_normal = normalize(tri.normal_0.xyz * barycentric.x + 
-                                tri.normal_1.xyz * barycentric.y + 
-                                tri.normal_2.xyz * barycentric.z);
-        return true;
+    return normalize(n0 * (1.0f - barycentric.x - barycentric.y) +
+                     n1 * barycentric.x +
+                     n2 * barycentric.y);
+}
+
+bool ray_aabb_intersect(Ray ray,
+                        float3 inv_dir,
+                        AABB box,
+                        float t_max,
+                        float* t_near)
+{
+    // Slab test against the three axis aligned plane pairs
+    float3 t0 = (box.min.xyz - ray.origin) * inv_dir;
+    float3 t1 = (box.max.xyz - ray.origin) * inv_dir;
+
+    float3 t_small = fmin(t0, t1);
+    float3 t_large = fmax(t0, t1);
+
+    float t_enter = fmax(fmax(t_small.x, t_small.y), t_small.z);
+    float t_exit = fmin(fmin(t_large.x, t_large.y), t_large.z);
+
+    *t_near = t_enter;
+    return t_exit >= fmax(t_enter, 0.0f) && t_enter < t_max;
+}
+
+// The instances reference the bottom level roots by binary node index
+#if defined(INSTANCING) && BVH_WIDTH > 2
+#error "INSTANCING requires BVH_WIDTH=2"
+#endif
+
+// The host passes a traversal stack covering its deepest tree, so the pushes below never overflow it
+#ifndef BVH_STACK_SIZE
+#if BVH_WIDTH > 4
+#define BVH_STACK_SIZE 128
+#else
+#define BVH_STACK_SIZE 64
+#endif
+#endif
+
+#if BVH_WIDTH > 2
+int intersect_bvh(Ray ray,
+                  const __global WideBVHNode* nodes,
+                  int root,
+                  const __global TriangleAccel* triangles,
+                  float* t_min,
+                  float2* barycentric)
+{
+    int hit_idx = -1;
+
+    float3 inv_dir = 1.0f / ray.direction;
+
+    int stack[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    stack[stack_ptr++] = root;
+
+    while (stack_ptr > 0)
+    {
+        int ref = stack[--stack_ptr];
+
+        // Leaf reference, the sign bit is set and the range is packed as (start << 5) | count
+        if (ref < 0)
+        {
+            uint leaf = as_uint(ref);
+            int start = (int)((leaf & 0x7FFFFFFFu) >> 5);
+            int count = (int)(leaf & 31u);
+            for (int i = start; i < start + count; ++i)
+            {
+                if (ray_triangle_intersect(ray, &triangles[i], t_min, barycentric))
+                {
+                    hit_idx = i;
+                }
+            }
+            continue;
+        }
+
+        const __global WideBVHNode* node = &nodes[ref];
+
+        float3 origin = (float3)(node->origin[0], node->origin[1], node->origin[2]);
+        float3 scale = (float3)(as_float((uint)node->exponent[0] << 23),
+                                as_float((uint)node->exponent[1] << 23),
+                                as_float((uint)node->exponent[2] << 23));
+
+        // Decode and test every child, keeping the hit children sorted near to far
+        int hit_children[BVH_WIDTH];
+        float hit_distances[BVH_WIDTH];
+        int hit_count = 0;
+
+        int child_count = node->child_count;
+        for (int c = 0; c < child_count; ++c)
+        {
+            AABB box;
+            box.min = (float4)(origin + convert_float3((uchar3)(node->quantized_min[0][c], node->quantized_min[1][c], node->quantized_min[2][c])) * scale, 0.0f);
+            box.max = (float4)(origin + convert_float3((uchar3)(node->quantized_max[0][c], node->quantized_max[1][c], node->quantized_max[2][c])) * scale, 0.0f);
+
+            float t_near;
+            if (!ray_aabb_intersect(ray, inv_dir, box, *t_min, &t_near))
+                continue;
+
+            int slot = hit_count++;
+            while (slot > 0 && hit_distances[slot - 1] > t_near)
+            {
+                hit_children[slot] = hit_children[slot - 1];
+                hit_distances[slot] = hit_distances[slot - 1];
+                --slot;
+            }
+            hit_children[slot] = node->children[c];
+            hit_distances[slot] = t_near;
+        }
+
+        // Push far to near so the nearest child is popped first
+        for (int h = hit_count - 1; h >= 0; --h)
+        {
+            stack[stack_ptr++] = hit_children[h];
+        }
+    }
+    return hit_idx;
+}
+#else
+int intersect_bvh(Ray ray,
+                  const __global BVHNode* nodes,
+                  int root,
+                  const __global TriangleAccel* triangles,
+                  float* t_min,
+                  float2* barycentric)
+{
+    int hit_idx = -1;
+
+    float3 inv_dir = 1.0f / ray.direction;
+
+    float t_root;
+    if (!ray_aabb_intersect(ray, inv_dir, nodes[root].mBounds, *t_min, &t_root))
+        return hit_idx;
+
+    int stack[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    stack[stack_ptr++] = root;
+
+    while (stack_ptr > 0)
+    {
+        BVHNode node = nodes[stack[--stack_ptr]];
+
+        // Leaf node, test the contained triangles
+        if (node.mLeft < 0)
+        {
+            for (int i = node.mStart; i < node.mStart + node.mCount; ++i)
+            {
+                if (ray_triangle_intersect(ray, &triangles[i], t_min, barycentric))
+                {
+                    hit_idx = i;
+                }
+            }
+            continue;
+        }
+
+        float t_left, t_right;
+        bool hit_left = ray_aabb_intersect(ray, inv_dir, nodes[node.mLeft].mBounds, *t_min, &t_left);
+        bool hit_right = ray_aabb_intersect(ray, inv_dir, nodes[node.mRight].mBounds, *t_min, &t_right);
+
+        // Push the far child first so the near child is visited first and shrinks t_min early
+        if (hit_left && hit_right)
+        {
+            int near_child = t_left <= t_right ? node.mLeft : node.mRight;
+            int far_child = t_left <= t_right ? node.mRight : node.mLeft;
+
+            stack[stack_ptr++] = far_child;
+            stack[stack_ptr++] = near_child;
+        }
+        else if (hit_left)
+        {
+            stack[stack_ptr++] = node.mLeft;
+        }
+        else if (hit_right)
+        {
+            stack[stack_ptr++] = node.mRight;
+        }
+    }
+    return hit_idx;
+}
+#endif
+
+// Any-hit traversal for shadow rays. Unlike intersect_bvh it returns at the first triangle in front of t_max,
+// so it neither sorts the children by distance nor keeps the barycentrics or the hit index of the closest hit.
+// Leaf children are tested as soon as their parent is, since any of their triangles ends the query, and the
+// inner children with the larger bounds are visited first, being the more likely occluders.
+#if BVH_WIDTH > 2
+bool occluded_bvh(Ray ray,
+                  float t_max,
+                  const __global WideBVHNode* nodes,
+                  int root,
+                  const __global TriangleAccel* triangles)
+{
+    float3 inv_dir = 1.0f / ray.direction;
+    float2 barycentric;
+
+    int stack[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    stack[stack_ptr++] = root;
+
+    while (stack_ptr > 0)
+    {
+        const __global WideBVHNode* node = &nodes[stack[--stack_ptr]];
+
+        float3 origin = (float3)(node->origin[0], node->origin[1], node->origin[2]);
+        float3 scale = (float3)(as_float((uint)node->exponent[0] << 23),
+                                as_float((uint)node->exponent[1] << 23),
+                                as_float((uint)node->exponent[2] << 23));
+
+        // The inner children are pushed smallest first, so the largest is popped first
+        int inner_children[BVH_WIDTH];
+        float inner_areas[BVH_WIDTH];
+        int inner_count = 0;
+
+        int child_count = node->child_count;
+        for (int c = 0; c < child_count; ++c)
+        {
+            AABB box;
+            box.min = (float4)(origin + convert_float3((uchar3)(node->quantized_min[0][c], node->quantized_min[1][c], node->quantized_min[2][c])) * scale, 0.0f);
+            box.max = (float4)(origin + convert_float3((uchar3)(node->quantized_max[0][c], node->quantized_max[1][c], node->quantized_max[2][c])) * scale, 0.0f);
+
+            float t_near;
+            if (!ray_aabb_intersect(ray, inv_dir, box, t_max, &t_near))
+                continue;
+
+            int ref = node->children[c];
+            if (ref < 0)
+            {
+                uint leaf = as_uint(ref);
+                int start = (int)((leaf & 0x7FFFFFFFu) >> 5);
+                int count = (int)(leaf & 31u);
+                for (int i = start; i < start + count; ++i)
+                {
+                    float t = t_max;
+                    if (ray_triangle_intersect(ray, &triangles[i], &t, &barycentric))
+                        return true;
+                }
+                continue;
+            }
+
+            float3 extent = box.max.xyz - box.min.xyz;
+            float area = extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+
+            int slot = inner_count++;
+            while (slot > 0 && inner_areas[slot - 1] > area)
+            {
+                inner_children[slot] = inner_children[slot - 1];
+                inner_areas[slot] = inner_areas[slot - 1];
+                --slot;
+            }
+            inner_children[slot] = ref;
+            inner_areas[slot] = area;
+        }
+
+        for (int h = 0; h < inner_count; ++h)
+        {
+            stack[stack_ptr++] = inner_children[h];
+        }
+    }
+    return false;
+}
+#else
+bool occluded_bvh(Ray ray,
+                  float t_max,
+                  const __global BVHNode* nodes,
+                  int root,
+                  const __global TriangleAccel* triangles)
+{
+    float3 inv_dir = 1.0f / ray.direction;
+    float2 barycentric;
+
+    float t_root;
+    if (!ray_aabb_intersect(ray, inv_dir, nodes[root].mBounds, t_max, &t_root))
+        return false;
+
+    int stack[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    stack[stack_ptr++] = root;
+
+    while (stack_ptr > 0)
+    {
+        BVHNode node = nodes[stack[--stack_ptr]];
+
+        // Leaf node, any triangle in front of the light ends the query
+        if (node.mLeft < 0)
+        {
+            for (int i = node.mStart; i < node.mStart + node.mCount; ++i)
+            {
+                float t = t_max;
+                if (ray_triangle_intersect(ray, &triangles[i], &t, &barycentric))
+                    return true;
+            }
+            continue;
+        }
+
+        BVHNode left = nodes[node.mLeft];
+        BVHNode right = nodes[node.mRight];
+
+        float t_left, t_right;
+        bool hit_left = ray_aabb_intersect(ray, inv_dir, left.mBounds, t_max, &t_left);
+        bool hit_right = ray_aabb_intersect(ray, inv_dir, right.mBounds, t_max, &t_right);
+
+        // Visit a leaf child first, otherwise the child with the larger bounds
+        if (hit_left && hit_right)
+        {
+            float3 left_extent = left.mBounds.max.xyz - left.mBounds.min.xyz;
+            float3 right_extent = right.mBounds.max.xyz - right.mBounds.min.xyz;
+            float left_area = left_extent.x * left_extent.y + left_extent.y * left_extent.z + left_extent.z * left_extent.x;
+            float right_area = right_extent.x * right_extent.y + right_extent.y * right_extent.z + right_extent.z * right_extent.x;
+
+            bool left_first = right.mLeft >= 0 && (left.mLeft < 0 || left_area >= right_area);
+            int first_child = left_first ? node.mLeft : node.mRight;
+            int second_child = left_first ? node.mRight : node.mLeft;
+
+            stack[stack_ptr++] = second_child;
+            stack[stack_ptr++] = first_child;
+        }
+        else if (hit_left)
+        {
+            stack[stack_ptr++] = node.mLeft;
+        }
+        else if (hit_right)
+        {
+            stack[stack_ptr++] = node.mRight;
+        }
     }
     return false;
 }
+#endif
+
+#ifdef INSTANCING
+// Moves the ray into the object space of the instance. The direction isn't renormalized,
+// so the hit distances of every instance stay comparable in world units
+Ray instance_ray(Ray ray, const __global Instance* instance)
+{
+    Ray local;
+    local.origin = (float3)(dot(instance->world_to_object[0].xyz, ray.origin) + instance->world_to_object[0].w,
+                            dot(instance->world_to_object[1].xyz, ray.origin) + instance->world_to_object[1].w,
+                            dot(instance->world_to_object[2].xyz, ray.origin) + instance->world_to_object[2].w);
+    local.direction = (float3)(dot(instance->world_to_object[0].xyz, ray.direction),
+                               dot(instance->world_to_object[1].xyz, ray.direction),
+                               dot(instance->world_to_object[2].xyz, ray.direction));
+    return local;
+}
+#endif
+
+// Closest hit of the scene. With INSTANCING the top level BVH over the instances is traversed and every
+// instance leaf continues in the bottom level BVH of its mesh, otherwise bvh_nodes holds the whole scene
+int intersect_scene(Ray ray,
+                    const __global BVH_NODE* bvh_nodes,
+                    const __global BVHNode* tlas_nodes,
+                    const __global Instance* instances,
+                    const __global TriangleAccel* triangles,
+                    float* t_min,
+                    float2* barycentric,
+                    int* instance_idx)
+{
+    *instance_idx = -1;
+#ifdef INSTANCING
+    int hit_idx = -1;
+
+    float3 inv_dir = 1.0f / ray.direction;
+
+    float t_root;
+    if (!ray_aabb_intersect(ray, inv_dir, tlas_nodes[0].mBounds, *t_min, &t_root))
+        return hit_idx;
+
+    int stack[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    stack[stack_ptr++] = 0;
+
+    while (stack_ptr > 0)
+    {
+        BVHNode node = tlas_nodes[stack[--stack_ptr]];
+
+        if (node.mLeft < 0)
+        {
+            for (int i = node.mStart; i < node.mStart + node.mCount; ++i)
+            {
+                int instance_hit = intersect_bvh(instance_ray(ray, &instances[i]), bvh_nodes, instances[i].root, triangles, t_min, barycentric);
+                if (instance_hit >= 0)
+                {
+                    hit_idx = instance_hit;
+                    *instance_idx = i;
+                }
+            }
+            continue;
+        }
+
+        float t_left, t_right;
+        bool hit_left = ray_aabb_intersect(ray, inv_dir, tlas_nodes[node.mLeft].mBounds, *t_min, &t_left);
+        bool hit_right = ray_aabb_intersect(ray, inv_dir, tlas_nodes[node.mRight].mBounds, *t_min, &t_right);
+
+        if (hit_left && hit_right)
+        {
+            int near_child = t_left <= t_right ? node.mLeft : node.mRight;
+            int far_child = t_left <= t_right ? node.mRight : node.mLeft;
+
+            stack[stack_ptr++] = far_child;
+            stack[stack_ptr++] = near_child;
+        }
+        else if (hit_left)
+        {
+            stack[stack_ptr++] = node.mLeft;
+        }
+        else if (hit_right)
+        {
+            stack[stack_ptr++] = node.mRight;
+        }
+    }
+    return hit_idx;
+#else
+    return intersect_bvh(ray, bvh_nodes, 0, triangles, t_min, barycentric);
+#endif
+}
+
+// Any-hit query of the scene for shadow rays, see intersect_scene
+bool occluded_scene(Ray ray,
+                    float t_max,
+                    const __global BVH_NODE* bvh_nodes,
+                    const __global BVHNode* tlas_nodes,
+                    const __global Instance* instances,
+                    const __global TriangleAccel* triangles)
+{
+#ifdef INSTANCING
+    float3 inv_dir = 1.0f / ray.direction;
+
+    float t_root;
+    if (!ray_aabb_intersect(ray, inv_dir, tlas_nodes[0].mBounds, t_max, &t_root))
+        return false;
+
+    int stack[BVH_STACK_SIZE];
+    int stack_ptr = 0;
+    stack[stack_ptr++] = 0;
+
+    while (stack_ptr > 0)
+    {
+        BVHNode node = tlas_nodes[stack[--stack_ptr]];
+
+        if (node.mLeft < 0)
+        {
+            for (int i = node.mStart; i < node.mStart + node.mCount; ++i)
+            {
+                if (occluded_bvh(instance_ray(ray, &instances[i]), t_max, bvh_nodes, instances[i].root, triangles))
+                    return true;
+            }
+            continue;
+        }
+
+        float t_left, t_right;
+        bool hit_left = ray_aabb_intersect(ray, inv_dir, tlas_nodes[node.mLeft].mBounds, t_max, &t_left);
+        bool hit_right = ray_aabb_intersect(ray, inv_dir, tlas_nodes[node.mRight].mBounds, t_max, &t_right);
+
+        if (hit_left)
+            stack[stack_ptr++] = node.mLeft;
+        if (hit_right)
+            stack[stack_ptr++] = node.mRight;
+    }
+    return false;
+#else
+    return occluded_bvh(ray, t_max, bvh_nodes, 0, triangles);
+#endif
+}
 
 float3 reflect(float3 I, float3 N) 
 {
     return I - 2.0f * dot(I, N) * N;
 }
 
-__kernel void trace(__global uchar4* image,
-                    int width,
-                    int height,
-                    const __global float4* lights,
-                    int num_lights,
-                    const __global Triangle* triangles,
-                    int num_triangles,
-                    const __global Material* materials,
-                    float4 camera_pos,
-                    float4 camera_dir,
-                    float fov) 
+uint hash_uint(uint x)
 {
-    int x = get_global_id(0);
-    int y = get_global_id(1);
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
 
-    if (x >= width || y >= height) 
-        return;
+uint sample_seed(uint pixel_index, uint sample_index)
+{
+    return pixel_index ^ hash_uint(sample_index);
+}
+
+// Advances the random state and returns a uniform number in [0, 1)
+float random_float(uint* state)
+{
+    *state = hash_uint(*state + 0x9E3779B9u);
+    return (*state >> 8) * (1.0f / 16777216.0f);
+}
+
+int sample_stride(int samples)
+{
+    // Smallest stride from samples / golden ratio on that is coprime to the sample count
+    int stride = max(1, (int)(samples * 0.618034f + 0.5f));
+    for (;;)
+    {
+        int a = stride;
+        int b = samples;
+        while (b != 0)
+        {
+            int t = a % b;
+            a = b;
+            b = t;
+        }
+        if (a == 1)
+            return stride;
+        ++stride;
+    }
+}
 
+float2 sample_offset(int sample, int samples, uint seed, bool accumulate)
+{
+    // A single sample of a frame that isn't accumulated stays at the pixel centre, like the unstratified image
+    if (samples == 1 && !accumulate)
+        return (float2)(0.5f, 0.5f);
+
+    // Jittered N-rooks sub pixel position. Sample s is placed randomly within column s and row (s * stride) % samples
+    // of a samples x samples grid. The coprime stride permutes the rows, so every column and row holds exactly one sample
+    // for any sample count, and strides near samples / golden ratio spread the samples like a Fibonacci lattice
+    int row = (int)(((long)sample * sample_stride(samples)) % samples);
+    uint hash = hash_uint(seed);
+    float2 jitter = (float2)((hash & 0xFFFF) / 65536.0f, (hash >> 16) / 65536.0f);
+    return (float2)((sample + jitter.x) / samples, (row + jitter.y) / samples);
+}
+
+Ray camera_ray(float x,
+               float y,
+               int width,
+               int height,
+               float4 camera_pos,
+               float4 camera_dir,
+               float fov)
+{
     // Compute normalized screen coordinates
     float aspect_ratio = (float)width / height;
-    float px = (2.0f * ((x + 0.5f) / width) - 1.0f) * tan(radians(fov) / 2.0f) * aspect_ratio;
-    float py = (1.0f - 2.0f * ((y + 0.5f) / height)) * tan(radians(fov) / 2.0f);
+    float px = (2.0f * (x / width) - 1.0f) * tan(radians(fov) / 2.0f) * aspect_ratio;
+    float py = (1.0f - 2.0f * (y / height)) * tan(radians(fov) / 2.0f);
 
     Ray ray;
 
@@ -146,100 +729,718 @@ __kernel void trace(__global uchar4* image,
     // Initialize ray
     ray.origin = camera_pos.xyz;
     ray.direction = normalize(camera_dir.xyz + ray.direction);
+    return ray;
+}
 
-    // Initialize color
-    float3 color = (float3)(0.0f, 0.0f, 0.0f);
+// Lights every node keeps a share of the selection probability with, even when they can't reach the Lambert term
+#ifndef LIGHT_TREE_MIN_IMPORTANCE
+#define LIGHT_TREE_MIN_IMPORTANCE 0.05f
+#endif
+
+// Importance of the lights below the node for the shading point. The lights don't fall off with distance, so
+// the importance is the light count of the node times an upper bound of the cosine between the normal and the
+// directions towards the bounding sphere of the node
+float light_node_importance(LightTreeNode node, float3 position, float3 normal)
+{
+    float3 to_center = node.bounds.xyz - position;
+    float distance = length(to_center);
+
+    float cos_bound = 1.0f;
+    if (distance > node.bounds.w)
+    {
+        // cos(max(angle to the center - half angle of the sphere, 0))
+        float cos_center = dot(normal, to_center) / distance;
+        float sin_center = sqrt(fmax(1.0f - cos_center * cos_center, 0.0f));
+        float sin_cone = node.bounds.w / distance;
+        float cos_cone = sqrt(fmax(1.0f - sin_cone * sin_cone, 0.0f));
+        cos_bound = cos_center >= cos_cone ? 1.0f : cos_center * cos_cone + sin_center * sin_cone;
+    }
+    return node.intensity * (fmax(cos_bound, 0.0f) + LIGHT_TREE_MIN_IMPORTANCE);
+}
+
+// Picks a single light by descending the tree and choosing each child in proportion to its importance,
+// a logarithmic number of steps in the light count. Returns the light index and its selection probability in pdf
+int sample_light_tree(const __global LightTreeNode* nodes,
+                      float3 position,
+                      float3 normal,
+                      uint* rng,
+                      float* pdf)
+{
+    *pdf = 1.0f;
+
+    LightTreeNode node = nodes[0];
+    while (node.left >= 0)
+    {
+        LightTreeNode left = nodes[node.left];
+        LightTreeNode right = nodes[node.right];
+
+        float left_importance = light_node_importance(left, position, normal);
+        float right_importance = light_node_importance(right, position, normal);
+        float left_probability = left_importance / (left_importance + right_importance);
+
+        if (random_float(rng) < left_probability)
+        {
+            node = left;
+            *pdf *= left_probability;
+        }
+        else
+        {
+            node = right;
+            *pdf *= 1.0f - left_probability;
+        }
+    }
+    return node.light;
+}
+
+// Lambert and Phong contribution of a single white light, nothing for an occluded light with SHADOWS
+float3 shade_light(float3 light_pos,
+                   float3 hit_point,
+                   float3 hit_normal,
+                   float3 view_dir,
+                   Material material,
+                   const __global TriangleAccel* triangles,
+                   const __global BVH_NODE* bvh_nodes,
+                   const __global BVHNode* tlas_nodes,
+                   const __global Instance* instances)
+{
+    float3 light_dir = normalize(light_pos - hit_point);
+    float light_intensity = fmax(dot(hit_normal, light_dir), 0.0f);
+
+#ifdef SHADOWS
+    // Lights behind the surface are self-shadowed and need no shadow ray
+    if (light_intensity <= 0.0f)
+        return (float3)(0.0f, 0.0f, 0.0f);
+
+    Ray shadow_ray;
+    shadow_ray.origin = hit_point + EPSILON * hit_normal;
+    shadow_ray.direction = light_dir;
+    if (occluded_scene(shadow_ray, length(light_pos - hit_point) - EPSILON, bvh_nodes, tlas_nodes, instances, triangles))
+        return (float3)(0.0f, 0.0f, 0.0f);
+#endif
+
+    float3 reflect_dir = normalize(reflect(-light_dir, hit_normal));
+
+    // Diffuse shading (Lambertian)
+    float3 light = material.diffuse_color.rgb * light_intensity * (float3)(1.0f, 1.0f, 1.0f); // White light
+
+    // Specular shading (Phong reflection model)
+    float spec = pow(max(dot(view_dir, reflect_dir), 0.0f), material.shininess);
+    light += material.specular_color.rgb * (float3)(1.0f, 1.0f, 1.0f) /* White light */ * spec * 0.1f /*Specular intensity scaling*/;
+    return light;
+}
+
+// Shades the closest hit of a bounce, or the sky on a miss, and turns the ray into its reflection.
+// Returns false once the path terminated.
+bool shade_bounce(Ray* ray,
+                  float3* throughput,
+                  float3* color,
+                  int hit_idx,
+                  int instance_idx,
+                  float t_min,
+                  float2 barycentric,
+                  const __global float4* lights,
+                  int num_lights,
+                  const __global TriangleAccel* triangles,
+                  const __global int* triangle_materials,
+                  const __global uint* normals,
+                  const __global BVH_NODE* bvh_nodes,
+                  const __global Material* materials,
+                  const __global LightTreeNode* light_tree,
+                  const __global BVHNode* tlas_nodes,
+                  const __global Instance* instances,
+                  uint* rng)
+{
     float3 sky_color_top = (float3)(0.757f, 0.965f, 1.0f);
     float3 sky_color_bottom = (float3)(0.3f, 0.5f, 1.0f);
 
+    // No intersection
+    if (hit_idx == -1)
+    {
+        float a = 0.5f * (ray->direction.y + 1.0f);
+        a = clamp(a, 0.0f, 1.0f);
+        float3 sky_color = mix(sky_color_bottom, sky_color_top, a);
+        *color += *throughput * sky_color;
+        return false;
+    }
+
+    // Only the closest hit fetches its material and interpolates its normal
+    int material_idx = triangle_materials[hit_idx];
+    float3 hit_point = ray->origin + t_min * ray->direction;
+    float3 hit_normal = interpolate_normal(&triangles[hit_idx], normals, barycentric);
+#ifdef INSTANCING
+    // Object space normals move to world space by the transposed inverse transform
+    const __global float4* world_to_object = instances[instance_idx].world_to_object;
+    hit_normal = normalize(world_to_object[0].xyz * hit_normal.x + world_to_object[1].xyz * hit_normal.y + world_to_object[2].xyz * hit_normal.z);
+#endif
+
+    // Material properties
+    Material material = materials[material_idx];
+    float3 view_dir = normalize(ray->origin - hit_point);
+    
+    //color += diffuse_color * 0.1f;
+    
+    // Accumulate color from lights (basic Phong shading)
+#ifdef LIGHT_TREE
+    // A single light picked from the tree, weighted by its selection probability
+    float light_pdf;
+    int light_idx = sample_light_tree(light_tree, hit_point, hit_normal, rng, &light_pdf);
+    float3 direct_light = shade_light(lights[light_idx].xyz, hit_point, hit_normal, view_dir, material, triangles, bvh_nodes, tlas_nodes, instances) / light_pdf;
+#else
+    float3 direct_light = (float3)(0.0f, 0.0f, 0.0f);
+    for (int l = 0; l < num_lights; ++l) 
+    {
+        direct_light += shade_light(lights[l].xyz, hit_point, hit_normal, view_dir, material, triangles, bvh_nodes, tlas_nodes, instances);
+    }
+#endif
+
+    float3 reflected_color = (float3)(0.0f, 0.0f, 0.0f);
+    if (material.reflectivity > 0.0f)
+    {
+        ray->direction = reflect(ray->direction, hit_normal); // Reflect ray direction
+
+        ray->origin = hit_point + EPSILON * hit_normal; // Move slightly off the surface
+    
+        reflected_color = *throughput * material.reflectivity;
+    }
+    
+    // Blend colors based on reflectivity
+    *color += *throughput * (((1.0f - material.reflectivity) * direct_light) + (material.reflectivity * reflected_color));
+
+    // Scale throughput by remaining reflectivity
+    *throughput *= material.reflectivity;
+    
+    // If throughput becomes negligible, terminate early
+    return length(*throughput) >= EPSILON;
+}
+
+float3 trace_ray(Ray ray,
+                 const __global float4* lights,
+                 int num_lights,
+                 const __global TriangleAccel* triangles,
+                 const __global int* triangle_materials,
+                 const __global uint* normals,
+                 const __global BVH_NODE* bvh_nodes,
+                 const __global Material* materials,
+                 const __global LightTreeNode* light_tree,
+                 const __global BVHNode* tlas_nodes,
+                 const __global Instance* instances,
+                 uint rng,
+                 int* secondary_rays)
+{
+    // Initialize color
+    float3 color = (float3)(0.0f, 0.0f, 0.0f);
+
     // Energy carried by the ray
     float3 throughput = (float3)(1.0f, 1.0f, 1.0f);
 
-    const int max_bounces = 3;
+    const int max_bounces = MAX_BOUNCES;
     for (int b = 0; b < max_bounces; ++b)
     {
-        // Trace ray for sphere intersections
+        // Every bounce after the primary ray traces a secondary ray
+        if (b > 0)
+            ++(*secondary_rays);
+
+        // Trace ray through the BVH for the closest triangle
         float t_min = 1e20f;
-        int hit_idx = -1;
-        int material_idx = -1;
+        float2 barycentric;
+        int instance_idx;
+        int hit_idx = intersect_scene(ray, bvh_nodes, tlas_nodes, instances, triangles, &t_min, &barycentric, &instance_idx);
 
-        float3 hit_normal;
-        float3 hit_point;
+        if (!shade_bounce(&ray, &throughput, &color, hit_idx, instance_idx, t_min, barycentric, lights, num_lights, triangles, triangle_materials, normals, bvh_nodes, materials, light_tree, tlas_nodes, instances, &rng))
+            break;
+    }
 
-        for (int i = 0; i < num_triangles; i++)
-        {
-            Triangle tri = triangles[i];
-            if (ray_triangle_intersect(ray, tri, &t_min, &hit_point, &hit_normal))
-            {
-                hit_idx = i;
-                material_idx = tri.materialIndex;
-            }
-        }
+    return color;
+}
+
+void store_pixel(__global OUTPUT_PIXEL* image, int index, float3 color)
+{
+#if OUTPUT_FORMAT == OUTPUT_RGBA16F
+    vstore_half4((float4)(color, 1.0f), index, image);
+#elif OUTPUT_FORMAT == OUTPUT_RGBA32F
+    image[index] = (float4)(color, 1.0f);
+#else
+    uchar r = (uchar)(clamp(color.x, 0.0f, 1.0f) * 255);
+    uchar g = (uchar)(clamp(color.y, 0.0f, 1.0f) * 255);
+    uchar b = (uchar)(clamp(color.z, 0.0f, 1.0f) * 255);
+#if OUTPUT_FORMAT == OUTPUT_BGRA8
+    image[index] = (uchar4)(b, g, r, 255);
+#else
+    image[index] = (uchar4)(r, g, b, 255);
+#endif
+#endif
+}
+
+// Averages the sample sum of the pixel. Progressive accumulation adds the samples to the previous frames and returns the running average
+float3 resolve_pixel(float3 color,
+                     uint pixel_index,
+                     int samples,
+                     __global float4* accumulation,
+                     int accumulated_samples)
+{
+    if (!accumulation)
+        return color / (float)samples;
+
+    float4 total = accumulated_samples > 0 ? accumulation[pixel_index] : (float4)(0.0f);
+    total.xyz += color;
+    accumulation[pixel_index] = total;
+    return total.xyz / (float)(accumulated_samples + samples);
+}
+
+// Adaptive sampling only estimates the noise of pixels with at least this many samples
+#ifndef ADAPTIVE_MIN_SAMPLES
+#define ADAPTIVE_MIN_SAMPLES 16
+#endif
+
+// Noisy pixels take up to this many times the samples per frame
+#ifndef ADAPTIVE_MAX_SCALE
+#define ADAPTIVE_MAX_SCALE 4
+#endif
+
+float luminance(float3 color)
+{
+    return dot(color, (float3)(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Samples the pixel takes this frame, 0 once it converged. The accumulation holds the color sum in xyz and
+// the sum of the squared sample luminances in w, so the variance of the pixel mean is known without extra storage
+int adaptive_sample_count(uint pixel_index,
+                          int samples,
+                          const __global float4* accumulation,
+                          const __global uint* pixel_samples,
+                          int accumulated_samples,
+                          float threshold)
+{
+    if (accumulated_samples == 0)
+        return samples;
+
+    uint n = pixel_samples[pixel_index];
+    if (n < ADAPTIVE_MIN_SAMPLES)
+        return samples;
+
+    float4 total = accumulation[pixel_index];
+    float mean = luminance(total.xyz) / n;
+    float variance = fmax(total.w / n - mean * mean, 0.0f);
+
+    // Standard error of the pixel mean relative to its brightness, biased so dark pixels don't stay noisy forever
+    float error = sqrt(variance / n) / (mean + 0.01f);
+    if (error <= threshold)
+        return 0;
 
+    return clamp((int)ceil(samples * error / threshold), samples, samples * ADAPTIVE_MAX_SCALE);
+}
+
+// Traces the samples of the pixel and writes its running average
+void trace_pixel(int x,
+                 int y,
+                 __global OUTPUT_PIXEL* image,
+                 int width,
+                 int height,
+                 const __global float4* lights,
+                 int num_lights,
+                 const __global TriangleAccel* triangles,
+                 int num_triangles,
+                 const __global int* triangle_materials,
+                 const __global uint* normals,
+                 const __global BVH_NODE* bvh_nodes,
+                 const __global Material* materials,
+                 float4 camera_pos,
+                 float4 camera_dir,
+                 float fov,
+                 int samples,
+                 __global uint* ray_counts,
+                 __global float4* accumulation,
+                 int accumulated_samples,
+                 __global uint* pixel_samples,
+                 float adaptive_threshold,
+                 const __global LightTreeNode* light_tree,
+                 const __global BVHNode* tlas_nodes,
+                 const __global Instance* instances)
+{
+    uint pixel_index = y * width + x;
 
-        // No intersection
-        if (hit_idx == -1)
+    // Adaptive sampling keeps a sample count per pixel, converged pixels only rewrite their running average
+    // and the noisy ones take the freed time
+    int pixel_sample_count = samples;
+    uint previous_samples = accumulated_samples;
+    if (pixel_samples)
+    {
+        previous_samples = accumulated_samples > 0 ? pixel_samples[pixel_index] : 0;
+        pixel_sample_count = adaptive_sample_count(pixel_index, samples, accumulation, pixel_samples, accumulated_samples, adaptive_threshold);
+        if (pixel_sample_count == 0)
         {
-            float a = 0.5f * (ray.direction.y + 1.0f);
-            a = clamp(a, 0.0f, 1.0f);
-            float3 sky_color = mix(sky_color_bottom, sky_color_top, a);
-            color += throughput * sky_color;
-            break;
+            store_pixel(image, pixel_index, accumulation[pixel_index].xyz / (float)previous_samples);
+            return;
         }
-        
-        // Material properties
-        Material material = materials[material_idx];
-        float3 diffuse_color = material.diffuse_color.rgb;
-        float3 specular_color = material.specular_color.rgb;
-        
-        //color += diffuse_color * 0.1f;
-        
-        // Accumulate color from lights (basic Phong shading)
-        float3 direct_light = (float3)(0.0f, 0.0f, 0.0f);
-        for (int l = 0; l < num_lights; ++l) 
-        {
-            float4 light = lights[l];
-            float3 light_pos = (float3)(light.x, light.y, light.z);
-        
-            float3 light_dir = normalize(light_pos - hit_point);
-            float light_intensity = fmax(dot(hit_normal, light_dir), 0.0f);
-        
-            float3 view_dir = normalize(ray.origin - hit_point);
-            float3 reflect_dir = normalize(reflect(-light_dir, hit_normal));
-        
-            // Diffuse shading (Lambertian)
-            direct_light += diffuse_color * light_intensity * (float3)(1.0f, 1.0f, 1.0f); // White light
-        
-            // Specular shading (Phong reflection model)
-            float spec = pow(max(dot(view_dir, reflect_dir), 0.0f), material.shininess);
-            direct_light += specular_color * (float3)(1.0f, 1.0f, 1.0f) /* White light */ * spec * 0.1f /*Specular intensity scaling*/;
-        }
-
-        float3 reflected_color = (float3)(0.0f, 0.0f, 0.0f);
-        if (material.reflectivity > 0.0f)
-        {
-            ray.direction = reflect(ray.direction, hit_normal); // Reflect ray direction
-
-            ray.origin = hit_point + EPSILON * hit_normal; // Move slightly off the surface
-        
-            reflected_color = throughput * material.reflectivity;
-        }
-        
-        // Blend colors based on reflectivity
-        color += throughput * (((1.0f - material.reflectivity) * direct_light) + (material.reflectivity * reflected_color));
-
-        // Scale throughput by remaining reflectivity
-        throughput *= material.reflectivity;
-        
-        // If throughput becomes negligible, terminate early
-        if (length(throughput) < EPSILON)
+    }
+
+    // Sum the jittered stratified samples of the pixel
+    float3 color = (float3)(0.0f, 0.0f, 0.0f);
+    float luminance_squares = 0.0f;
+    int secondary_rays = 0;
+    for (int s = 0; s < pixel_sample_count; ++s)
+    {
+        uint seed = sample_seed(pixel_index, previous_samples + s);
+        float2 offset = sample_offset(s, pixel_sample_count, seed, accumulation != 0);
+        Ray ray = camera_ray(x + offset.x, y + offset.y, width, height, camera_pos, camera_dir, fov);
+        float3 sample_color = trace_ray(ray, lights, num_lights, triangles, triangle_materials, normals, bvh_nodes, materials, light_tree, tlas_nodes, instances, seed, &secondary_rays);
+        color += sample_color;
+        luminance_squares += luminance(sample_color) * luminance(sample_color);
+    }
+
+    if (pixel_samples)
+    {
+        float4 total = previous_samples > 0 ? accumulation[pixel_index] : (float4)(0.0f);
+        total += (float4)(color, luminance_squares);
+        accumulation[pixel_index] = total;
+        pixel_samples[pixel_index] = previous_samples + pixel_sample_count;
+        color = total.xyz / (float)(previous_samples + pixel_sample_count);
+    }
+    else
+    {
+        color = resolve_pixel(color, pixel_index, samples, accumulation, accumulated_samples);
+    }
+
+    // Ray statistics are only gathered when a counter is bound, e.g. for benchmarking
+    if (ray_counts)
+        atomic_add(ray_counts, (uint)secondary_rays);
+
+    // Write to image in the format of the consumer
+    store_pixel(image, pixel_index, color);
+}
+
+__kernel void trace(__global OUTPUT_PIXEL* image,
+                    int width,
+                    int height,
+                    const __global float4* lights,
+                    int num_lights,
+                    const __global TriangleAccel* triangles,
+                    int num_triangles,
+                    const __global int* triangle_materials,
+                    const __global uint* normals,
+                    const __global BVH_NODE* bvh_nodes,
+                    const __global Material* materials,
+                    float4 camera_pos,
+                    float4 camera_dir,
+                    float fov,
+                    int samples,
+                    __global uint* ray_counts,
+                    __global float4* accumulation,
+                    int accumulated_samples,
+                    __global uint* work_counter,
+                    __global uint* pixel_samples,
+                    float adaptive_threshold,
+                    const __global LightTreeNode* light_tree,
+                    const __global BVHNode* tlas_nodes,
+                    const __global Instance* instances) 
+{
+    // Specialized variants replace the arguments by compile-time constants, so the loops over them can be unrolled
+#ifdef IMAGE_WIDTH
+    width = IMAGE_WIDTH;
+    height = IMAGE_HEIGHT;
+#endif
+#ifdef NUM_LIGHTS
+    num_lights = NUM_LIGHTS;
+#endif
+
+#ifdef PERSISTENT_THREADS
+    // Only enough work-groups to fill the device are launched. They pull batches of consecutive pixels from the
+    // work counter until the image is done, so groups that finished cheap sky pixels take over the remaining ones
+    // instead of idling next to groups tracing expensive reflective pixels
+    __local uint batch_start;
+    uint pixel_count = width * height;
+    for (;;)
+    {
+        if (get_local_id(0) == 0)
+            batch_start = atomic_add(work_counter, (uint)get_local_size(0));
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Every work item reads the batch before the next one is fetched, so the whole group leaves together
+        uint batch = batch_start;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (batch >= pixel_count)
+            return;
+
+        uint pixel_index = batch + get_local_id(0);
+        if (pixel_index < pixel_count)
+            trace_pixel(pixel_index % width, pixel_index / width, image, width, height, lights, num_lights, triangles, num_triangles, triangle_materials, normals, bvh_nodes, materials, camera_pos, camera_dir, fov, samples, ray_counts, accumulation, accumulated_samples, pixel_samples, adaptive_threshold, light_tree, tlas_nodes, instances);
+    }
+#else
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x >= width || y >= height) 
+        return;
+
+    trace_pixel(x, y, image, width, height, lights, num_lights, triangles, num_triangles, triangle_materials, normals, bvh_nodes, materials, camera_pos, camera_dir, fov, samples, ray_counts, accumulation, accumulated_samples, pixel_samples, adaptive_threshold, light_tree, tlas_nodes, instances);
+#endif
+}
+
+// Wavefront execution splits the megakernel into one kernel per stage. A sample pass generates a path per pixel,
+// then every bounce extends (intersects) the queued paths, shades them and compacts the surviving ones into
+// the queue of the next bounce. queue_sizes[b] holds the path count of bounce b, the kernels are launched over
+// the whole image and skip the work items past the queue size, so the host never waits on the queue counts.
+__kernel void wavefront_generate(__global PathState* paths,
+                                 __global float4* radiance,
+                                 int width,
+                                 int height,
+                                 float4 camera_pos,
+                                 float4 camera_dir,
+                                 float fov,
+                                 int sample,
+                                 int samples,
+                                 int accumulated_samples,
+                                 int accumulate)
+{
+#ifdef IMAGE_WIDTH
+    width = IMAGE_WIDTH;
+    height = IMAGE_HEIGHT;
+#endif
+
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x >= width || y >= height) 
+        return;
+
+    // Same jittered stratified sample as the megakernel
+    uint pixel_index = y * width + x;
+    uint seed = sample_seed(pixel_index, accumulated_samples + sample);
+    float2 offset = sample_offset(sample, samples, seed, accumulate != 0);
+    Ray ray = camera_ray(x + offset.x, y + offset.y, width, height, camera_pos, camera_dir, fov);
+
+    PathState path;
+    path.origin = (float4)(ray.origin, 0.0f);
+    path.direction = (float4)(ray.direction, 0.0f);
+    path.throughput = (float4)(1.0f, 1.0f, 1.0f, 0.0f);
+    path.pixel_index = pixel_index;
+    path.alive = 1;
+    path.rng = seed;
+    paths[pixel_index] = path;
+
+    // The first pass of the frame clears the sample sum
+    if (sample == 0)
+        radiance[pixel_index] = (float4)(0.0f);
+}
+
+__kernel void wavefront_extend(const __global PathState* paths,
+                               __global PathHit* hits,
+                               const __global uint* queue_sizes,
+                               int bounce,
+                               const __global TriangleAccel* triangles,
+                               const __global BVH_NODE* bvh_nodes,
+                               const __global BVHNode* tlas_nodes,
+                               const __global Instance* instances)
+{
+    int i = get_global_id(0);
+    if (i >= (int)queue_sizes[bounce])
+        return;
+
+    Ray ray;
+    ray.origin = paths[i].origin.xyz;
+    ray.direction = paths[i].direction.xyz;
+
+    PathHit hit;
+    hit.t_min = 1e20f;
+    float2 barycentric = (float2)(0.0f, 0.0f);
+    hit.hit_idx = intersect_scene(ray, bvh_nodes, tlas_nodes, instances, triangles, &hit.t_min, &barycentric, &hit.instance_idx);
+    hit.u = barycentric.x;
+    hit.v = barycentric.y;
+    hits[i] = hit;
+}
+
+__kernel void wavefront_shade(__global PathState* paths,
+                              const __global PathHit* hits,
+                              const __global uint* queue_sizes,
+                              int bounce,
+                              __global float4* radiance,
+                              const __global float4* lights,
+                              int num_lights,
+                              const __global TriangleAccel* triangles,
+                              const __global int* triangle_materials,
+                              const __global uint* normals,
+                              const __global BVH_NODE* bvh_nodes,
+                              const __global Material* materials,
+                              const __global LightTreeNode* light_tree,
+                              const __global BVHNode* tlas_nodes,
+                              const __global Instance* instances)
+{
+#ifdef NUM_LIGHTS
+    num_lights = NUM_LIGHTS;
+#endif
+
+    int i = get_global_id(0);
+    if (i >= (int)queue_sizes[bounce])
+        return;
+
+    PathState path = paths[i];
+    PathHit hit = hits[i];
+
+    Ray ray;
+    ray.origin = path.origin.xyz;
+    ray.direction = path.direction.xyz;
+    float3 throughput = path.throughput.xyz;
+    float3 color = (float3)(0.0f, 0.0f, 0.0f);
+
+    bool alive = shade_bounce(&ray, &throughput, &color, hit.hit_idx, hit.instance_idx, hit.t_min, (float2)(hit.u, hit.v), 
+                              lights, num_lights, triangles, triangle_materials, normals, bvh_nodes, materials, light_tree, tlas_nodes, instances, &path.rng);
+
+    // A pixel has a single path in flight per sample pass, so its sample sum is updated without atomics
+    radiance[path.pixel_index] += (float4)(color, 0.0f);
+
+    path.origin = (float4)(ray.origin, 0.0f);
+    path.direction = (float4)(ray.direction, 0.0f);
+    path.throughput = (float4)(throughput, 0.0f);
+    path.alive = alive && bounce + 1 < MAX_BOUNCES;
+    paths[i] = path;
+}
+
+__kernel void wavefront_compact(const __global PathState* paths,
+                                __global PathState* next_paths,
+                                __global uint* queue_sizes,
+                                int bounce,
+                                __global uint* ray_counts)
+{
+    int i = get_global_id(0);
+    if (i >= (int)queue_sizes[bounce])
+        return;
+
+    PathState path = paths[i];
+    if (!path.alive)
+        return;
+
+    // Terminated paths drop out, so the next bounce only launches coherent work for the surviving ones
+    next_paths[atomic_inc(&queue_sizes[bounce + 1])] = path;
+
+    // Every surviving path traces a secondary ray, counted the same as in the megakernel
+    if (ray_counts)
+        atomic_inc(ray_counts);
+}
+
+// Ray reordering bins the secondary rays by direction octant and origin cell, so neighbouring work items
+// traverse the same BVH nodes and fetch the same triangles after a reflection
+#define RAY_SORT_GRID 4
+#define RAY_SORT_BINS (8 * RAY_SORT_GRID * RAY_SORT_GRID * RAY_SORT_GRID)
+
+uint ray_sort_key(float3 origin, float3 direction, float4 scene_min, float4 scene_max)
+{
+    // The octant is the most significant part, rays leaving in the same directions stay together across cells
+    uint octant = (direction.x < 0.0f ? 1 : 0) | (direction.y < 0.0f ? 2 : 0) | (direction.z < 0.0f ? 4 : 0);
+
+    float3 extent = fmax(scene_max.xyz - scene_min.xyz, (float3)(EPSILON));
+    float3 cell = clamp((origin - scene_min.xyz) / extent, 0.0f, 0.999f) * RAY_SORT_GRID;
+    uint cell_index = ((uint)cell.z * RAY_SORT_GRID + (uint)cell.y) * RAY_SORT_GRID + (uint)cell.x;
+
+    return octant * RAY_SORT_GRID * RAY_SORT_GRID * RAY_SORT_GRID + cell_index;
+}
+
+// Counting sort of a path queue: count the keys per bin, turn the counts into bin offsets and scatter the paths
+__kernel void wavefront_sort_count(const __global PathState* paths,
+                                   const __global uint* queue_sizes,
+                                   int bounce,
+                                   __global uint* keys,
+                                   __global uint* bins,
+                                   float4 scene_min,
+                                   float4 scene_max)
+{
+    int i = get_global_id(0);
+    if (i >= (int)queue_sizes[bounce])
+        return;
+
+    uint key = ray_sort_key(paths[i].origin.xyz, paths[i].direction.xyz, scene_min, scene_max);
+    keys[i] = key;
+    atomic_inc(&bins[key]);
+}
+
+// Exclusive prefix sum over the bins, few enough for a single work item
+__kernel void wavefront_sort_offsets(__global uint* bins)
+{
+    uint offset = 0;
+    for (int b = 0; b < RAY_SORT_BINS; ++b)
+    {
+        uint count = bins[b];
+        bins[b] = offset;
+        offset += count;
+    }
+}
+
+__kernel void wavefront_sort_scatter(const __global PathState* paths,
+                                     __global PathState* sorted_paths,
+                                     const __global uint* queue_sizes,
+                                     int bounce,
+                                     const __global uint* keys,
+                                     __global uint* bins)
+{
+    int i = get_global_id(0);
+    if (i >= (int)queue_sizes[bounce])
+        return;
+
+    sorted_paths[atomic_inc(&bins[keys[i]])] = paths[i];
+}
+
+__kernel void wavefront_resolve(__global OUTPUT_PIXEL* image,
+                                const __global float4* radiance,
+                                int width,
+                                int height,
+                                int samples,
+                                __global float4* accumulation,
+                                int accumulated_samples)
+{
+#ifdef IMAGE_WIDTH
+    width = IMAGE_WIDTH;
+    height = IMAGE_HEIGHT;
+#endif
+
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x >= width || y >= height) 
+        return;
+
+    uint pixel_index = y * width + x;
+    float3 color = resolve_pixel(radiance[pixel_index].xyz, pixel_index, samples, accumulation, accumulated_samples);
+
+    store_pixel(image, pixel_index, color);
+}
+
+// Refits one depth level of the binary BVH to the current triangles. The host launches the levels from the
+// deepest one up to the root, so the children of every node were refit by the previous launch
+__kernel void refit_bvh(__global BVHNode* nodes,
+                        const __global TriangleAccel* triangles,
+                        const __global int* level_nodes,
+                        int level_start,
+                        int level_count)
+{
+    int i = get_global_id(0);
+    if (i >= level_count)
+        return;
+
+    int node_idx = level_nodes[level_start + i];
+    BVHNode node = nodes[node_idx];
+
+    float3 box_min = (float3)(FLT_MAX);
+    float3 box_max = (float3)(-FLT_MAX);
+    if (node.mLeft < 0)
+    {
+        // The vertices are rebuilt from the edges the intersection test uses, so the bounds enclose exactly what is hit
+        for (int t = node.mStart; t < node.mStart + node.mCount; ++t)
         {
-            break;
+            TriangleAccel triangle = triangles[t];
+            float3 v0 = triangle.vertex_0.xyz;
+            float3 v1 = v0 + triangle.edge_1.xyz;
+            float3 v2 = v0 + triangle.edge_2.xyz;
+            box_min = fmin(box_min, fmin(v0, fmin(v1, v2)));
+            box_max = fmax(box_max, fmax(v0, fmax(v1, v2)));
         }
     }
+    else
+    {
+        AABB left = nodes[node.mLeft].mBounds;
+        AABB right = nodes[node.mRight].mBounds;
+        box_min = fmin(left.min.xyz, right.min.xyz);
+        box_max = fmax(left.max.xyz, right.max.xyz);
+    }
 
-    // Write to image
-    image[y * width + x] = (uchar4)((uchar)(clamp(color.x, 0.0f, 1.0f) * 255),
-                                    (uchar)(clamp(color.y, 0.0f, 1.0f) * 255),
-                                    (uchar)(clamp(color.z, 0.0f, 1.0f) * 255), 255);
+    nodes[node_idx].mBounds.min = (float4)(box_min, 0.0f);
+    nodes[node_idx].mBounds.max = (float4)(box_max, 0.0f);
 }
@@ -0,0 +1,583 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <numeric>
+
+AABB AABB::Empty()
+{
+	return AABB(Vector4f(FLT_MAX, FLT_MAX, FLT_MAX, 0),
+				Vector4f(-FLT_MAX, -FLT_MAX, -FLT_MAX, 0));
+}
+
+void AABB::Grow(const Vector4f& point)
+{
+	mMin = ComponentMinimum(mMin, point);
+	mMax = ComponentMaximum(mMax, point);
+}
+
+void AABB::Grow(const AABB& other)
+{
+	mMin = ComponentMinimum(mMin, other.mMin);
+	mMax = ComponentMaximum(mMax, other.mMax);
+}
+
+Vector4f AABB::Center() const
+{
+	return (mMin + mMax) * 0.5f;
+}
+
+float AABB::SurfaceArea() const
+{
+	if (!IsValid())
+		return 0.0f;
+
+	const Vector4f extent = mMax - mMin;
+	return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+}
+
+bool AABB::IsValid() const
+{
+	return mMin.x <= mMax.x && mMin.y <= mMax.y && mMin.z <= mMax.z;
+}
+
+const char* ToString(BVHBuildMethod method)
+{
+	switch (method)
+	{
+		case BVHBuildMethod::Median:
+			return "Median";
+		case BVHBuildMethod::BinnedSAH:
+			return "Binned SAH";
+	}
+	return "Unknown";
+}
+
+AABB ComputeAABB(const SceneGeometry& geometry, const IndexedTriangle& triangle)
+{
+	AABB aabb = AABB::Empty();
+	aabb.Grow(geometry.vertices[triangle.index_0]);
+	aabb.Grow(geometry.vertices[triangle.index_1]);
+	aabb.Grow(geometry.vertices[triangle.index_2]);
+	return aabb;
+}
+
+namespace
+{
+	// Ranges at least this large compute their bounds, bins and partitions across the pool
+	constexpr int kParallelSplitThreshold = 1 << 15;
+	// Subtrees at least this large are handed to the pool as independent build tasks
+	constexpr int kSubtreeTaskThreshold = 1 << 10;
+	// Chunk size of the parallel range operations
+	constexpr int kParallelGrainSize = 1 << 13;
+
+	struct BuildContext
+	{
+		const std::vector<AABB>& mBounds;
+		const std::vector<Vector4f>& mCentroids;
+		std::vector<int>& mOrder;
+		const BVHBuildSettings& mSettings;
+		std::vector<BVHNode>& mNodes;
+		std::atomic<int>& mNodeCount;
+		ThreadPool* mPool = nullptr;
+	};
+
+	struct RangeInfo
+	{
+		AABB mBounds = AABB::Empty();
+		AABB mCentroidBounds = AABB::Empty();
+	};
+
+	struct Bin
+	{
+		AABB mBounds = AABB::Empty();
+		int mCount = 0;
+	};
+
+	inline bool UseParallel(const BuildContext& ctx, int start, int end)
+	{
+		return ctx.mPool && ctx.mPool->GetThreadCount() > 1 && end - start >= kParallelSplitThreshold;
+	}
+
+	inline int BinIndex(float centroid, float axisMin, float scale, int binCount)
+	{
+		return std::clamp(static_cast<int>((centroid - axisMin) * scale), 0, binCount - 1);
+	}
+
+	RangeInfo ComputeRangeInfo(const BuildContext& ctx, int start, int end)
+	{
+		RangeInfo info;
+		for (int i = start; i < end; ++i)
+		{
+			const int primitive = ctx.mOrder[i];
+			info.mBounds.Grow(ctx.mBounds[primitive]);
+			info.mCentroidBounds.Grow(ctx.mCentroids[primitive]);
+		}
+		return info;
+	}
+
+	RangeInfo ComputeRangeInfoParallel(const BuildContext& ctx, int start, int end)
+	{
+		const int chunkCount = (end - start + kParallelGrainSize - 1) / kParallelGrainSize;
+		std::vector<RangeInfo> chunks(chunkCount);
+
+		ctx.mPool->ParallelFor(start, end, kParallelGrainSize, [&ctx, &chunks, start](int chunkStart, int chunkEnd)
+		{
+			chunks[(chunkStart - start) / kParallelGrainSize] = ComputeRangeInfo(ctx, chunkStart, chunkEnd);
+		});
+
+		RangeInfo info;
+		for (const RangeInfo& chunk : chunks)
+		{
+			info.mBounds.Grow(chunk.mBounds);
+			info.mCentroidBounds.Grow(chunk.mCentroidBounds);
+		}
+		return info;
+	}
+
+	// Bins the range along all three axes at once, bins is laid out as [axis * binCount + bin]
+	void BinRange(const BuildContext& ctx, int start, int end, const AABB& centroidBounds, int binCount, std::vector<Bin>& bins)
+	{
+		bins.assign(3 * binCount, Bin());
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const float axisMin = centroidBounds.mMin[axis];
+			const float extent = centroidBounds.mMax[axis] - axisMin;
+			if (extent <= 0.0f)
+				continue;
+
+			const float scale = binCount / extent;
+			Bin* axisBins = &bins[axis * binCount];
+			for (int i = start; i < end; ++i)
+			{
+				const int primitive = ctx.mOrder[i];
+				Bin& bin = axisBins[BinIndex(ctx.mCentroids[primitive][axis], axisMin, scale, binCount)];
+				bin.mCount++;
+				bin.mBounds.Grow(ctx.mBounds[primitive]);
+			}
+		}
+	}
+
+	void BinRangeParallel(const BuildContext& ctx, int start, int end, const AABB& centroidBounds, int binCount, std::vector<Bin>& bins)
+	{
+		const int chunkCount = (end - start + kParallelGrainSize - 1) / kParallelGrainSize;
+		std::vector<std::vector<Bin>> chunks(chunkCount);
+
+		ctx.mPool->ParallelFor(start, end, kParallelGrainSize, [&](int chunkStart, int chunkEnd)
+		{
+			BinRange(ctx, chunkStart, chunkEnd, centroidBounds, binCount, chunks[(chunkStart - start) / kParallelGrainSize]);
+		});
+
+		bins.assign(3 * binCount, Bin());
+		for (const std::vector<Bin>& chunk : chunks)
+		{
+			for (size_t i = 0; i < bins.size(); ++i)
+			{
+				bins[i].mCount += chunk[i].mCount;
+				bins[i].mBounds.Grow(chunk[i].mBounds);
+			}
+		}
+	}
+
+	template<typename Predicate>
+	int PartitionRange(const BuildContext& ctx, int start, int end, Predicate predicate)
+	{
+		if (!UseParallel(ctx, start, end))
+		{
+			auto midIt = std::partition(ctx.mOrder.begin() + start, ctx.mOrder.begin() + end, predicate);
+			return static_cast<int>(midIt - ctx.mOrder.begin());
+		}
+
+		// Count the left side of every chunk, then scatter each chunk to its prefix offsets
+		const int chunkCount = (end - start + kParallelGrainSize - 1) / kParallelGrainSize;
+		std::vector<int> leftCounts(chunkCount, 0);
+
+		ctx.mPool->ParallelFor(start, end, kParallelGrainSize, [&](int chunkStart, int chunkEnd)
+		{
+			int count = 0;
+			for (int i = chunkStart; i < chunkEnd; ++i)
+				count += predicate(ctx.mOrder[i]) ? 1 : 0;
+			leftCounts[(chunkStart - start) / kParallelGrainSize] = count;
+		});
+
+		std::vector<int> leftOffsets(chunkCount, 0);
+		std::vector<int> rightOffsets(chunkCount, 0);
+
+		int totalLeft = 0;
+		for (int c = 0; c < chunkCount; ++c)
+		{
+			leftOffsets[c] = totalLeft;
+			totalLeft += leftCounts[c];
+		}
+		int totalRight = totalLeft;
+		for (int c = 0; c < chunkCount; ++c)
+		{
+			const int chunkSize = std::min(kParallelGrainSize, end - start - c * kParallelGrainSize);
+			rightOffsets[c] = totalRight;
+			totalRight += chunkSize - leftCounts[c];
+		}
+
+		std::vector<int> scratch(end - start);
+		ctx.mPool->ParallelFor(start, end, kParallelGrainSize, [&](int chunkStart, int chunkEnd)
+		{
+			const int chunk = (chunkStart - start) / kParallelGrainSize;
+			int left = leftOffsets[chunk];
+			int right = rightOffsets[chunk];
+			for (int i = chunkStart; i < chunkEnd; ++i)
+			{
+				const int primitive = ctx.mOrder[i];
+				scratch[predicate(primitive) ? left++ : right++] = primitive;
+			}
+		});
+
+		ctx.mPool->ParallelFor(start, end, kParallelGrainSize, [&](int chunkStart, int chunkEnd)
+		{
+			std::copy(scratch.begin() + (chunkStart - start), scratch.begin() + (chunkEnd - start), ctx.mOrder.begin() + chunkStart);
+		});
+
+		return start + totalLeft;
+	}
+
+	int SplitMedian(const BuildContext& ctx, int start, int end, const AABB& bounds)
+	{
+		const Vector4f size = bounds.mMax - bounds.mMin;
+		const int axis = (size.x > size.y && size.x > size.z) ? 0 : (size.y > size.z ? 1 : 2);
+
+		const int mid = start + (end - start) / 2;
+		std::nth_element(ctx.mOrder.begin() + start, ctx.mOrder.begin() + mid, ctx.mOrder.begin() + end,
+						 [&ctx, axis](int a, int b)
+						 {
+							return ctx.mCentroids[a][axis] < ctx.mCentroids[b][axis];
+						 });
+		return mid;
+	}
+
+	int SplitBinnedSAH(const BuildContext& ctx, int start, int end, const RangeInfo& info)
+	{
+		const BVHBuildSettings& settings = ctx.mSettings;
+		const int count = end - start;
+		const int binCount = std::max(2, settings.mBinCount);
+
+		std::vector<Bin> bins;
+		if (UseParallel(ctx, start, end))
+			BinRangeParallel(ctx, start, end, info.mCentroidBounds, binCount, bins);
+		else
+			BinRange(ctx, start, end, info.mCentroidBounds, binCount, bins);
+
+		const float parentArea = std::max(info.mBounds.SurfaceArea(), FLT_MIN);
+
+		int bestAxis = -1;
+		int bestBin = -1;
+		float bestCost = FLT_MAX;
+
+		std::vector<float> rightAreas(binCount, 0.0f);
+		std::vector<int> rightCounts(binCount, 0);
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (info.mCentroidBounds.mMax[axis] - info.mCentroidBounds.mMin[axis] <= 0.0f)
+				continue;
+
+			const Bin* axisBins = &bins[axis * binCount];
+
+			// Sweep from the right to gather the right side of every split plane
+			AABB rightBounds = AABB::Empty();
+			int rightCount = 0;
+			for (int b = binCount - 1; b > 0; --b)
+			{
+				rightBounds.Grow(axisBins[b].mBounds);
+				rightCount += axisBins[b].mCount;
+				rightAreas[b] = rightBounds.SurfaceArea();
+				rightCounts[b] = rightCount;
+			}
+
+			// Sweep from the left, evaluating the split plane after each bin
+			AABB leftBounds = AABB::Empty();
+			int leftCount = 0;
+			for (int b = 0; b < binCount - 1; ++b)
+			{
+				leftBounds.Grow(axisBins[b].mBounds);
+				leftCount += axisBins[b].mCount;
+
+				if (leftCount == 0 || rightCounts[b + 1] == 0)
+					continue;
+
+				const float cost = settings.mTraversalCost +
+								   settings.mIntersectionCost * (leftCount * leftBounds.SurfaceArea() + 
+																 rightCounts[b + 1] * rightAreas[b + 1]) / parentArea;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b + 1;
+				}
+			}
+		}
+
+		const float leafCost = settings.mIntersectionCost * count;
+		if (count <= settings.mMaxTrianglesPerLeaf && (bestAxis < 0 || leafCost <= bestCost))
+			return -1;
+
+		// Coincident centroids, fall back to an object median split to keep the leaves bounded
+		if (bestAxis < 0)
+			return SplitMedian(ctx, start, end, info.mBounds);
+
+		const float axisMin = info.mCentroidBounds.mMin[bestAxis];
+		const float scale = binCount / (info.mCentroidBounds.mMax[bestAxis] - axisMin);
+		const int mid = PartitionRange(ctx, start, end, 
+									   [&ctx, bestAxis, bestBin, binCount, axisMin, scale](int primitive)
+									   {
+											return BinIndex(ctx.mCentroids[primitive][bestAxis], axisMin, scale, binCount) < bestBin;
+									   });
+
+		if (mid == start || mid == end)
+			return SplitMedian(ctx, start, end, info.mBounds);
+		return mid;
+	}
+
+	int SplitRange(const BuildContext& ctx, int start, int end, const RangeInfo& info)
+	{
+		const int count = end - start;
+		if (count <= 1)
+			return -1;
+
+		if (ctx.mSettings.mMethod == BVHBuildMethod::Median)
+		{
+			if (count <= ctx.mSettings.mMaxTrianglesPerLeaf)
+				return -1;
+			return SplitMedian(ctx, start, end, info.mBounds);
+		}
+		return SplitBinnedSAH(ctx, start, end, info);
+	}
+
+	void BuildSubtree(BuildContext& ctx, int rootStart, int rootEnd, int rootNodeIndex)
+	{
+		struct BuildTask
+		{
+			int mStart = 0;
+			int mEnd = 0;
+			int mNodeIndex = 0;
+		};
+
+		std::vector<BuildTask> stack;
+		stack.push_back({rootStart, rootEnd, rootNodeIndex});
+
+		while (!stack.empty())
+		{
+			BuildTask task = stack.back();
+			stack.pop_back();
+
+			const int start = task.mStart;
+			const int end = task.mEnd;
+			const int nodeIndex = task.mNodeIndex;
+
+			const RangeInfo info = UseParallel(ctx, start, end) ? ComputeRangeInfoParallel(ctx, start, end) : 
+																  ComputeRangeInfo(ctx, start, end);
+			ctx.mNodes[nodeIndex].mBounds = info.mBounds;
+
+			const int mid = SplitRange(ctx, start, end, info);
+			if (mid < 0)
+			{
+				BVHNode& node = ctx.mNodes[nodeIndex];
+				node.mStart = start;
+				node.mCount = end - start;
+				node.mLeft = -1;
+				node.mRight = -1;
+				continue;
+			}
+
+			// Children are allocated as a pair so they stay adjacent in the node array
+			const int leftChild = ctx.mNodeCount.fetch_add(2);
+			const int rightChild = leftChild + 1;
+
+			BVHNode& node = ctx.mNodes[nodeIndex];
+			node.mLeft = leftChild;
+			node.mRight = rightChild;
+			node.mStart = -1;
+			node.mCount = -1;
+
+			// Hand large independent subtrees to the pool, keep the rest on the local stack
+			if (ctx.mPool && ctx.mPool->GetThreadCount() > 1 && end - mid >= kSubtreeTaskThreshold)
+			{
+				ctx.mPool->Submit([&ctx, mid, end, rightChild]()
+				{
+					BuildSubtree(ctx, mid, end, rightChild);
+				});
+			}
+			else
+			{
+				stack.push_back({mid, end, rightChild});
+			}
+			stack.push_back({start, mid, leftChild});
+		}
+	}
+}
+
+void ConstructBVH(std::vector<BVHNode>& nodes,
+				  const std::vector<AABB>& primitiveBounds,
+				  std::vector<int>& primitiveOrder,
+				  const BVHBuildSettings& settings,
+				  ThreadPool* pool)
+{
+	const int primitiveCount = static_cast<int>(primitiveBounds.size());
+
+	primitiveOrder.resize(primitiveCount);
+	std::iota(primitiveOrder.begin(), primitiveOrder.end(), 0);
+
+	// Centroids are computed once up front rather than inside every comparison
+	std::vector<Vector4f> centroids(primitiveCount);
+	if (pool)
+	{
+		pool->ParallelFor(0, primitiveCount, kParallelGrainSize, [&](int start, int end)
+		{
+			for (int i = start; i < end; ++i)
+				centroids[i] = primitiveBounds[i].Center();
+		});
+	}
+	else
+	{
+		for (int i = 0; i < primitiveCount; ++i)
+			centroids[i] = primitiveBounds[i].Center();
+	}
+
+	// A binary tree over N primitives never exceeds 2N - 1 nodes
+	nodes.clear();
+	nodes.resize(std::max(1, primitiveCount * 2 - 1));
+
+	std::atomic<int> nodeCount(1);
+	BuildContext ctx = { primitiveBounds, centroids, primitiveOrder, settings, nodes, nodeCount, pool };
+
+	BuildSubtree(ctx, 0, primitiveCount, 0);
+	if (pool)
+		pool->Wait();
+
+	nodes.resize(nodeCount);
+}
+
+void ConstructBVH(std::vector<BVHNode>& nodes,
+				  SceneGeometry& geometry,
+				  const BVHBuildSettings& settings,
+				  ThreadPool* pool)
+{
+	std::vector<IndexedTriangle>& triangles = geometry.triangles;
+
+	std::vector<AABB> bounds(triangles.size());
+	for (size_t i = 0; i < triangles.size(); ++i)
+		bounds[i] = ComputeAABB(geometry, triangles[i]);
+
+	std::vector<int> order;
+	ConstructBVH(nodes, bounds, order, settings, pool);
+
+	std::vector<IndexedTriangle> ordered;
+	ordered.reserve(triangles.size());
+	for (int index : order)
+		ordered.emplace_back(triangles[index]);
+	triangles.swap(ordered);
+}
+
+float ComputeSAHCost(const std::vector<BVHNode>& nodes,
+					 const BVHBuildSettings& settings)
+{
+	if (nodes.empty())
+		return 0.0f;
+
+	const float rootArea = nodes[0].mBounds.SurfaceArea();
+	if (rootArea <= 0.0f)
+		return 0.0f;
+
+	double cost = 0.0;
+	for (const BVHNode& node : nodes)
+	{
+		const float area = node.mBounds.SurfaceArea();
+		if (node.IsLeaf())
+			cost += settings.mIntersectionCost * node.mCount * area;
+		else
+			cost += settings.mTraversalCost * area;
+	}
+	return static_cast<float>(cost / rootArea);
+}
+
+float ComputeTriangleRelativeSAHCost(const std::vector<BVHNode>& nodes,
+									 const SceneGeometry& geometry,
+									 const BVHBuildSettings& settings)
+{
+	double triangleArea = 0.0;
+	for (const IndexedTriangle& triangle : geometry.triangles)
+		triangleArea += ComputeAABB(geometry, triangle).SurfaceArea();
+	if (nodes.empty() || triangleArea <= 0.0)
+		return 0.0f;
+
+	return static_cast<float>(ComputeSAHCost(nodes, settings) * nodes[0].mBounds.SurfaceArea() / triangleArea);
+}
+
+int ComputeBVHDepth(const std::vector<BVHNode>& nodes, int root)
+{
+	if (root < 0 || root >= static_cast<int>(nodes.size()))
+		return 0;
+
+	// A reverse pass visits every child before its parent
+	std::vector<int> depths(nodes.size(), 0);
+	for (int i = static_cast<int>(nodes.size()) - 1; i >= root; --i)
+	{
+		const BVHNode& node = nodes[i];
+		if (!node.IsLeaf())
+			depths[i] = 1 + std::max(depths[node.mLeft], depths[node.mRight]);
+	}
+	return depths[root];
+}
+
+void RefitBVH(std::vector<BVHNode>& nodes, const std::vector<AABB>& primitiveBounds)
+{
+	for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; --i)
+	{
+		BVHNode& node = nodes[i];
+
+		AABB bounds = AABB::Empty();
+		if (node.IsLeaf())
+		{
+			for (int primitive = node.mStart; primitive < node.mStart + node.mCount; ++primitive)
+				bounds.Grow(primitiveBounds[primitive]);
+		}
+		else
+		{
+			bounds.Grow(nodes[node.mLeft].mBounds);
+			bounds.Grow(nodes[node.mRight].mBounds);
+		}
+		node.mBounds = bounds;
+	}
+}
+
+void RefitBVH(std::vector<BVHNode>& nodes, const SceneGeometry& geometry)
+{
+	std::vector<AABB> bounds(geometry.triangles.size());
+	for (size_t i = 0; i < geometry.triangles.size(); ++i)
+		bounds[i] = ComputeAABB(geometry, geometry.triangles[i]);
+
+	RefitBVH(nodes, bounds);
+}
+
+BVHQualityMonitor::BVHQualityMonitor(float rebuildThreshold)
+	: mRebuildThreshold(rebuildThreshold)
+{
+}
+
+void BVHQualityMonitor::OnBuild(float sahCost)
+{
+	mBuildCost = sahCost;
+	mCost = sahCost;
+	mRefitCount = 0;
+}
+
+bool BVHQualityMonitor::OnRefit(float sahCost)
+{
+	mCost = sahCost;
+	++mRefitCount;
+	return GetDegradation() > mRebuildThreshold;
+}
+
+float BVHQualityMonitor::GetDegradation() const
+{
+	return mBuildCost > 0.0f ? mCost / mBuildCost : 1.0f;
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "MeshDefines.h"
+#include "SceneGeometry.h"
+#include "ThreadPool.h"
+
+#include <vector>
+
+/// <summary>
+/// Axis aligned bounding box.
+/// </summary>
+struct AABB
+{
+public:
+	AABB() = default;
+
+	AABB(const Vector4f& min, const Vector4f& max)
+		: mMin(min),
+		mMax(max)
+	{
+	}
+public:
+	/// <summary>
+	/// Creates an inverted bounding box that any grow operation will overwrite.
+	/// </summary>
+	/// <returns>The empty bounding box</returns>
+	static AABB Empty();
+
+	/// <summary>
+	/// Expands the bounding box to contain the passed point.
+	/// </summary>
+	/// <param name="point">The point to contain</param>
+	void Grow(const Vector4f& point);
+
+	/// <summary>
+	/// Expands the bounding box to contain the passed bounding box.
+	/// </summary>
+	/// <param name="other">The bounding box to contain</param>
+	void Grow(const AABB& other);
+
+	/// <summary>
+	/// Retrieves the center point of the bounding box.
+	/// </summary>
+	/// <returns>The center point</returns>
+	Vector4f Center() const;
+
+	/// <summary>
+	/// Retrieves the surface area of the bounding box.
+	/// </summary>
+	/// <returns>The surface area, or zero for an empty box</returns>
+	float SurfaceArea() const;
+
+	/// <summary>
+	/// Checks whether the bounding box contains at least one point.
+	/// </summary>
+	/// <returns>True if the bounding box is valid, otherwise false</returns>
+	bool IsValid() const;
+public:
+	Vector4f mMin;
+	Vector4f mMax;
+};
+
+struct BVHNode
+{
+public:
+	inline bool IsLeaf() const { return mLeft < 0; }
+public:
+	AABB mBounds;
+	int mLeft = -1;
+	int mRight = -1;
+	int mStart = 0;
+	int mCount = 0;
+};
+static_assert(sizeof(BVHNode) == 48, "BVHNode must match the OpenCL BVHNode layout");
+
+enum class BVHBuildMethod
+{
+	Median,
+	BinnedSAH
+};
+
+/// <summary>
+/// Configuration of the BVH construction.
+/// </summary>
+struct BVHBuildSettings
+{
+	BVHBuildMethod mMethod = BVHBuildMethod::BinnedSAH;
+	int mMaxTrianglesPerLeaf = 4;
+	int mBinCount = 16;
+	float mTraversalCost = 1.0f;
+	float mIntersectionCost = 1.0f;
+};
+
+/// <summary>
+/// Retrieves the display name of the build method.
+/// </summary>
+/// <param name="method">The build method</param>
+/// <returns>The display name</returns>
+const char* ToString(BVHBuildMethod method);
+
+/// <summary>
+/// Computes the bounding box of a single triangle.
+/// </summary>
+/// <param name="geometry">The geometry providing the shared vertices</param>
+/// <param name="triangle">The triangle</param>
+/// <returns>The bounding box</returns>
+AABB ComputeAABB(const SceneGeometry& geometry, const IndexedTriangle& triangle);
+
+/// <summary>
+/// Constructs a BVH over arbitrary primitive bounds.
+/// The leaves reference ranges of the output primitive order, so the caller is
+/// expected to reorder its primitives by primitiveOrder before uploading them.
+/// </summary>
+/// <param name="nodes">The output nodes, the root is at index 0</param>
+/// <param name="primitiveBounds">The bounds of each primitive</param>
+/// <param name="primitiveOrder">The output primitive indices in leaf order</param>
+/// <param name="settings">The build settings</param>
+/// <param name="pool">Optional thread pool building independent subtrees and large ranges in parallel</param>
+void ConstructBVH(std::vector<BVHNode>& nodes,
+				  const std::vector<AABB>& primitiveBounds,
+				  std::vector<int>& primitiveOrder,
+				  const BVHBuildSettings& settings = BVHBuildSettings(),
+				  ThreadPool* pool = nullptr);
+
+/// <summary>
+/// Constructs a BVH over the scene triangles and reorders them to match the leaf ranges.
+/// The shared vertex buffers are left untouched.
+/// </summary>
+/// <param name="nodes">The output nodes, the root is at index 0</param>
+/// <param name="geometry">The geometry to build over, its triangles are reordered in place</param>
+/// <param name="settings">The build settings</param>
+/// <param name="pool">Optional thread pool building independent subtrees and large ranges in parallel</param>
+void ConstructBVH(std::vector<BVHNode>& nodes,
+				  SceneGeometry& geometry,
+				  const BVHBuildSettings& settings = BVHBuildSettings(),
+				  ThreadPool* pool = nullptr);
+
+/// <summary>
+/// Computes the surface area heuristic cost of the tree, relative to the root surface area.
+/// </summary>
+/// <param name="nodes">The tree nodes</param>
+/// <param name="settings">The settings providing the traversal and intersection costs</param>
+/// <returns>The expected cost of tracing a random ray through the tree</returns>
+float ComputeSAHCost(const std::vector<BVHNode>& nodes,
+					 const BVHBuildSettings& settings = BVHBuildSettings());
+
+/// <summary>
+/// Computes the surface area heuristic cost of the tree relative to the summed surface area of the triangle bounds.
+/// The root relative cost drops as soon as the triangles spread out, even if a refit left the nodes overlapping,
+/// while this one keeps measuring the node area the tree adds on top of its triangles.
+/// </summary>
+/// <param name="nodes">The tree nodes</param>
+/// <param name="geometry">The geometry the tree was built over</param>
+/// <param name="settings">The settings providing the traversal and intersection costs</param>
+/// <returns>The cost of the tree per unit of triangle surface area</returns>
+float ComputeTriangleRelativeSAHCost(const std::vector<BVHNode>& nodes,
+									 const SceneGeometry& geometry,
+									 const BVHBuildSettings& settings = BVHBuildSettings());
+
+/// <summary>
+/// Computes the depth of the subtree, the number of inner nodes on its longest path to a leaf.
+/// Relies on the builders allocating the children after their parent, like RefitBVH.
+/// </summary>
+/// <param name="nodes">The tree nodes</param>
+/// <param name="root">The root node of the subtree, e.g. of a bottom level BVH</param>
+/// <returns>The depth, 0 for a single leaf</returns>
+int ComputeBVHDepth(const std::vector<BVHNode>& nodes, int root = 0);
+
+/// <summary>
+/// Refits the bounds of a BVH bottom-up while keeping its topology, e.g. after the primitives moved.
+/// Relies on the builders allocating the children after their parent, so a reverse pass over the nodes
+/// visits every child before its parent.
+/// </summary>
+/// <param name="nodes">The tree nodes, their bounds are updated in place</param>
+/// <param name="primitiveBounds">The bounds of each primitive in leaf order</param>
+void RefitBVH(std::vector<BVHNode>& nodes, const std::vector<AABB>& primitiveBounds);
+
+/// <summary>
+/// Refits the bounds of a BVH constructed over the scene triangles to their current vertex positions.
+/// </summary>
+/// <param name="nodes">The tree nodes, their bounds are updated in place</param>
+/// <param name="geometry">The geometry the tree was built over, its triangles in leaf order</param>
+void RefitBVH(std::vector<BVHNode>& nodes, const SceneGeometry& geometry);
+
+/// <summary>
+/// Watches the SAH cost of a refitted BVH. Refitting keeps the split decisions of the last build,
+/// which grow loose once the primitives moved far from where they were built, so a full rebuild
+/// is requested once the cost degraded past the threshold relative to the last build.
+///
+/// Usage:
+///		monitor.OnBuild(ComputeTriangleRelativeSAHCost(nodes, geometry, settings));
+///		RefitBVH(nodes, geometry);
+///		if (monitor.OnRefit(ComputeTriangleRelativeSAHCost(nodes, geometry, settings)))
+///			Rebuild();
+/// </summary>
+class BVHQualityMonitor
+{
+public:
+	/// <summary>
+	/// Constructor initializing a BVHQualityMonitor.
+	/// </summary>
+	/// <param name="rebuildThreshold">The ratio of the refitted to the built cost that requests a rebuild</param>
+	explicit BVHQualityMonitor(float rebuildThreshold = 1.3f);
+public:
+	/// <summary>
+	/// Records the cost of a freshly built tree as the new baseline.
+	/// </summary>
+	/// <param name="sahCost">The SAH cost of the built tree</param>
+	void OnBuild(float sahCost);
+
+	/// <summary>
+	/// Records the cost of the refitted tree.
+	/// </summary>
+	/// <param name="sahCost">The SAH cost of the refitted tree</param>
+	/// <returns>True if the tree degraded past the threshold and should be rebuilt, otherwise false</returns>
+	bool OnRefit(float sahCost);
+
+	/// <summary>
+	/// Retrieves the cost of the current tree relative to its last build.
+	/// </summary>
+	/// <returns>The degradation, 1 for a freshly built tree</returns>
+	float GetDegradation() const;
+
+	inline float GetBuildCost() const { return mBuildCost; }
+
+	inline float GetCost() const { return mCost; }
+
+	inline int GetRefitCount() const { return mRefitCount; }
+
+	inline float GetRebuildThreshold() const { return mRebuildThreshold; }
+private:
+	float mRebuildThreshold;
+	float mBuildCost = 0.0f;
+	float mCost = 0.0f;
+
+	// Refits since the last build
+	int mRefitCount = 0;
+};
@@ -0,0 +1,118 @@
+#include "BVHRefitter.h"
+
+#include "OpenCLUtils.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+BVHRefitter::BVHRefitter(cl_context context, cl_program program, size_t maxNodes)
+	: mMaxNodes(maxNodes)
+{
+	cl_int err = 0;
+	mRefitKernel = clCreateKernel(program, "refit_bvh", &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the refit_bvh kernel");
+		return;
+	}
+
+	mLevelNodesBuffer = OpenCLUtils::create_device_buffer(context, std::max<size_t>(1, mMaxNodes) * sizeof(int));
+	if (!mLevelNodesBuffer)
+	{
+		perror("Couldn't create the refit level buffer");
+		return;
+	}
+
+	err = clSetKernelArg(mRefitKernel, 2, sizeof(cl_mem), &mLevelNodesBuffer);
+	if (err < 0)
+	{
+		perror("Couldn't create a refit kernel argument");
+		return;
+	}
+	mValid = true;
+}
+
+BVHRefitter::~BVHRefitter()
+{
+	if (mRefitKernel)
+		clReleaseKernel(mRefitKernel);
+	if (mLevelNodesBuffer)
+		clReleaseMemObject(mLevelNodesBuffer);
+}
+
+bool BVHRefitter::SetTopology(cl_command_queue queue, const std::vector<BVHNode>& nodes)
+{
+	if (nodes.size() > mMaxNodes)
+	{
+		printf("The BVH has %zu nodes, the refitter holds at most %zu\n", nodes.size(), mMaxNodes);
+		return false;
+	}
+
+	// The builders allocate the children after their parent, so a forward pass sees every parent depth first
+	std::vector<int> depths(nodes.size(), 0);
+	int maxDepth = 0;
+	for (size_t i = 0; i < nodes.size(); ++i)
+	{
+		const BVHNode& node = nodes[i];
+		if (node.IsLeaf())
+			continue;
+
+		depths[node.mLeft] = depths[i] + 1;
+		depths[node.mRight] = depths[i] + 1;
+		maxDepth = std::max(maxDepth, depths[i] + 1);
+	}
+
+	// Counting sort by depth with the deepest level first
+	const int levelCount = nodes.empty() ? 0 : maxDepth + 1;
+	mLevelStarts.assign(levelCount + 1, 0);
+	for (int depth : depths)
+		mLevelStarts[maxDepth - depth + 1]++;
+	for (int level = 0; level < levelCount; ++level)
+		mLevelStarts[level + 1] += mLevelStarts[level];
+
+	std::vector<int> cursors(mLevelStarts.begin(), mLevelStarts.end() - 1);
+	mLevelNodes.resize(nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i)
+		mLevelNodes[cursors[maxDepth - depths[i]]++] = static_cast<int>(i);
+
+	if (mLevelNodes.empty())
+		return true;
+
+	// Blocking, topology changes are rare and the host levels are rewritten by the next one
+	cl_int err = clEnqueueWriteBuffer(queue, mLevelNodesBuffer, CL_TRUE, 0, mLevelNodes.size() * sizeof(int), mLevelNodes.data(), 0, NULL, NULL);
+	if (err < 0)
+	{
+		perror("Couldn't upload the refit levels");
+		return false;
+	}
+	return true;
+}
+
+bool BVHRefitter::Refit(cl_command_queue queue, cl_mem bvh, cl_mem triangles, OpenCLProfiler* profiler)
+{
+	cl_int err = clSetKernelArg(mRefitKernel, 0, sizeof(cl_mem), &bvh);
+	err |= clSetKernelArg(mRefitKernel, 1, sizeof(cl_mem), &triangles);
+	if (err < 0)
+	{
+		perror("Couldn't create a refit kernel argument");
+		return false;
+	}
+
+	for (int level = 0; level < GetLevelCount(); ++level)
+	{
+		const int levelStart = mLevelStarts[level];
+		const int levelCount = mLevelStarts[level + 1] - levelStart;
+		const size_t global = static_cast<size_t>(levelCount);
+
+		err = clSetKernelArg(mRefitKernel, 3, sizeof(int), &levelStart);
+		err |= clSetKernelArg(mRefitKernel, 4, sizeof(int), &levelCount);
+		if (err >= 0)
+			err = clEnqueueNDRangeKernel(queue, mRefitKernel, 1, NULL, &global, NULL, 0, NULL, profiler ? profiler->Track("Refit BVH Kernel") : NULL);
+		if (err < 0)
+		{
+			perror("Couldn't enqueue the refit kernel");
+			return false;
+		}
+	}
+	return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "Cl/cl.h"
+
+#include "OpenCLProfiler.h"
+
+#include "BVH.h"
+
+#include <vector>
+
+/// <summary>
+/// Device refit of the binary BVH with the refit_bvh kernel. Deformed triangles only have to be uploaded,
+/// the node bounds are updated in place on the device instead of being rebuilt and uploaded by the host.
+/// The nodes are grouped by their depth and every level is one launch, deepest first, so each node is
+/// refit after its children without any synchronization between the work items.
+///
+/// Usage:
+///		BVHRefitter refitter(context, program, maxNodes);
+///		refitter.SetTopology(queue, nodes);
+///		refitter.Refit(queue, bvhBuffer, trianglesBuffer, &profiler);
+/// </summary>
+class BVHRefitter
+{
+public:
+	/// <summary>
+	/// Constructor initializing a BVHRefitter, creating the refit kernel and the level buffer.
+	/// </summary>
+	/// <param name="context">The context</param>
+	/// <param name="program">The built mesh tracing program</param>
+	/// <param name="maxNodes">The most nodes any of the refit topologies holds</param>
+	BVHRefitter(cl_context context, cl_program program, size_t maxNodes);
+
+	/// <summary>
+	/// Destructor releasing the kernel and buffer.
+	/// </summary>
+	~BVHRefitter();
+
+	BVHRefitter(const BVHRefitter&) = delete;
+	BVHRefitter& operator=(const BVHRefitter&) = delete;
+public:
+	/// <summary>
+	/// Groups the nodes by depth and uploads the levels, required once after every build.
+	/// </summary>
+	/// <param name="queue">The command queue</param>
+	/// <param name="nodes">The binary nodes as uploaded to the device, the root is at index 0</param>
+	/// <returns>False if the levels couldn't be uploaded, otherwise true</returns>
+	bool SetTopology(cl_command_queue queue, const std::vector<BVHNode>& nodes);
+
+	/// <summary>
+	/// Enqueues the refit of every level without waiting for it.
+	/// </summary>
+	/// <param name="queue">The command queue</param>
+	/// <param name="bvh">The binary nodes of the topology</param>
+	/// <param name="triangles">The triangles in leaf order</param>
+	/// <param name="profiler">The optional profiler the levels are tracked by</param>
+	/// <returns>False if a level couldn't be enqueued, otherwise true</returns>
+	bool Refit(cl_command_queue queue, cl_mem bvh, cl_mem triangles, OpenCLProfiler* profiler);
+
+	inline bool IsValid() const { return mValid; }
+
+	inline int GetLevelCount() const { return static_cast<int>(mLevelStarts.size()) - 1; }
+private:
+	size_t mMaxNodes;
+	bool mValid = false;
+
+	cl_kernel mRefitKernel = nullptr;
+	cl_mem mLevelNodesBuffer = nullptr;
+
+	// Node indices grouped by depth, deepest level first. Level l covers [mLevelStarts[l], mLevelStarts[l + 1])
+	std::vector<int> mLevelNodes;
+	std::vector<int> mLevelStarts;
+};
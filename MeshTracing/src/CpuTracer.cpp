@@ -0,0 +1,308 @@
+#include "CpuTracer.h"
+
+#include <cstring>
+
+namespace
+{
+	constexpr float kEpsilon = 0.001f;
+	constexpr int kStackSize = 64;
+
+	inline Float3 ToFloat3(const Vector4f& v)
+	{
+		return { v.x, v.y, v.z };
+	}
+
+	inline uint32_t AsUInt(float value)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	bool RayAABBIntersect(const Float3& origin, const Float3& invDir, const AABB& box, float tMax, float& tNear)
+	{
+		// Slab test against the three axis aligned plane pairs
+		const Float3 t0 = (ToFloat3(box.mMin) - origin) * invDir;
+		const Float3 t1 = (ToFloat3(box.mMax) - origin) * invDir;
+
+		const Float3 tSmall = CpuMath::Min(t0, t1);
+		const Float3 tLarge = CpuMath::Max(t0, t1);
+
+		const float tEnter = std::max(std::max(tSmall.x, tSmall.y), tSmall.z);
+		const float tExit = std::min(std::min(tLarge.x, tLarge.y), tLarge.z);
+
+		tNear = tEnter;
+		return tExit >= std::max(tEnter, 0.0f) && tEnter < tMax;
+	}
+
+	inline float HalfArea(const AABB& box)
+	{
+		const Float3 extent = ToFloat3(box.mMax) - ToFloat3(box.mMin);
+		return extent.x * extent.y + extent.y * extent.z + extent.z * extent.x;
+	}
+}
+
+CpuTracer::CpuTracer(const DeviceGeometry& geometry,
+					 const std::vector<BVHNode>& bvh,
+					 const std::vector<Material>& materials,
+					 const std::vector<Vector4f>& lights)
+	: mGeometry(geometry),
+	mBVH(bvh),
+	mMaterials(materials),
+	mLights(lights)
+{
+	mNormals.reserve(geometry.normals.size());
+	for (uint32_t encoded : geometry.normals)
+		mNormals.push_back(ToFloat3(DecodeNormal(encoded)));
+}
+
+Float3 CpuTracer::TracePixel(float px, float py, int width, int height,
+							 const Vector4f& cameraPos,
+							 const Vector4f& cameraDir,
+							 float fov,
+							 int* secondaryRays) const
+{
+	Float3 rayOrigin = ToFloat3(cameraPos);
+	Float3 rayDirection = CpuMath::CameraRayDirection(px, py, width, height, fov, ToFloat3(cameraDir));
+
+	Float3 color(0.0f, 0.0f, 0.0f);
+	const Float3 skyColorTop(0.757f, 0.965f, 1.0f);
+	const Float3 skyColorBottom(0.3f, 0.5f, 1.0f);
+
+	// Energy carried by the ray
+	Float3 throughput(1.0f, 1.0f, 1.0f);
+
+	for (int b = 0; b < MaxBounces; ++b)
+	{
+		// Every bounce after the primary ray traces a secondary ray
+		if (b > 0 && secondaryRays)
+			++(*secondaryRays);
+
+		float tMin = 1e20f;
+		float u = 0.0f;
+		float v = 0.0f;
+		const int hitIndex = IntersectBVH(rayOrigin, rayDirection, tMin, u, v);
+
+		// No intersection
+		if (hitIndex == -1)
+		{
+			const float a = std::clamp(0.5f * (rayDirection.y + 1.0f), 0.0f, 1.0f);
+			color += throughput * CpuMath::Mix(skyColorBottom, skyColorTop, a);
+			break;
+		}
+
+		const Float3 hitPoint = rayOrigin + tMin * rayDirection;
+		const Float3 hitNormal = InterpolateNormal(mGeometry.triangles[hitIndex], u, v);
+
+		// Material properties
+		const Material& material = mMaterials[mGeometry.materials[hitIndex]];
+		const Float3 diffuseColor = ToFloat3(material.diffuseColor);
+		const Float3 specularColor = ToFloat3(material.specularColor);
+
+		// Accumulate color from lights (basic Phong shading)
+		Float3 directLight(0.0f, 0.0f, 0.0f);
+		for (const Vector4f& light : mLights)
+		{
+			const Float3 lightDir = CpuMath::Normalize(ToFloat3(light) - hitPoint);
+			const float lightIntensity = std::max(CpuMath::Dot(hitNormal, lightDir), 0.0f);
+
+			// Lights behind the surface are self-shadowed and need no shadow ray
+			if (mShadows && (lightIntensity <= 0.0f ||
+				OccludedBVH(hitPoint + kEpsilon * hitNormal, lightDir, CpuMath::Length(ToFloat3(light) - hitPoint) - kEpsilon)))
+				continue;
+
+			const Float3 viewDir = CpuMath::Normalize(rayOrigin - hitPoint);
+			const Float3 reflectDir = CpuMath::Normalize(CpuMath::Reflect(-lightDir, hitNormal));
+
+			// Diffuse shading (Lambertian)
+			directLight += diffuseColor * lightIntensity;
+
+			// Specular shading (Phong reflection model)
+			const float spec = std::pow(std::max(CpuMath::Dot(viewDir, reflectDir), 0.0f), material.shininess);
+			directLight += specularColor * spec * 0.1f;
+		}
+
+		Float3 reflectedColor(0.0f, 0.0f, 0.0f);
+		if (material.reflectivity > 0.0f)
+		{
+			rayDirection = CpuMath::Reflect(rayDirection, hitNormal);
+			rayOrigin = hitPoint + kEpsilon * hitNormal;
+
+			reflectedColor = throughput * material.reflectivity;
+		}
+
+		// Blend colors based on reflectivity
+		color += throughput * ((1.0f - material.reflectivity) * directLight + material.reflectivity * reflectedColor);
+
+		// Scale throughput by remaining reflectivity
+		throughput *= material.reflectivity;
+
+		// If throughput becomes negligible, terminate early
+		if (CpuMath::Length(throughput) < kEpsilon)
+			break;
+	}
+	return color;
+}
+
+int CpuTracer::IntersectBVH(const Float3& origin, const Float3& direction, float& tMin, float& u, float& v) const
+{
+	int hitIndex = -1;
+	if (mBVH.empty())
+		return hitIndex;
+
+	const Float3 invDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	float tRoot;
+	if (!RayAABBIntersect(origin, invDir, mBVH[0].mBounds, tMin, tRoot))
+		return hitIndex;
+
+	int stack[kStackSize];
+	int stackPtr = 0;
+	stack[stackPtr++] = 0;
+
+	while (stackPtr > 0)
+	{
+		const BVHNode& node = mBVH[stack[--stackPtr]];
+
+		// Leaf node, test the contained triangles
+		if (node.IsLeaf())
+		{
+			for (int i = node.mStart; i < node.mStart + node.mCount; ++i)
+			{
+				if (IntersectTriangle(origin, direction, mGeometry.triangles[i], tMin, u, v))
+					hitIndex = i;
+			}
+			continue;
+		}
+
+		float tLeft, tRight;
+		const bool hitLeft = RayAABBIntersect(origin, invDir, mBVH[node.mLeft].mBounds, tMin, tLeft);
+		const bool hitRight = RayAABBIntersect(origin, invDir, mBVH[node.mRight].mBounds, tMin, tRight);
+
+		// Push the far child first so the near child is visited first and shrinks tMin early
+		if (hitLeft && hitRight)
+		{
+			const int nearChild = tLeft <= tRight ? node.mLeft : node.mRight;
+			const int farChild = tLeft <= tRight ? node.mRight : node.mLeft;
+
+			if (stackPtr < kStackSize)
+				stack[stackPtr++] = farChild;
+			if (stackPtr < kStackSize)
+				stack[stackPtr++] = nearChild;
+		}
+		else if (hitLeft && stackPtr < kStackSize)
+		{
+			stack[stackPtr++] = node.mLeft;
+		}
+		else if (hitRight && stackPtr < kStackSize)
+		{
+			stack[stackPtr++] = node.mRight;
+		}
+	}
+	return hitIndex;
+}
+
+bool CpuTracer::OccludedBVH(const Float3& origin, const Float3& direction, float tMax) const
+{
+	if (mBVH.empty())
+		return false;
+
+	const Float3 invDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+
+	float tRoot;
+	if (!RayAABBIntersect(origin, invDir, mBVH[0].mBounds, tMax, tRoot))
+		return false;
+
+	int stack[kStackSize];
+	int stackPtr = 0;
+	stack[stackPtr++] = 0;
+
+	while (stackPtr > 0)
+	{
+		const BVHNode& node = mBVH[stack[--stackPtr]];
+
+		// Leaf node, any triangle in front of the light ends the query
+		if (node.IsLeaf())
+		{
+			for (int i = node.mStart; i < node.mStart + node.mCount; ++i)
+			{
+				float t = tMax;
+				float u, v;
+				if (IntersectTriangle(origin, direction, mGeometry.triangles[i], t, u, v))
+					return true;
+			}
+			continue;
+		}
+
+		const BVHNode& left = mBVH[node.mLeft];
+		const BVHNode& right = mBVH[node.mRight];
+
+		float tLeft, tRight;
+		const bool hitLeft = RayAABBIntersect(origin, invDir, left.mBounds, tMax, tLeft);
+		const bool hitRight = RayAABBIntersect(origin, invDir, right.mBounds, tMax, tRight);
+
+		// Visit a leaf child first, otherwise the child with the larger bounds
+		if (hitLeft && hitRight)
+		{
+			const bool leftFirst = !right.IsLeaf() && (left.IsLeaf() || HalfArea(left.mBounds) >= HalfArea(right.mBounds));
+			const int firstChild = leftFirst ? node.mLeft : node.mRight;
+			const int secondChild = leftFirst ? node.mRight : node.mLeft;
+
+			if (stackPtr < kStackSize)
+				stack[stackPtr++] = secondChild;
+			if (stackPtr < kStackSize)
+				stack[stackPtr++] = firstChild;
+		}
+		else if (hitLeft && stackPtr < kStackSize)
+		{
+			stack[stackPtr++] = node.mLeft;
+		}
+		else if (hitRight && stackPtr < kStackSize)
+		{
+			stack[stackPtr++] = node.mRight;
+		}
+	}
+	return false;
+}
+
+bool CpuTracer::IntersectTriangle(const Float3& origin, const Float3& direction, const TriangleAccel& tri, float& t, float& u, float& v) const
+{
+	// Moller-Trumbore with the edges precomputed on the host
+	const Float3 e1 = ToFloat3(tri.edge_1);
+	const Float3 e2 = ToFloat3(tri.edge_2);
+
+	const Float3 h = CpuMath::Cross(direction, e2);
+	const float a = CpuMath::Dot(e1, h);
+	if (a > -1e-6f && a < 1e-6f)
+		return false;
+
+	const float f = 1.0f / a;
+	const Float3 s = origin - ToFloat3(tri.vertex_0);
+	const float hitU = f * CpuMath::Dot(s, h);
+	if (hitU < 0.0f || hitU > 1.0f)
+		return false;
+
+	const Float3 q = CpuMath::Cross(s, e1);
+	const float hitV = f * CpuMath::Dot(direction, q);
+	if (hitV < 0.0f || hitU + hitV > 1.0f)
+		return false;
+
+	const float det = f * CpuMath::Dot(e2, q);
+	if (det > 1e-6f && det < t)
+	{
+		t = det;
+		u = hitU;
+		v = hitV;
+		return true;
+	}
+	return false;
+}
+
+Float3 CpuTracer::InterpolateNormal(const TriangleAccel& tri, float u, float v) const
+{
+	const Float3& n0 = mNormals[AsUInt(tri.vertex_0.w)];
+	const Float3& n1 = mNormals[AsUInt(tri.edge_1.w)];
+	const Float3& n2 = mNormals[AsUInt(tri.edge_2.w)];
+
+	return CpuMath::Normalize(n0 * (1.0f - u - v) + n1 * u + n2 * v);
+}
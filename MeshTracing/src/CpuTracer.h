@@ -0,0 +1,73 @@
+#pragma once
+
+#include "CpuMath.h"
+
+#include "BVH.h"
+#include "MeshDefines.h"
+#include "SceneGeometry.h"
+
+#include <vector>
+
+/// <summary>
+/// Native port of the mesh trace kernel, traversing the binary BVH on the host.
+/// </summary>
+class CpuTracer
+{
+public:
+	// Bounces per ray, also compiled into the trace kernel as MAX_BOUNCES
+	static constexpr int MaxBounces = 3;
+public:
+	/// <summary>
+	/// Constructor initializing a CpuTracer.
+	/// The scene buffers are referenced and must outlive the tracer.
+	/// </summary>
+	/// <param name="geometry">The device geometry in BVH leaf order</param>
+	/// <param name="bvh">The binary BVH over the geometry</param>
+	/// <param name="materials">The scene materials</param>
+	/// <param name="lights">The scene point lights</param>
+	CpuTracer(const DeviceGeometry& geometry,
+			  const std::vector<BVHNode>& bvh,
+			  const std::vector<Material>& materials,
+			  const std::vector<Vector4f>& lights);
+public:
+	/// <summary>
+	/// Traces the primary ray through the image position and its reflections.
+	/// </summary>
+	/// <param name="px">The horizontal image position, pixel centers are at x + 0.5</param>
+	/// <param name="py">The vertical image position, pixel centers are at y + 0.5</param>
+	/// <param name="width">The image width</param>
+	/// <param name="height">The image height</param>
+	/// <param name="cameraPos">The camera position</param>
+	/// <param name="cameraDir">The camera direction</param>
+	/// <param name="fov">The vertical field of view in degrees</param>
+	/// <param name="secondaryRays">Optional secondary ray count incremented per traced bounce</param>
+	/// <returns>The unclamped pixel color</returns>
+	Float3 TracePixel(float px, float py, int width, int height, 
+					  const Vector4f& cameraPos, 
+					  const Vector4f& cameraDir, 
+					  float fov,
+					  int* secondaryRays = nullptr) const;
+
+	/// <summary>
+	/// Shadow tests the lights with any-hit rays, like the SHADOWS kernel variant.
+	/// </summary>
+	/// <param name="enabled">Whether occluded lights are skipped</param>
+	inline void SetShadows(bool enabled) { mShadows = enabled; }
+private:
+	int IntersectBVH(const Float3& origin, const Float3& direction, float& tMin, float& u, float& v) const;
+
+	bool OccludedBVH(const Float3& origin, const Float3& direction, float tMax) const;
+
+	bool IntersectTriangle(const Float3& origin, const Float3& direction, const TriangleAccel& tri, float& t, float& u, float& v) const;
+
+	Float3 InterpolateNormal(const TriangleAccel& tri, float u, float v) const;
+private:
+	const DeviceGeometry& mGeometry;
+	const std::vector<BVHNode>& mBVH;
+	const std::vector<Material>& mMaterials;
+	const std::vector<Vector4f>& mLights;
+	bool mShadows = false;
+
+	// Normals decoded once instead of per hit
+	std::vector<Float3> mNormals;
+};
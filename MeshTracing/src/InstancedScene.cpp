@@ -0,0 +1,187 @@
+#include "InstancedScene.h"
+
+#include <cmath>
+
+Matrix4f Matrix4f::Identity()
+{
+	Matrix4f matrix;
+	for (int i = 0; i < 4; ++i)
+		matrix.m[i][i] = 1.0f;
+	return matrix;
+}
+
+Matrix4f Matrix4f::Translation(float x, float y, float z)
+{
+	Matrix4f matrix = Identity();
+	matrix.m[0][3] = x;
+	matrix.m[1][3] = y;
+	matrix.m[2][3] = z;
+	return matrix;
+}
+
+Matrix4f Matrix4f::RotationY(float radians)
+{
+	const float c = std::cos(radians);
+	const float s = std::sin(radians);
+
+	Matrix4f matrix = Identity();
+	matrix.m[0][0] = c;
+	matrix.m[0][2] = s;
+	matrix.m[2][0] = -s;
+	matrix.m[2][2] = c;
+	return matrix;
+}
+
+Matrix4f Matrix4f::operator*(const Matrix4f& other) const
+{
+	Matrix4f result;
+	for (int row = 0; row < 4; ++row)
+	{
+		for (int column = 0; column < 4; ++column)
+		{
+			for (int k = 0; k < 4; ++k)
+				result.m[row][column] += m[row][k] * other.m[k][column];
+		}
+	}
+	return result;
+}
+
+Vector4f Matrix4f::TransformPoint(const Vector4f& point) const
+{
+	return { m[0][0] * point.x + m[0][1] * point.y + m[0][2] * point.z + m[0][3],
+			 m[1][0] * point.x + m[1][1] * point.y + m[1][2] * point.z + m[1][3],
+			 m[2][0] * point.x + m[2][1] * point.y + m[2][2] * point.z + m[2][3],
+			 point.w };
+}
+
+Matrix4f Matrix4f::InverseAffine() const
+{
+	// Inverse of the upper 3x3 through its adjugate
+	const float det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+					  m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+					  m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+	const float invDet = det != 0.0f ? 1.0f / det : 0.0f;
+
+	Matrix4f inverse = Identity();
+	inverse.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * invDet;
+	inverse.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+	inverse.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+	inverse.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * invDet;
+	inverse.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+	inverse.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+	inverse.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * invDet;
+	inverse.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+	inverse.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+
+	// The inverse translation is the negated translation in the inverse rotated frame
+	for (int row = 0; row < 3; ++row)
+		inverse.m[row][3] = -(inverse.m[row][0] * m[0][3] + inverse.m[row][1] * m[1][3] + inverse.m[row][2] * m[2][3]);
+	return inverse;
+}
+
+int InstancedScene::AddMesh(const Mesh& mesh, const BVHBuildSettings& settings, ThreadPool* pool)
+{
+	SceneGeometry meshGeometry;
+	AppendMesh(mesh, meshGeometry);
+
+	std::vector<BVHNode> meshBVH;
+	ConstructBVH(meshBVH, meshGeometry, settings, pool);
+
+	// Append the mesh with its vertex, triangle and node indices offset into the shared buffers
+	const uint32_t baseVertex = static_cast<uint32_t>(mGeometry.vertices.size());
+	const int baseTriangle = static_cast<int>(mGeometry.triangles.size());
+	const int baseNode = static_cast<int>(mBottomLevel.size());
+
+	mGeometry.vertices.insert(mGeometry.vertices.end(), meshGeometry.vertices.begin(), meshGeometry.vertices.end());
+	mGeometry.normals.insert(mGeometry.normals.end(), meshGeometry.normals.begin(), meshGeometry.normals.end());
+	for (IndexedTriangle triangle : meshGeometry.triangles)
+	{
+		triangle.index_0 += baseVertex;
+		triangle.index_1 += baseVertex;
+		triangle.index_2 += baseVertex;
+		mGeometry.triangles.emplace_back(triangle);
+	}
+
+	for (BVHNode node : meshBVH)
+	{
+		if (node.IsLeaf())
+		{
+			node.mStart += baseTriangle;
+		}
+		else
+		{
+			node.mLeft += baseNode;
+			node.mRight += baseNode;
+		}
+		mBottomLevel.emplace_back(node);
+	}
+
+	MeshRecord record;
+	record.mRoot = baseNode;
+	record.mTriangleCount = meshGeometry.triangles.size();
+	record.mBounds = meshBVH.empty() ? AABB::Empty() : meshBVH[0].mBounds;
+	mMeshes.emplace_back(record);
+	return static_cast<int>(mMeshes.size()) - 1;
+}
+
+int InstancedScene::AddInstance(int mesh, const Matrix4f& transform)
+{
+	Instance instance;
+	instance.mMesh = mesh;
+	instance.mTransform = transform;
+	mInstances.emplace_back(instance);
+	return static_cast<int>(mInstances.size()) - 1;
+}
+
+void InstancedScene::SetTransform(int instance, const Matrix4f& transform)
+{
+	mInstances[instance].mTransform = transform;
+}
+
+void InstancedScene::BuildTopLevel()
+{
+	// World bounds of every instance from the transformed corners of its mesh bounds
+	std::vector<AABB> instanceBounds(mInstances.size());
+	for (size_t i = 0; i < mInstances.size(); ++i)
+	{
+		const AABB& meshBounds = mMeshes[mInstances[i].mMesh].mBounds;
+
+		AABB bounds = AABB::Empty();
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			const Vector4f point((corner & 1) ? meshBounds.mMax.x : meshBounds.mMin.x,
+								 (corner & 2) ? meshBounds.mMax.y : meshBounds.mMin.y,
+								 (corner & 4) ? meshBounds.mMax.z : meshBounds.mMin.z,
+								 0.0f);
+			bounds.Grow(mInstances[i].mTransform.TransformPoint(point));
+		}
+		instanceBounds[i] = bounds;
+	}
+
+	// One instance per leaf, the instance transforms are the expensive part of a leaf test
+	BVHBuildSettings settings;
+	settings.mMaxTrianglesPerLeaf = 1;
+
+	std::vector<int> order;
+	ConstructBVH(mTopLevel, instanceBounds, order, settings);
+
+	mDeviceInstances.resize(order.size());
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		const Instance& instance = mInstances[order[i]];
+		const Matrix4f inverse = instance.mTransform.InverseAffine();
+
+		DeviceInstance& record = mDeviceInstances[i];
+		for (int row = 0; row < 3; ++row)
+			record.mWorldToObject[row] = Vector4f(inverse.m[row][0], inverse.m[row][1], inverse.m[row][2], inverse.m[row][3]);
+		record.mRoot = mMeshes[instance.mMesh].mRoot;
+	}
+}
+
+size_t InstancedScene::GetPlacedTriangleCount() const
+{
+	size_t count = 0;
+	for (const Instance& instance : mInstances)
+		count += mMeshes[instance.mMesh].mTriangleCount;
+	return count;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "BVH.h"
+#include "MeshDefines.h"
+#include "SceneGeometry.h"
+#include "ThreadPool.h"
+
+#include <vector>
+
+/// <summary>
+/// Row major 4x4 transform, points are column vectors.
+/// </summary>
+struct Matrix4f
+{
+public:
+	static Matrix4f Identity();
+
+	static Matrix4f Translation(float x, float y, float z);
+
+	static Matrix4f RotationY(float radians);
+
+	Matrix4f operator*(const Matrix4f& other) const;
+
+	/// <summary>
+	/// Transforms the point, ignoring its w component.
+	/// </summary>
+	/// <param name="point">The point</param>
+	/// <returns>The transformed point</returns>
+	Vector4f TransformPoint(const Vector4f& point) const;
+
+	/// <summary>
+	/// Inverts the transform, which is expected to be affine (last row 0, 0, 0, 1).
+	/// </summary>
+	/// <returns>The inverse transform</returns>
+	Matrix4f InverseAffine() const;
+public:
+	float m[4][4] = {};
+};
+
+/// <summary>
+/// Device record of an instance, matching the OpenCL Instance layout.
+/// The first three rows of the inverse transform move the rays into the object space of the mesh,
+/// their transpose moves the object space normals back into world space.
+/// </summary>
+struct DeviceInstance
+{
+	Vector4f mWorldToObject[3];
+
+	// Root node of the bottom level BVH of the mesh
+	int mRoot = 0;
+	int pad0 = 0;
+	int pad1 = 0;
+	int pad2 = 0;
+};
+static_assert(sizeof(DeviceInstance) == 64, "DeviceInstance must match the OpenCL Instance layout");
+
+/// <summary>
+/// Two-level acceleration structure. Every unique mesh is stored and built once as a bottom level BVH,
+/// a small top level BVH over the world bounds of the instances references them through their transforms.
+/// Moving instances only rebuilds the top level, and the geometry memory scales with the unique meshes
+/// instead of the placed copies.
+///
+/// Usage:
+///		InstancedScene scene;
+///		const int mesh = scene.AddMesh(suzanne, settings, &pool);
+///		scene.AddInstance(mesh, Matrix4f::Translation(2.0f, 0.0f, 0.0f));
+///		scene.BuildTopLevel();
+/// </summary>
+class InstancedScene
+{
+public:
+	/// <summary>
+	/// Adds a unique mesh and builds its bottom level BVH.
+	/// </summary>
+	/// <param name="mesh">The mesh in object space</param>
+	/// <param name="settings">The bottom level build settings</param>
+	/// <param name="pool">Optional thread pool the build is parallelized on</param>
+	/// <returns>The mesh index</returns>
+	int AddMesh(const Mesh& mesh, const BVHBuildSettings& settings, ThreadPool* pool = nullptr);
+
+	/// <summary>
+	/// Places a copy of the mesh, the top level has to be rebuilt before rendering.
+	/// </summary>
+	/// <param name="mesh">The mesh index</param>
+	/// <param name="transform">The object to world transform</param>
+	/// <returns>The instance index</returns>
+	int AddInstance(int mesh, const Matrix4f& transform);
+
+	/// <summary>
+	/// Moves an instance, the top level has to be rebuilt before rendering.
+	/// </summary>
+	/// <param name="instance">The instance index</param>
+	/// <param name="transform">The object to world transform</param>
+	void SetTransform(int instance, const Matrix4f& transform);
+
+	/// <summary>
+	/// Rebuilds the top level BVH over the instance bounds and the device instance records in its leaf order.
+	/// </summary>
+	void BuildTopLevel();
+
+	/// <summary>
+	/// Retrieves the triangles placed in the scene, counting every instance.
+	/// </summary>
+	/// <returns>The placed triangle count</returns>
+	size_t GetPlacedTriangleCount() const;
+
+	inline const SceneGeometry& GetGeometry() const { return mGeometry; }
+
+	inline const std::vector<BVHNode>& GetBottomLevelNodes() const { return mBottomLevel; }
+
+	inline const std::vector<BVHNode>& GetTopLevelNodes() const { return mTopLevel; }
+
+	inline const std::vector<DeviceInstance>& GetDeviceInstances() const { return mDeviceInstances; }
+
+	inline const Matrix4f& GetTransform(int instance) const { return mInstances[instance].mTransform; }
+
+	inline int GetInstanceCount() const { return static_cast<int>(mInstances.size()); }
+
+	inline int GetMeshCount() const { return static_cast<int>(mMeshes.size()); }
+private:
+	struct MeshRecord
+	{
+		int mRoot = 0;
+		size_t mTriangleCount = 0;
+		AABB mBounds;
+	};
+
+	struct Instance
+	{
+		int mMesh = 0;
+		Matrix4f mTransform;
+	};
+private:
+	// The triangles of every unique mesh, each mesh in the leaf order of its bottom level BVH
+	SceneGeometry mGeometry;
+
+	// The bottom level BVHs of all meshes, child and triangle indices are global
+	std::vector<BVHNode> mBottomLevel;
+	std::vector<MeshRecord> mMeshes;
+
+	std::vector<Instance> mInstances;
+	std::vector<BVHNode> mTopLevel;
+	std::vector<DeviceInstance> mDeviceInstances;
+};
@@ -0,0 +1,74 @@
+#include "LightTree.h"
+
+#include "BVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace
+{
+	struct LightRange
+	{
+		int mStart;
+		int mEnd;
+		int mNode;
+	};
+}
+
+void ConstructLightTree(std::vector<LightTreeNode>& nodes, const std::vector<Vector4f>& lights)
+{
+	nodes.clear();
+	if (lights.empty())
+		return;
+
+	const int lightCount = static_cast<int>(lights.size());
+
+	std::vector<int> order(lightCount);
+	std::iota(order.begin(), order.end(), 0);
+
+	// A binary tree over N lights with one light per leaf has exactly 2N - 1 nodes
+	nodes.resize(lightCount * 2 - 1);
+	int nodeCount = 1;
+
+	std::vector<LightRange> stack;
+	stack.push_back({ 0, lightCount, 0 });
+	while (!stack.empty())
+	{
+		const LightRange range = stack.back();
+		stack.pop_back();
+
+		AABB bounds = AABB::Empty();
+		for (int i = range.mStart; i < range.mEnd; ++i)
+			bounds.Grow(lights[order[i]]);
+
+		const Vector4f center = bounds.Center();
+		const Vector4f extent = (bounds.mMax - bounds.mMin) * 0.5f;
+
+		LightTreeNode& node = nodes[range.mNode];
+		node.mBounds = Vector4f(center.x, center.y, center.z, std::sqrt(extent.x * extent.x + extent.y * extent.y + extent.z * extent.z));
+		node.mIntensity = static_cast<float>(range.mEnd - range.mStart);
+
+		if (range.mEnd - range.mStart == 1)
+		{
+			node.mLight = order[range.mStart];
+			continue;
+		}
+
+		// Median split, lights at the same position still end up in separate leaves
+		int axis = 0;
+		if (extent.y > extent.x)
+			axis = 1;
+		if (extent.z > extent[axis])
+			axis = 2;
+
+		const int mid = (range.mStart + range.mEnd) / 2;
+		std::nth_element(order.begin() + range.mStart, order.begin() + mid, order.begin() + range.mEnd,
+						 [&lights, axis](int a, int b) { return lights[a][axis] < lights[b][axis]; });
+
+		node.mLeft = nodeCount++;
+		node.mRight = nodeCount++;
+		stack.push_back({ mid, range.mEnd, node.mRight });
+		stack.push_back({ range.mStart, mid, node.mLeft });
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "MeshDefines.h"
+
+#include <vector>
+
+/// <summary>
+/// Node of the light tree, matching the OpenCL LightTreeNode layout.
+/// </summary>
+struct LightTreeNode
+{
+public:
+	inline bool IsLeaf() const { return mLeft < 0; }
+public:
+	// Bounding sphere of the lights below the node, the center in xyz and the radius in w
+	Vector4f mBounds;
+
+	// Number of lights below the node, every light shades as a unit white light
+	float mIntensity = 0.0f;
+	int mLeft = -1;
+	int mRight = -1;
+
+	// Index into the lights buffer, only set for leaves
+	int mLight = -1;
+};
+static_assert(sizeof(LightTreeNode) == 32, "LightTreeNode must match the OpenCL LightTreeNode layout");
+
+/// <summary>
+/// Constructs a binary tree over the point lights with a single light per leaf, splitting the lights
+/// at the median of the longest axis of their bounds.
+/// Every light shades as a unit white light regardless of its w component, so the intensity of a node is its light count
+/// and sample_light_tree selects the children in proportion to their light count and orientation towards the hit.
+/// </summary>
+/// <param name="nodes">The output nodes, the root is at index 0</param>
+/// <param name="lights">The point light positions</param>
+void ConstructLightTree(std::vector<LightTreeNode>& nodes, const std::vector<Vector4f>& lights);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <vector>
 
 struct Vector4f
@@ -15,7 +17,7 @@ public:
 	{
 	}
 public:
-	inline float operator[](int index)
+	inline float operator[](int index) const
 	{
 		if (index == 0)
 			return x;
@@ -45,6 +47,14 @@ public:
 				 w - other.w };
 	}
 
+	inline Vector4f operator*(float scalar) const
+	{
+		return { x * scalar,
+				 y * scalar,
+				 z * scalar,
+				 w * scalar };
+	}
+
 	inline Vector4f operator/(float scalar) const
 	{
 		return { x / scalar,
@@ -59,6 +69,22 @@ public:
 	float w = 0;
 };
 
+inline Vector4f ComponentMinimum(const Vector4f& a, const Vector4f& b)
+{
+	return { std::min(a.x, b.x),
+			 std::min(a.y, b.y),
+			 std::min(a.z, b.z),
+			 std::min(a.w, b.w) };
+}
+
+inline Vector4f ComponentMaximum(const Vector4f& a, const Vector4f& b)
+{
+	return { std::max(a.x, b.x),
+			 std::max(a.y, b.y),
+			 std::max(a.z, b.z),
+			 std::max(a.w, b.w) };
+}
+
 struct Material
 {
 	Vector4f diffuseColor;
@@ -69,32 +95,10 @@ struct Material
 	float pad2 = 0;
 };
 
-struct Triangle
-{
-public:
-	Triangle() = default;
-
-	Triangle(const Triangle&) = default;
-
-	
-public:
-	inline Vector4f Centriod() const
-	{
-		return (vertex_0 + vertex_1 + vertex_2) / 3.0f;
-	}
-public:
-	Vector4f vertex_0;
-	Vector4f vertex_1;
-	Vector4f vertex_2;
-	Vector4f normal_0;
-	Vector4f normal_1;
-	Vector4f normal_2;
-	int materialIndex = -1;
-	int _padding[3];
-};
-
 struct Mesh
 {
-	std::vector<Triangle> triangles;
+	std::vector<Vector4f> vertices;
+	std::vector<Vector4f> normals;
+	std::vector<uint32_t> indices;
 	int materialIndex = -1;
 };
\ No newline at end of file
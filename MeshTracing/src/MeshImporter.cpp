@@ -58,11 +58,10 @@ bool MeshImporter::Import(const std::filesystem::path& path,
 		}
 		/// -----------------------------------------------------
 
-		// Extract vertices
-		std::vector<Vector4f> vertices;
-		std::vector<Vector4f> normals;
-		vertices.reserve(mesh->mNumVertices);
-		normals.reserve(mesh->mNumVertices);
+		// Extract the shared vertices, offset by the vertices of previously imported meshes
+		const uint32_t baseVertex = static_cast<uint32_t>(output.vertices.size());
+		output.vertices.reserve(output.vertices.size() + mesh->mNumVertices);
+		output.normals.reserve(output.normals.size() + mesh->mNumVertices);
 		for (uint32_t i = 0; i < mesh->mNumVertices; ++i)
 		{
 			aiVector3D& ai_vertex = mesh->mVertices[i];
@@ -71,7 +70,7 @@ bool MeshImporter::Import(const std::filesystem::path& path,
 									   ai_vertex.y,
 									   ai_vertex.z, 0);
 			
-			vertices.emplace_back(vertex);
+			output.vertices.emplace_back(vertex);
 
 			if (mesh->HasNormals())
 			{
@@ -81,33 +80,27 @@ bool MeshImporter::Import(const std::filesystem::path& path,
 										   ai_normal.y,
 										   ai_normal.z, 0);
 
-				normals.emplace_back(normal);
+				output.normals.emplace_back(normal);
+			}
+			else
+			{
+				output.normals.emplace_back(Vector4f(0, 1, 0, 0));
 			}
 		}
-		
 
 		// Extract faces
+		output.indices.reserve(output.indices.size() + mesh->mNumFaces * 3);
 		for (uint32_t i = 0; i < mesh->mNumFaces; ++i)
 		{
 			const aiFace& face = mesh->mFaces[i];
+			if (face.mNumIndices != 3)
+				continue;
 
-			Triangle triangle;
-
-			int32_t index_0 = face.mIndices[0];
-			int32_t index_1 = face.mIndices[1];
-			int32_t index_2 = face.mIndices[2];
-
-			triangle.vertex_0 = vertices[index_0];
-			triangle.vertex_1 = vertices[index_1];
-			triangle.vertex_2 = vertices[index_2];
-
-			triangle.normal_0 = normals[index_0];
-			triangle.normal_1 = normals[index_1];
-			triangle.normal_2 = normals[index_2];
-
-			output.triangles.emplace_back(triangle);
+			output.indices.emplace_back(baseVertex + face.mIndices[0]);
+			output.indices.emplace_back(baseVertex + face.mIndices[1]);
+			output.indices.emplace_back(baseVertex + face.mIndices[2]);
 		}
 	}
 
-	return false;
+	return true;
 }
@@ -0,0 +1,91 @@
+#include "SceneGeometry.h"
+
+#include <bit>
+#include <cmath>
+
+void AppendMesh(const Mesh& mesh, SceneGeometry& geometry)
+{
+	const uint32_t baseVertex = static_cast<uint32_t>(geometry.vertices.size());
+
+	geometry.vertices.insert(geometry.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+	geometry.normals.insert(geometry.normals.end(), mesh.normals.begin(), mesh.normals.end());
+
+	geometry.triangles.reserve(geometry.triangles.size() + mesh.indices.size() / 3);
+	for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+	{
+		IndexedTriangle triangle;
+		triangle.index_0 = baseVertex + mesh.indices[i];
+		triangle.index_1 = baseVertex + mesh.indices[i + 1];
+		triangle.index_2 = baseVertex + mesh.indices[i + 2];
+		triangle.materialIndex = mesh.materialIndex;
+		geometry.triangles.emplace_back(triangle);
+	}
+}
+
+uint32_t EncodeNormal(const Vector4f& normal)
+{
+	const float length = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (length <= 0.0f)
+		return EncodeNormal(Vector4f(0, 1, 0, 0));
+
+	float x = normal.x / length;
+	float y = normal.y / length;
+
+	// Fold the lower hemisphere over the diagonals
+	if (normal.z < 0.0f)
+	{
+		const float foldedX = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		const float foldedY = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	const uint32_t qx = static_cast<uint32_t>(std::lround((std::clamp(x, -1.0f, 1.0f) * 0.5f + 0.5f) * 65535.0f));
+	const uint32_t qy = static_cast<uint32_t>(std::lround((std::clamp(y, -1.0f, 1.0f) * 0.5f + 0.5f) * 65535.0f));
+	return qx | (qy << 16);
+}
+
+Vector4f DecodeNormal(uint32_t encoded)
+{
+	const float x = (encoded & 0xFFFF) / 65535.0f * 2.0f - 1.0f;
+	const float y = (encoded >> 16) / 65535.0f * 2.0f - 1.0f;
+
+	Vector4f normal(x, y, 1.0f - std::abs(x) - std::abs(y), 0);
+	const float t = std::max(-normal.z, 0.0f);
+	normal.x += normal.x >= 0.0f ? -t : t;
+	normal.y += normal.y >= 0.0f ? -t : t;
+
+	const float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+	return normal / length;
+}
+
+void BuildDeviceGeometry(const SceneGeometry& geometry, DeviceGeometry& output)
+{
+	output.triangles.resize(geometry.triangles.size());
+	output.materials.resize(geometry.triangles.size());
+	for (size_t i = 0; i < geometry.triangles.size(); ++i)
+	{
+		const IndexedTriangle& triangle = geometry.triangles[i];
+		const Vector4f& v0 = geometry.vertices[triangle.index_0];
+		const Vector4f& v1 = geometry.vertices[triangle.index_1];
+		const Vector4f& v2 = geometry.vertices[triangle.index_2];
+
+		TriangleAccel& accel = output.triangles[i];
+		accel.vertex_0 = Vector4f(v0.x, v0.y, v0.z, std::bit_cast<float>(triangle.index_0));
+		accel.edge_1 = Vector4f(v1.x - v0.x, v1.y - v0.y, v1.z - v0.z, std::bit_cast<float>(triangle.index_1));
+		accel.edge_2 = Vector4f(v2.x - v0.x, v2.y - v0.y, v2.z - v0.z, std::bit_cast<float>(triangle.index_2));
+
+		output.materials[i] = triangle.materialIndex;
+	}
+
+	output.normals.resize(geometry.normals.size());
+	for (size_t i = 0; i < geometry.normals.size(); ++i)
+		output.normals[i] = EncodeNormal(geometry.normals[i]);
+}
+
+size_t GetDeviceMemorySize(const DeviceGeometry& geometry)
+{
+	return geometry.triangles.size() * sizeof(TriangleAccel) +
+		   geometry.materials.size() * sizeof(int) +
+		   geometry.normals.size() * sizeof(uint32_t);
+}
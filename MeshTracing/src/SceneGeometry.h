@@ -0,0 +1,86 @@
+#pragma once
+
+#include "MeshDefines.h"
+
+#include <cstdint>
+#include <vector>
+
+/// <summary>
+/// Compact triangle referencing the shared scene vertex and normal buffers.
+/// </summary>
+struct IndexedTriangle
+{
+	uint32_t index_0 = 0;
+	uint32_t index_1 = 0;
+	uint32_t index_2 = 0;
+	int materialIndex = -1;
+};
+static_assert(sizeof(IndexedTriangle) == 16, "IndexedTriangle is expected to be tightly packed");
+
+/// <summary>
+/// Intersection optimized triangle uploaded to the device.
+/// The edges are precomputed for Moller-Trumbore and the w components carry the 
+/// shared vertex indices (bit cast) used to interpolate the normals of the closest hit.
+/// </summary>
+struct TriangleAccel
+{
+	Vector4f vertex_0;
+	Vector4f edge_1;
+	Vector4f edge_2;
+};
+static_assert(sizeof(TriangleAccel) == 48, "TriangleAccel must match the OpenCL TriangleAccel layout");
+
+/// <summary>
+/// Indexed geometry of the whole scene.
+/// </summary>
+struct SceneGeometry
+{
+	std::vector<Vector4f> vertices;
+	std::vector<Vector4f> normals;
+	std::vector<IndexedTriangle> triangles;
+};
+
+/// <summary>
+/// Device side buffers of the scene geometry, in BVH leaf order.
+/// </summary>
+struct DeviceGeometry
+{
+	std::vector<TriangleAccel> triangles;
+	std::vector<int> materials;
+	std::vector<uint32_t> normals;
+};
+
+/// <summary>
+/// Appends the mesh to the scene, sharing its vertices between its triangles.
+/// </summary>
+/// <param name="mesh">The mesh to append</param>
+/// <param name="geometry">The scene geometry</param>
+void AppendMesh(const Mesh& mesh, SceneGeometry& geometry);
+
+/// <summary>
+/// Encodes a unit normal into 32 bits using an octahedral mapping (2 x 16 bit).
+/// </summary>
+/// <param name="normal">The normal to encode</param>
+/// <returns>The encoded normal</returns>
+uint32_t EncodeNormal(const Vector4f& normal);
+
+/// <summary>
+/// Decodes a normal encoded by EncodeNormal.
+/// </summary>
+/// <param name="encoded">The encoded normal</param>
+/// <returns>The normalized normal</returns>
+Vector4f DecodeNormal(uint32_t encoded);
+
+/// <summary>
+/// Builds the device side geometry buffers.
+/// </summary>
+/// <param name="geometry">The scene geometry</param>
+/// <param name="output">The device geometry</param>
+void BuildDeviceGeometry(const SceneGeometry& geometry, DeviceGeometry& output);
+
+/// <summary>
+/// Retrieves the device memory in bytes used by the geometry buffers.
+/// </summary>
+/// <param name="geometry">The device geometry</param>
+/// <returns>The size in bytes</returns>
+size_t GetDeviceMemorySize(const DeviceGeometry& geometry);
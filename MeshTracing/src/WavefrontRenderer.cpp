@@ -0,0 +1,291 @@
+#include "WavefrontRenderer.h"
+
+#include "OpenCLUtils.h"
+
+#include <stdio.h>
+
+namespace
+{
+	// Sizes of the PathState and PathHit records of the kernels
+	constexpr size_t PathStateSize = 64;
+	constexpr size_t PathHitSize = 32;
+
+	// RAY_SORT_BINS of the kernels, 8 direction octants times 4 x 4 x 4 origin cells
+	constexpr size_t RaySortBins = 8 * 4 * 4 * 4;
+}
+
+WavefrontRenderer::WavefrontRenderer(cl_context context, cl_program program, int width, int height, int maxBounces)
+	: mWidth(width),
+	mHeight(height),
+	mMaxBounces(maxBounces)
+{
+	mGenerateKernel = CreateKernel(program, "wavefront_generate");
+	mExtendKernel = CreateKernel(program, "wavefront_extend");
+	mShadeKernel = CreateKernel(program, "wavefront_shade");
+	mCompactKernel = CreateKernel(program, "wavefront_compact");
+	mResolveKernel = CreateKernel(program, "wavefront_resolve");
+	mSortCountKernel = CreateKernel(program, "wavefront_sort_count");
+	mSortOffsetsKernel = CreateKernel(program, "wavefront_sort_offsets");
+	mSortScatterKernel = CreateKernel(program, "wavefront_sort_scatter");
+	if (!mGenerateKernel || !mExtendKernel || !mShadeKernel || !mCompactKernel || !mResolveKernel ||
+		!mSortCountKernel || !mSortOffsetsKernel || !mSortScatterKernel)
+	{
+		return;
+	}
+
+	const size_t pixelCount = static_cast<size_t>(mWidth) * mHeight;
+	mPaths[0] = OpenCLUtils::create_device_buffer(context, pixelCount * PathStateSize);
+	mPaths[1] = OpenCLUtils::create_device_buffer(context, pixelCount * PathStateSize);
+	mHits = OpenCLUtils::create_device_buffer(context, pixelCount * PathHitSize);
+	mRadiance = OpenCLUtils::create_device_buffer(context, pixelCount * sizeof(float) * 4);
+	mQueueSizes = OpenCLUtils::create_device_buffer(context, mMaxBounces * sizeof(cl_uint));
+	mUnsortedPaths = OpenCLUtils::create_device_buffer(context, pixelCount * PathStateSize);
+	mSortKeys = OpenCLUtils::create_device_buffer(context, pixelCount * sizeof(cl_uint));
+	mSortBins = OpenCLUtils::create_device_buffer(context, RaySortBins * sizeof(cl_uint));
+	if (!mPaths[0] || !mPaths[1] || !mHits || !mRadiance || !mQueueSizes || !mUnsortedPaths || !mSortKeys || !mSortBins)
+	{
+		perror("Couldn't create the wavefront buffers");
+		return;
+	}
+
+	mInitialQueueSizes.assign(mMaxBounces, 0);
+	mInitialQueueSizes[0] = static_cast<cl_uint>(pixelCount);
+	mEmptySortBins.assign(RaySortBins, 0);
+
+	cl_int err = clSetKernelArg(mGenerateKernel, 1, sizeof(cl_mem), &mRadiance);
+	err |= clSetKernelArg(mGenerateKernel, 2, sizeof(int), &mWidth);
+	err |= clSetKernelArg(mGenerateKernel, 3, sizeof(int), &mHeight);
+
+	err |= clSetKernelArg(mExtendKernel, 1, sizeof(cl_mem), &mHits);
+	err |= clSetKernelArg(mExtendKernel, 2, sizeof(cl_mem), &mQueueSizes);
+
+	err |= clSetKernelArg(mShadeKernel, 1, sizeof(cl_mem), &mHits);
+	err |= clSetKernelArg(mShadeKernel, 2, sizeof(cl_mem), &mQueueSizes);
+	err |= clSetKernelArg(mShadeKernel, 4, sizeof(cl_mem), &mRadiance);
+
+	err |= clSetKernelArg(mCompactKernel, 2, sizeof(cl_mem), &mQueueSizes);
+
+	err |= clSetKernelArg(mResolveKernel, 1, sizeof(cl_mem), &mRadiance);
+	err |= clSetKernelArg(mResolveKernel, 2, sizeof(int), &mWidth);
+	err |= clSetKernelArg(mResolveKernel, 3, sizeof(int), &mHeight);
+
+	err |= clSetKernelArg(mSortCountKernel, 0, sizeof(cl_mem), &mUnsortedPaths);
+	err |= clSetKernelArg(mSortCountKernel, 1, sizeof(cl_mem), &mQueueSizes);
+	err |= clSetKernelArg(mSortCountKernel, 3, sizeof(cl_mem), &mSortKeys);
+	err |= clSetKernelArg(mSortCountKernel, 4, sizeof(cl_mem), &mSortBins);
+
+	err |= clSetKernelArg(mSortOffsetsKernel, 0, sizeof(cl_mem), &mSortBins);
+
+	err |= clSetKernelArg(mSortScatterKernel, 0, sizeof(cl_mem), &mUnsortedPaths);
+	err |= clSetKernelArg(mSortScatterKernel, 2, sizeof(cl_mem), &mQueueSizes);
+	err |= clSetKernelArg(mSortScatterKernel, 4, sizeof(cl_mem), &mSortKeys);
+	err |= clSetKernelArg(mSortScatterKernel, 5, sizeof(cl_mem), &mSortBins);
+	if (err < 0)
+	{
+		perror("Couldn't create a wavefront kernel argument");
+		return;
+	}
+
+	mValid = true;
+}
+
+WavefrontRenderer::~WavefrontRenderer()
+{
+	for (cl_kernel kernel : { mGenerateKernel, mExtendKernel, mShadeKernel, mCompactKernel, mResolveKernel, mSortCountKernel, mSortOffsetsKernel, mSortScatterKernel })
+	{
+		if (kernel)
+			clReleaseKernel(kernel);
+	}
+
+	for (cl_mem buffer : { mPaths[0], mPaths[1], mHits, mRadiance, mQueueSizes, mUnsortedPaths, mSortKeys, mSortBins })
+	{
+		if (buffer)
+			clReleaseMemObject(buffer);
+	}
+}
+
+bool WavefrontRenderer::SetScene(cl_mem lights,
+								 int lightsCount,
+								 cl_mem triangles,
+								 cl_mem triangleMaterials,
+								 cl_mem normals,
+								 cl_mem bvh,
+								 cl_mem materials,
+								 cl_mem lightTree,
+								 cl_mem topLevelBVH,
+								 cl_mem instances,
+								 const AABB& bounds)
+{
+	cl_int err = clSetKernelArg(mExtendKernel, 4, sizeof(cl_mem), &triangles);
+	err |= clSetKernelArg(mExtendKernel, 5, sizeof(cl_mem), &bvh);
+	err |= clSetKernelArg(mExtendKernel, 6, sizeof(cl_mem), &topLevelBVH);
+	err |= clSetKernelArg(mExtendKernel, 7, sizeof(cl_mem), &instances);
+
+	err |= clSetKernelArg(mShadeKernel, 5, sizeof(cl_mem), &lights);
+	err |= clSetKernelArg(mShadeKernel, 6, sizeof(int), &lightsCount);
+	err |= clSetKernelArg(mShadeKernel, 7, sizeof(cl_mem), &triangles);
+	err |= clSetKernelArg(mShadeKernel, 8, sizeof(cl_mem), &triangleMaterials);
+	err |= clSetKernelArg(mShadeKernel, 9, sizeof(cl_mem), &normals);
+	err |= clSetKernelArg(mShadeKernel, 10, sizeof(cl_mem), &bvh);
+	err |= clSetKernelArg(mShadeKernel, 11, sizeof(cl_mem), &materials);
+	err |= clSetKernelArg(mShadeKernel, 12, sizeof(cl_mem), &lightTree);
+	err |= clSetKernelArg(mShadeKernel, 13, sizeof(cl_mem), &topLevelBVH);
+	err |= clSetKernelArg(mShadeKernel, 14, sizeof(cl_mem), &instances);
+
+	err |= clSetKernelArg(mSortCountKernel, 5, sizeof(Vector4f), &bounds.mMin);
+	err |= clSetKernelArg(mSortCountKernel, 6, sizeof(Vector4f), &bounds.mMax);
+	if (err < 0)
+	{
+		perror("Couldn't set the wavefront scene arguments");
+		return false;
+	}
+	return true;
+}
+
+bool WavefrontRenderer::SetCamera(const Vector4f& cameraPos, const Vector4f& cameraDir, float fov)
+{
+	cl_int err = clSetKernelArg(mGenerateKernel, 4, sizeof(Vector4f), &cameraPos);
+	err |= clSetKernelArg(mGenerateKernel, 5, sizeof(Vector4f), &cameraDir);
+	err |= clSetKernelArg(mGenerateKernel, 6, sizeof(float), &fov);
+	if (err < 0)
+	{
+		perror("Couldn't set the wavefront camera arguments");
+		return false;
+	}
+	return true;
+}
+
+bool WavefrontRenderer::Render(cl_command_queue queue,
+							   cl_mem image,
+							   int samples,
+							   cl_mem accumulation,
+							   int accumulatedSamples,
+							   cl_mem rayCounts,
+							   OpenCLProfiler* profiler,
+							   cl_event* renderEvent)
+{
+	const size_t imageGlobal[2] = { static_cast<size_t>(mWidth), static_cast<size_t>(mHeight) };
+
+	// The queue kernels are launched over the whole image and skip the work items past the queue size,
+	// so the host never reads the queue sizes back between the bounces
+	const size_t pathGlobal = static_cast<size_t>(mWidth) * mHeight;
+
+	const int accumulate = accumulation ? 1 : 0;
+	cl_int err = clSetKernelArg(mGenerateKernel, 8, sizeof(int), &samples);
+	err |= clSetKernelArg(mGenerateKernel, 9, sizeof(int), &accumulatedSamples);
+	err |= clSetKernelArg(mGenerateKernel, 10, sizeof(int), &accumulate);
+	err |= clSetKernelArg(mCompactKernel, 4, sizeof(cl_mem), &rayCounts);
+	if (err < 0)
+	{
+		perror("Couldn't set the wavefront frame arguments");
+		return false;
+	}
+
+	// One pass per sample keeps a single path per pixel in flight, so the shade kernel adds to the pixel without atomics
+	for (int s = 0; s < samples; ++s)
+	{
+		err = clEnqueueWriteBuffer(queue, mQueueSizes, CL_FALSE, 0, mInitialQueueSizes.size() * sizeof(cl_uint), mInitialQueueSizes.data(), 0, NULL, Track(profiler, "Reset Queues"));
+		err |= clSetKernelArg(mGenerateKernel, 0, sizeof(cl_mem), &mPaths[0]);
+		err |= clSetKernelArg(mGenerateKernel, 7, sizeof(int), &s);
+		if (err >= 0)
+			err = clEnqueueNDRangeKernel(queue, mGenerateKernel, 2, NULL, imageGlobal, NULL, 0, NULL, Track(profiler, "Generate Kernel"));
+
+		for (int bounce = 0; bounce < mMaxBounces && err >= 0; ++bounce)
+		{
+			cl_mem& paths = mPaths[bounce % 2];
+			cl_mem& nextPaths = mPaths[(bounce + 1) % 2];
+
+			err = clSetKernelArg(mExtendKernel, 0, sizeof(cl_mem), &paths);
+			err |= clSetKernelArg(mExtendKernel, 3, sizeof(int), &bounce);
+			if (err >= 0)
+				err = clEnqueueNDRangeKernel(queue, mExtendKernel, 1, NULL, &pathGlobal, NULL, 0, NULL, Track(profiler, "Extend Kernel"));
+
+			if (err >= 0)
+			{
+				err = clSetKernelArg(mShadeKernel, 0, sizeof(cl_mem), &paths);
+				err |= clSetKernelArg(mShadeKernel, 3, sizeof(int), &bounce);
+			}
+			if (err >= 0)
+				err = clEnqueueNDRangeKernel(queue, mShadeKernel, 1, NULL, &pathGlobal, NULL, 0, NULL, Track(profiler, "Shade Kernel"));
+
+			// The last bounce has no next queue to compact into
+			if (err >= 0 && bounce + 1 < mMaxBounces)
+			{
+				err = clSetKernelArg(mCompactKernel, 0, sizeof(cl_mem), &paths);
+				err |= clSetKernelArg(mCompactKernel, 1, sizeof(cl_mem), mRayReordering ? &mUnsortedPaths : &nextPaths);
+				err |= clSetKernelArg(mCompactKernel, 3, sizeof(int), &bounce);
+				if (err >= 0)
+					err = clEnqueueNDRangeKernel(queue, mCompactKernel, 1, NULL, &pathGlobal, NULL, 0, NULL, Track(profiler, "Compact Kernel"));
+			}
+
+			// The next bounce traces the surviving paths sorted by direction octant and origin cell
+			if (err >= 0 && bounce + 1 < mMaxBounces && mRayReordering && !EnqueueSort(queue, nextPaths, bounce + 1, profiler))
+				return false;
+		}
+
+		if (err < 0)
+		{
+			perror("Couldn't enqueue a wavefront sample pass");
+			return false;
+		}
+	}
+
+	err = clSetKernelArg(mResolveKernel, 0, sizeof(cl_mem), &image);
+	err |= clSetKernelArg(mResolveKernel, 4, sizeof(int), &samples);
+	err |= clSetKernelArg(mResolveKernel, 5, sizeof(cl_mem), &accumulation);
+	err |= clSetKernelArg(mResolveKernel, 6, sizeof(int), &accumulatedSamples);
+	if (err >= 0)
+		err = clEnqueueNDRangeKernel(queue, mResolveKernel, 2, NULL, imageGlobal, NULL, 0, NULL, renderEvent ? renderEvent : Track(profiler, "Resolve Kernel"));
+
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the wavefront resolve");
+		return false;
+	}
+	return true;
+}
+
+bool WavefrontRenderer::EnqueueSort(cl_command_queue queue, cl_mem sortedPaths, int bounce, OpenCLProfiler* profiler)
+{
+	const size_t pathGlobal = static_cast<size_t>(mWidth) * mHeight;
+	const size_t single = 1;
+
+	cl_int err = clEnqueueWriteBuffer(queue, mSortBins, CL_FALSE, 0, mEmptySortBins.size() * sizeof(cl_uint), mEmptySortBins.data(), 0, NULL, Track(profiler, "Reset Sort Bins"));
+	err |= clSetKernelArg(mSortCountKernel, 2, sizeof(int), &bounce);
+	if (err >= 0)
+		err = clEnqueueNDRangeKernel(queue, mSortCountKernel, 1, NULL, &pathGlobal, NULL, 0, NULL, Track(profiler, "Sort Count Kernel"));
+	if (err >= 0)
+		err = clEnqueueNDRangeKernel(queue, mSortOffsetsKernel, 1, NULL, &single, &single, 0, NULL, Track(profiler, "Sort Offsets Kernel"));
+
+	if (err >= 0)
+	{
+		err = clSetKernelArg(mSortScatterKernel, 1, sizeof(cl_mem), &sortedPaths);
+		err |= clSetKernelArg(mSortScatterKernel, 3, sizeof(int), &bounce);
+	}
+	if (err >= 0)
+		err = clEnqueueNDRangeKernel(queue, mSortScatterKernel, 1, NULL, &pathGlobal, NULL, 0, NULL, Track(profiler, "Sort Scatter Kernel"));
+
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the ray reordering");
+		return false;
+	}
+	return true;
+}
+
+cl_kernel WavefrontRenderer::CreateKernel(cl_program program, const char* name)
+{
+	cl_int err = 0;
+	cl_kernel kernel = clCreateKernel(program, name, &err);
+	if (err < 0)
+	{
+		printf("Couldn't create the %s kernel\n", name);
+		return nullptr;
+	}
+	return kernel;
+}
+
+cl_event* WavefrontRenderer::Track(OpenCLProfiler* profiler, const char* stage) const
+{
+	return profiler ? profiler->Track(stage) : NULL;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "Cl/cl.h"
+
+#include "OpenCLProfiler.h"
+
+#include "BVH.h"
+#include "MeshDefines.h"
+
+#include <vector>
+
+/// <summary>
+/// Wavefront execution of the mesh trace kernel. Instead of one megakernel tracing every path to the end,
+/// each sample pass runs separate generate, extend (intersect), shade and compact kernels connected by
+/// device side path queues. Compaction drops the terminated paths, so the later bounces only launch work
+/// for the surviving ones and every kernel keeps its registers to a single stage.
+/// With ray reordering the surviving paths are additionally sorted by direction octant and origin cell,
+/// so the secondary bounces trace coherent rays.
+///
+/// Usage:
+///		WavefrontRenderer wavefront(context, program, width, height, maxBounces);
+///		wavefront.SetScene(...);
+///		wavefront.SetCamera(cameraPos, cameraDir, fov);
+///		wavefront.Render(queue, imageBuffer, samples, accumulationBuffer, accumulatedSamples, nullptr, &profiler);
+/// </summary>
+class WavefrontRenderer
+{
+public:
+	/// <summary>
+	/// Constructor initializing a WavefrontRenderer, creating the stage kernels and the path queues.
+	/// </summary>
+	/// <param name="context">The context</param>
+	/// <param name="program">The built mesh tracing program</param>
+	/// <param name="width">The image width</param>
+	/// <param name="height">The image height</param>
+	/// <param name="maxBounces">The bounces per path, has to match the MAX_BOUNCES of the program</param>
+	WavefrontRenderer(cl_context context, cl_program program, int width, int height, int maxBounces);
+
+	/// <summary>
+	/// Destructor releasing the kernels and buffers.
+	/// </summary>
+	~WavefrontRenderer();
+
+	WavefrontRenderer(const WavefrontRenderer&) = delete;
+	WavefrontRenderer& operator=(const WavefrontRenderer&) = delete;
+public:
+	/// <summary>
+	/// Binds the scene buffers, which are referenced and must outlive the renderer.
+	/// </summary>
+	/// <param name="lightTree">The light tree, only read by programs built with LIGHT_TREE</param>
+	/// <param name="topLevelBVH">The top level BVH over the instances, only read by programs built with INSTANCING</param>
+	/// <param name="instances">The instances of the bottom level BVHs in bvh, only read by programs built with INSTANCING</param>
+	/// <param name="bounds">The scene bounds the ray origins are binned in</param>
+	/// <returns>False if a kernel argument couldn't be set, otherwise true</returns>
+	bool SetScene(cl_mem lights,
+				  int lightsCount,
+				  cl_mem triangles,
+				  cl_mem triangleMaterials,
+				  cl_mem normals,
+				  cl_mem bvh,
+				  cl_mem materials,
+				  cl_mem lightTree,
+				  cl_mem topLevelBVH,
+				  cl_mem instances,
+				  const AABB& bounds);
+
+	/// <summary>
+	/// Sets the camera of the following frames.
+	/// </summary>
+	/// <param name="cameraPos">The camera position</param>
+	/// <param name="cameraDir">The camera direction</param>
+	/// <param name="fov">The vertical field of view in degrees</param>
+	/// <returns>False if a kernel argument couldn't be set, otherwise true</returns>
+	bool SetCamera(const Vector4f& cameraPos, const Vector4f& cameraDir, float fov);
+
+	/// <summary>
+	/// Enqueues the stages of a frame without waiting for them.
+	/// </summary>
+	/// <param name="queue">The command queue</param>
+	/// <param name="image">The output image in the pixel format of the program</param>
+	/// <param name="samples">The samples per pixel</param>
+	/// <param name="accumulation">The optional accumulation buffer</param>
+	/// <param name="accumulatedSamples">The samples accumulated by the previous frames, 0 restarts the running average</param>
+	/// <param name="rayCounts">The optional secondary ray counter</param>
+	/// <param name="profiler">The optional profiler the stages are tracked by</param>
+	/// <param name="renderEvent">Optionally set to the event of the last stage</param>
+	/// <returns>False if a stage couldn't be enqueued, otherwise true</returns>
+	bool Render(cl_command_queue queue,
+				cl_mem image,
+				int samples,
+				cl_mem accumulation,
+				int accumulatedSamples,
+				cl_mem rayCounts,
+				OpenCLProfiler* profiler,
+				cl_event* renderEvent = nullptr);
+
+	inline bool IsValid() const { return mValid; }
+
+	inline void SetRayReordering(bool enabled) { mRayReordering = enabled; }
+
+	inline bool IsRayReordering() const { return mRayReordering; }
+private:
+	cl_kernel CreateKernel(cl_program program, const char* name);
+
+	bool EnqueueSort(cl_command_queue queue, cl_mem sortedPaths, int bounce, OpenCLProfiler* profiler);
+
+	cl_event* Track(OpenCLProfiler* profiler, const char* stage) const;
+private:
+	int mWidth;
+	int mHeight;
+	int mMaxBounces;
+	bool mValid = false;
+	bool mRayReordering = false;
+
+	cl_kernel mGenerateKernel = nullptr;
+	cl_kernel mExtendKernel = nullptr;
+	cl_kernel mShadeKernel = nullptr;
+	cl_kernel mCompactKernel = nullptr;
+	cl_kernel mResolveKernel = nullptr;
+	cl_kernel mSortCountKernel = nullptr;
+	cl_kernel mSortOffsetsKernel = nullptr;
+	cl_kernel mSortScatterKernel = nullptr;
+
+	// Ping-pong path queues, bounce b reads mPaths[b % 2] and compacts into the other one
+	cl_mem mPaths[2] = { nullptr, nullptr };
+	cl_mem mHits = nullptr;
+	cl_mem mRadiance = nullptr;
+	cl_mem mQueueSizes = nullptr;
+
+	// The reordered bounces compact into the unsorted paths and scatter them into the next queue
+	cl_mem mUnsortedPaths = nullptr;
+	cl_mem mSortKeys = nullptr;
+	cl_mem mSortBins = nullptr;
+
+	// Every sample pass starts with a path per pixel and empty queues for the later bounces
+	std::vector<cl_uint> mInitialQueueSizes;
+	std::vector<cl_uint> mEmptySortBins;
+};
@@ -0,0 +1,191 @@
+#include "WideBVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <utility>
+
+namespace
+{
+	constexpr uint32_t kLeafFlag = 0x80000000u;
+	constexpr int kLeafCountBits = 5;
+	constexpr uint32_t kLeafMaxStart = (1u << (31 - kLeafCountBits)) - 1;
+
+	int EncodeLeaf(const BVHNode& leaf)
+	{
+		const uint32_t ref = kLeafFlag | (static_cast<uint32_t>(leaf.mStart) << kLeafCountBits) | static_cast<uint32_t>(leaf.mCount);
+		return static_cast<int>(ref);
+	}
+
+	// Smallest biased power of two exponent such that 255 steps cover the extent
+	uint8_t ComputeExponent(float extent)
+	{
+		if (extent <= 0.0f)
+			return 1;
+
+		int exponent = 0;
+		std::frexp(extent / 255.0f, &exponent);
+		return static_cast<uint8_t>(std::clamp(exponent + 127, 1, 254));
+	}
+
+	inline float ExponentScale(uint8_t exponent)
+	{
+		return std::ldexp(1.0f, static_cast<int>(exponent) - 127);
+	}
+
+	uint8_t QuantizeMin(float value, float origin, float scale)
+	{
+		int q = std::clamp(static_cast<int>(std::floor((value - origin) / scale)), 0, 255);
+		while (q > 0 && origin + q * scale > value)
+			--q;
+		return static_cast<uint8_t>(q);
+	}
+
+	uint8_t QuantizeMax(float value, float origin, float scale)
+	{
+		int q = std::clamp(static_cast<int>(std::ceil((value - origin) / scale)), 0, 255);
+		while (q < 255 && origin + q * scale < value)
+			++q;
+		return static_cast<uint8_t>(q);
+	}
+}
+
+template<int Width>
+bool CollapseBVH(const std::vector<BVHNode>& binaryNodes,
+				 std::vector<WideBVHNode<Width>>& wideNodes)
+{
+	wideNodes.clear();
+	if (binaryNodes.empty())
+		return false;
+
+	for (const BVHNode& node : binaryNodes)
+	{
+		if (node.IsLeaf() && (node.mCount > kWideBVHMaxLeafCount || static_cast<uint32_t>(node.mStart) > kLeafMaxStart))
+		{
+			std::cerr << "BVH leaf exceeds the wide node leaf range, count: " << node.mCount << std::endl;
+			return false;
+		}
+	}
+
+	wideNodes.reserve(binaryNodes.size() / (Width - 1) + 1);
+	wideNodes.emplace_back();
+
+	// Pairs of (binary node, wide node) awaiting their children
+	std::vector<std::pair<int, int>> queue;
+	queue.emplace_back(0, 0);
+
+	for (size_t head = 0; head < queue.size(); ++head)
+	{
+		const auto [binaryIndex, wideIndex] = queue[head];
+		const BVHNode& binaryNode = binaryNodes[binaryIndex];
+
+		// Gather the children, opening the largest internal child until the node is full
+		int children[Width];
+		int childCount = 0;
+		if (binaryNode.IsLeaf())
+		{
+			children[childCount++] = binaryIndex;
+		}
+		else
+		{
+			children[childCount++] = binaryNode.mLeft;
+			children[childCount++] = binaryNode.mRight;
+		}
+
+		while (childCount < Width)
+		{
+			int largest = -1;
+			float largestArea = -1.0f;
+			for (int c = 0; c < childCount; ++c)
+			{
+				const BVHNode& child = binaryNodes[children[c]];
+				if (!child.IsLeaf() && child.mBounds.SurfaceArea() > largestArea)
+				{
+					largest = c;
+					largestArea = child.mBounds.SurfaceArea();
+				}
+			}
+
+			if (largest < 0)
+				break;
+
+			const BVHNode& opened = binaryNodes[children[largest]];
+			children[largest] = opened.mLeft;
+			children[childCount++] = opened.mRight;
+		}
+
+		// Quantization frame of the node
+		AABB bounds = AABB::Empty();
+		for (int c = 0; c < childCount; ++c)
+			bounds.Grow(binaryNodes[children[c]].mBounds);
+
+		WideBVHNode<Width> wideNode = {};
+		wideNode.mChildCount = static_cast<uint8_t>(childCount);
+
+		float scale[3];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			wideNode.mOrigin[axis] = bounds.IsValid() ? bounds.mMin[axis] : 0.0f;
+			wideNode.mExponent[axis] = ComputeExponent(bounds.IsValid() ? bounds.mMax[axis] - bounds.mMin[axis] : 0.0f);
+			scale[axis] = ExponentScale(wideNode.mExponent[axis]);
+		}
+
+		for (int c = 0; c < childCount; ++c)
+		{
+			const BVHNode& child = binaryNodes[children[c]];
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				if (child.mBounds.IsValid())
+				{
+					wideNode.mQuantizedMin[axis][c] = QuantizeMin(child.mBounds.mMin[axis], wideNode.mOrigin[axis], scale[axis]);
+					wideNode.mQuantizedMax[axis][c] = QuantizeMax(child.mBounds.mMax[axis], wideNode.mOrigin[axis], scale[axis]);
+				}
+				else
+				{
+					// Inverted box, never hit
+					wideNode.mQuantizedMin[axis][c] = 255;
+					wideNode.mQuantizedMax[axis][c] = 0;
+				}
+			}
+
+			if (child.IsLeaf())
+			{
+				wideNode.mChildren[c] = EncodeLeaf(child);
+			}
+			else
+			{
+				const int childWideIndex = static_cast<int>(wideNodes.size());
+				wideNodes.emplace_back();
+				queue.emplace_back(children[c], childWideIndex);
+				wideNode.mChildren[c] = childWideIndex;
+			}
+		}
+
+		wideNodes[wideIndex] = wideNode;
+	}
+	return true;
+}
+
+template<int Width>
+int ComputeWideBVHDepth(const std::vector<WideBVHNode<Width>>& wideNodes)
+{
+	// A reverse pass visits every child before its parent, leaf references are negative
+	std::vector<int> depths(wideNodes.size(), 0);
+	for (int i = static_cast<int>(wideNodes.size()) - 1; i >= 0; --i)
+	{
+		int childDepth = 0;
+		for (int c = 0; c < wideNodes[i].mChildCount; ++c)
+		{
+			const int child = wideNodes[i].mChildren[c];
+			if (child >= 0)
+				childDepth = std::max(childDepth, depths[child]);
+		}
+		depths[i] = 1 + childDepth;
+	}
+	return depths.empty() ? 0 : depths[0];
+}
+
+template bool CollapseBVH<4>(const std::vector<BVHNode>&, std::vector<WideBVHNode<4>>&);
+template bool CollapseBVH<8>(const std::vector<BVHNode>&, std::vector<WideBVHNode<8>>&);
+template int ComputeWideBVHDepth<4>(const std::vector<WideBVHNode<4>>&);
+template int ComputeWideBVHDepth<8>(const std::vector<WideBVHNode<8>>&);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "BVH.h"
+
+#include <cstdint>
+#include <vector>
+
+/// <summary>
+/// Maximum triangle count of a leaf referenced by a wide node.
+/// Leaf references pack the triangle count into 5 bits and the first triangle into 26 bits.
+/// </summary>
+constexpr int kWideBVHMaxLeafCount = 31;
+
+/// <summary>
+/// Compressed N-ary BVH node.
+/// Child bounds are stored as 8 bit offsets relative to the node origin, scaled by a 
+/// power of two per axis. A child reference is either the index of another wide node 
+/// (>= 0) or a leaf (sign bit set) packing the first triangle and the triangle count.
+/// </summary>
+template<int Width>
+struct WideBVHNode
+{
+public:
+	static_assert(Width == 4 || Width == 8, "Only 4 and 8 wide nodes are supported");
+public:
+	float mOrigin[3];
+	uint8_t mExponent[3];
+	uint8_t mChildCount;
+	int mChildren[Width];
+	uint8_t mQuantizedMin[3][Width];
+	uint8_t mQuantizedMax[3][Width];
+};
+static_assert(sizeof(WideBVHNode<4>) == 56, "WideBVHNode<4> must match the OpenCL WideBVHNode layout");
+static_assert(sizeof(WideBVHNode<8>) == 96, "WideBVHNode<8> must match the OpenCL WideBVHNode layout");
+
+/// <summary>
+/// Collapses a binary BVH into a compressed wide BVH.
+/// Each wide node repeatedly opens its largest internal child until it holds Width children.
+/// </summary>
+/// <typeparam name="Width">The node width, 4 or 8</typeparam>
+/// <param name="binaryNodes">The binary tree, root at index 0</param>
+/// <param name="wideNodes">The output wide nodes, root at index 0</param>
+/// <returns>True if the tree could be collapsed, false if a leaf exceeds the packable range</returns>
+template<int Width>
+bool CollapseBVH(const std::vector<BVHNode>& binaryNodes,
+				 std::vector<WideBVHNode<Width>>& wideNodes);
+
+/// <summary>
+/// Computes the depth of a collapsed wide BVH, the number of inner nodes on its longest path to a leaf.
+/// Relies on CollapseBVH allocating the children after their parent.
+/// </summary>
+/// <typeparam name="Width">The node width, 4 or 8</typeparam>
+/// <param name="wideNodes">The wide nodes, root at index 0</param>
+/// <returns>The depth, 0 for an empty tree</returns>
+template<int Width>
+int ComputeWideBVHDepth(const std::vector<WideBVHNode<Width>>& wideNodes);
@@ -1,10 +1,28 @@
+#include "Benchmark.h"
+#include "CommandLine.h"
+#include "FrameRenderer.h"
+#include "KernelVariant.h"
+#include "OpenCLProfiler.h"
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
+#include "PixelFormat.h"
 #include "RandomUtils.h"
+#include "RenderBackend.h"
+#include "RenderSettings.h"
+#include "SceneChangeTracker.h"
+#include "ThreadPool.h"
 #include "Timer.h"
 
+#include "BVH.h"
+#include "BVHRefitter.h"
+#include "CpuTracer.h"
+#include "InstancedScene.h"
+#include "LightTree.h"
 #include "MeshDefines.h"
 #include "MeshImporter.h"
+#include "SceneGeometry.h"
+#include "WavefrontRenderer.h"
+#include "WideBVH.h"
 
 cl_device_id device = nullptr;
 cl_context context = nullptr;
@@ -13,33 +31,8 @@ cl_kernel kernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
-struct AABB
-{
-	Vector4f mMin;
-	Vector4f mMax;
-};
-
-struct BVHNode
-{
-	AABB mBounds;
-	int mLeft = -1;
-	int mRight = -1;
-	int mStart = 0;
-	int mCount = 0;
-};
-
-void UploadMesh(const Mesh& mesh, std::vector<Triangle>& output)
-{
-	for (const Triangle& triangle : mesh.triangles)
-	{
-		Triangle tri = triangle;
-		tri.materialIndex = mesh.materialIndex;
-		output.emplace_back(tri);
-	}
-}
-
 void InitializeScene(std::vector<Material>& materials,
-					 std::vector<Triangle>& triangles)
+					 std::vector<Mesh>& meshes)
 {
 	Material mat1;
 	mat1.diffuseColor = { 0.0f, 0.8f, 0.8f, 0 };
@@ -74,138 +67,360 @@ void InitializeScene(std::vector<Material>& materials,
 	MeshImporter::Import("content/plane.obj", plane);
 	plane.materialIndex = 1;
 
-	UploadMesh(suzanne, triangles);
-	UploadMesh(sphere, triangles);
-	UploadMesh(plane, triangles);
+	meshes.emplace_back(std::move(suzanne));
+	meshes.emplace_back(std::move(sphere));
+	meshes.emplace_back(std::move(plane));
 }
 
-Vector4f ComponentMinimum(const Vector4f& a, const Vector4f& b)
+BVHBuildSettings ParseBVHSettings(const CommandLine& commandLine)
 {
-	return {std::min(a.x, b.x),
-			std::min(a.y, b.y),
-			std::min(a.z, b.z),
-			std::min(a.w, b.w)};
+	BVHBuildSettings settings;
+	settings.mMethod = commandLine.GetString("bvh", "sah") == "median" ? BVHBuildMethod::Median : BVHBuildMethod::BinnedSAH;
+	settings.mMaxTrianglesPerLeaf = commandLine.GetInt("bvh-leaf-size", settings.mMaxTrianglesPerLeaf);
+	settings.mBinCount = commandLine.GetInt("bvh-bins", settings.mBinCount);
+	settings.mTraversalCost = commandLine.GetFloat("bvh-traversal-cost", settings.mTraversalCost);
+	settings.mIntersectionCost = commandLine.GetFloat("bvh-leaf-cost", settings.mIntersectionCost);
+
+	// Wide nodes pack the leaf triangle count into a few bits
+	if (commandLine.GetInt("bvh-width", 2) > 2)
+		settings.mMaxTrianglesPerLeaf = std::min(settings.mMaxTrianglesPerLeaf, kWideBVHMaxLeafCount);
+	return settings;
 }
 
-Vector4f ComponentMaximum(const Vector4f& a, const Vector4f& b)
+void ReportBVH(const std::vector<BVHNode>& bvh, const BVHBuildSettings& settings, double buildTime_ms)
 {
-	return {std::max(a.x, b.x),
-			std::max(a.y, b.y),
-			std::max(a.z, b.z),
-			std::max(a.w, b.w)};
+	std::cout << "BVH (" << ToString(settings.mMethod) << ")"
+			  << "\tNodes: " << bvh.size()
+			  << "\tSAH Cost: " << ComputeSAHCost(bvh, settings)
+			  << "\tBuild Time: " << std::to_string(buildTime_ms) << std::endl;
 }
 
-AABB ComputeAABB(const std::vector<Triangle>& triangles, int start, int end) 
+void ReportBVHBuildScaling(const SceneGeometry& geometry, const BVHBuildSettings& settings)
 {
-	AABB aabb;
-	
-	// Initialize AABB to very large and small values
-	aabb.mMin = Vector4f(FLT_MAX, FLT_MAX, FLT_MAX, 0);
-	aabb.mMax = Vector4f(-FLT_MAX, -FLT_MAX, -FLT_MAX, 0);
+	const uint32_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
 
-	for (int i = start; i < end; ++i)
+	std::vector<uint32_t> threadCounts;
+	for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(maxThreads);
+
+	double singleThreadTime_ms = 0.0;
+	for (uint32_t threads : threadCounts)
 	{
-		const Triangle& tri = triangles[i];
+		ThreadPool pool(threads);
+
+		// Best of a few runs to filter out allocation and scheduling noise
+		double bestTime_ms = DBL_MAX;
+		for (int run = 0; run < 3; ++run)
+		{
+			SceneGeometry buildGeometry = geometry;
+			std::vector<BVHNode> buildBVH;
+
+			Timer buildTimer(true);
+			ConstructBVH(buildBVH, buildGeometry, settings, &pool);
+			bestTime_ms = std::min(bestTime_ms, buildTimer.Stop_ms());
+		}
 
-		aabb.mMin = ComponentMinimum(aabb.mMin, tri.vertex_0);
-		aabb.mMin = ComponentMinimum(aabb.mMin, tri.vertex_1);
-		aabb.mMin = ComponentMinimum(aabb.mMin, tri.vertex_2);
+		if (threads == 1)
+			singleThreadTime_ms = bestTime_ms;
 
-		aabb.mMax = ComponentMaximum(aabb.mMax, tri.vertex_0);
-		aabb.mMax = ComponentMaximum(aabb.mMax, tri.vertex_1);
-		aabb.mMax = ComponentMaximum(aabb.mMax, tri.vertex_2);
+		std::cout << "BVH Build Threads: " << threads 
+				  << "\tBuild Time: " << std::to_string(bestTime_ms) 
+				  << "\tSpeedup: " << std::to_string(singleThreadTime_ms / bestTime_ms) << std::endl;
 	}
+}
 
-	return aabb;
+/// <summary>
+/// Retrieves the traversal stack entries a depth first traversal of a tree of the depth needs.
+/// Every inner node on the path leaves all but one of its children on the stack.
+/// </summary>
+int GetTraversalStackSize(int depth, int width)
+{
+	return 1 + depth * (width - 1);
 }
 
-void ConstructBVH(std::vector<BVHNode>& nodes,
-				  std::vector<Triangle>& triangles,
-				  int maxTrianglesPerLeaf = 2)
+/// <summary>
+/// Packs the BVH into the node layout consumed by the kernel compiled with -DBVH_WIDTH=width.
+/// The depth of the packed tree sizes the traversal stack of that kernel.
+/// </summary>
+bool PackBVH(const std::vector<BVHNode>& bvh, int width, std::vector<uint8_t>& output, int& depth)
 {
-	nodes.reserve(triangles.size() * 2);
+	const size_t binarySize = bvh.size() * sizeof(BVHNode);
+	if (width == 4 || width == 8)
+	{
+		size_t wideCount = 0;
+		size_t wideSize = 0;
+		if (width == 4)
+		{
+			std::vector<WideBVHNode<4>> wide;
+			if (!CollapseBVH(bvh, wide))
+				return false;
+			output.assign(reinterpret_cast<const uint8_t*>(wide.data()), reinterpret_cast<const uint8_t*>(wide.data() + wide.size()));
+			wideCount = wide.size();
+			wideSize = wide.size() * sizeof(WideBVHNode<4>);
+			depth = ComputeWideBVHDepth(wide);
+		}
+		else
+		{
+			std::vector<WideBVHNode<8>> wide;
+			if (!CollapseBVH(bvh, wide))
+				return false;
+			output.assign(reinterpret_cast<const uint8_t*>(wide.data()), reinterpret_cast<const uint8_t*>(wide.data() + wide.size()));
+			wideCount = wide.size();
+			wideSize = wide.size() * sizeof(WideBVHNode<8>);
+			depth = ComputeWideBVHDepth(wide);
+		}
+
+		std::cout << "BVH" << width << " Nodes: " << wideCount
+				  << "\tMemory: " << wideSize << " bytes (binary " << binarySize << " bytes, "
+				  << std::to_string(static_cast<double>(binarySize) / std::max<size_t>(1, wideSize)) << "x smaller)" << std::endl;
+		return true;
+	}
 
-	struct BuildTask
+	output.assign(reinterpret_cast<const uint8_t*>(bvh.data()), reinterpret_cast<const uint8_t*>(bvh.data() + bvh.size()));
+	depth = ComputeBVHDepth(bvh);
+	return true;
+}
+
+/// <summary>
+/// Displaces the first vertices along their normals with a wave travelling up the meshes.
+/// The displacement is small enough to keep the normals as an approximation.
+/// </summary>
+void DeformVertices(SceneGeometry& geometry, const std::vector<Vector4f>& restVertices, float time)
+{
+	for (size_t i = 0; i < restVertices.size(); ++i)
 	{
-		int mStart = 0;
-		int mEnd = 0;
-		int mNodeIndex = 0;
-	};
+		const Vector4f& rest = restVertices[i];
+		const Vector4f& normal = geometry.normals[i];
+		const float offset = 0.1f * std::sin(time * 3.0f + rest.y * 6.0f);
+		geometry.vertices[i] = Vector4f(rest.x + normal.x * offset, rest.y + normal.y * offset, rest.z + normal.z * offset, rest.w);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	CommandLine commandLine(argc, argv);
+	const RenderBackend backend = SelectRenderBackend(commandLine);
+	std::cout << "Backend: " << ToString(backend) << std::endl;
+
+	RenderSettings defaultSettings;
+	defaultSettings.mCameraPosition = { 0.0f, 2.0f, 8.0f };
+	defaultSettings.mCameraDirection = { 0.0f, -0.3f, -1.0f };
+	const RenderSettings renderSettings = ParseRenderSettings(commandLine, defaultSettings);
+
+	const int Width		= renderSettings.mWidth;
+	const int Height	= renderSettings.mHeight;
+	const int Samples	= renderSettings.mSamples;
+
+	// Camera setup
+	Vector4f CameraPos(renderSettings.mCameraPosition.x, renderSettings.mCameraPosition.y, renderSettings.mCameraPosition.z, 0.0f);
+	Vector4f CameraDir(renderSettings.mCameraDirection.x, renderSettings.mCameraDirection.y, renderSettings.mCameraDirection.z, 0.0f);
+	float fov = renderSettings.mFov;
 
-	std::vector<BuildTask> stack;
-	stack.push_back({0, static_cast<int>(triangles.size()), 0});
+	std::vector<Material> Materials;
+	SceneGeometry Geometry;
+	std::vector<Vector4f> Lights;
+	Lights.emplace_back(Vector4f(1.0f, 3.0f, 0.0f, 5.0f));
+
+	std::vector<Mesh> Meshes;
+	InitializeScene(Materials, Meshes);
+	for (const Mesh& mesh : Meshes)
+		AppendMesh(mesh, Geometry);
+
+	const BVHBuildSettings bvhSettings = ParseBVHSettings(commandLine);
 
-	nodes.push_back(BVHNode());
+	ThreadPool buildPool(static_cast<uint32_t>(std::max(0, commandLine.GetInt("bvh-threads", 0))));
 
-	while (!stack.empty())
+	if (commandLine.Has("bvh-timing"))
+		ReportBVHBuildScaling(Geometry, bvhSettings);
+
+	// Report the alternative builder on the same input so the SAH savings can be compared
+	if (commandLine.Has("bvh-compare"))
 	{
-		BuildTask task = stack.back();
-		stack.pop_back();
+		BVHBuildSettings compareSettings = bvhSettings;
+		compareSettings.mMethod = bvhSettings.mMethod == BVHBuildMethod::Median ? BVHBuildMethod::BinnedSAH : BVHBuildMethod::Median;
+
+		SceneGeometry compareGeometry = Geometry;
+		std::vector<BVHNode> compareBVH;
+
+		Timer compareTimer(true);
+		ConstructBVH(compareBVH, compareGeometry, compareSettings, &buildPool);
+		ReportBVH(compareBVH, compareSettings, compareTimer.Stop_ms());
+	}
 
-		const int start = task.mStart;
-		const int end = task.mEnd;
-		const int nodeIndex = task.mNodeIndex;
-		const int count = end - start;
+	std::vector<BVHNode> bvh;
 
-		BVHNode& node = nodes[nodeIndex];
-		node.mBounds = ComputeAABB(triangles, start, end);
-		if (count <= maxTrianglesPerLeaf)
+	Timer bvhTimer(true);
+	ConstructBVH(bvh, Geometry, bvhSettings, &buildPool);
+	const double bvhBuildTime_ms = bvhTimer.Stop_ms();
+
+	DeviceGeometry deviceGeometry;
+	BuildDeviceGeometry(Geometry, deviceGeometry);
+
+	const size_t deviceGeometrySize = GetDeviceMemorySize(deviceGeometry);
+	const size_t legacyGeometrySize = Geometry.triangles.size() * 112; // Three vertices, three normals and a material as float4 records
+	std::cout << "Triangles: " << Geometry.triangles.size() 
+			  << "\tVertices: " << Geometry.vertices.size()
+			  << "\tGeometry Memory: " << deviceGeometrySize << " bytes (" 
+			  << std::to_string(static_cast<double>(deviceGeometrySize) / std::max<size_t>(1, Geometry.triangles.size())) << " bytes per triangle, " 
+			  << std::to_string(static_cast<double>(legacyGeometrySize) / std::max<size_t>(1, deviceGeometrySize)) << "x smaller)" << std::endl;
+	ReportBVH(bvh, bvhSettings, bvhBuildTime_ms);
+
+	int bvhWidth = commandLine.GetInt("bvh-width", 2);
+	if (bvhWidth != 4 && bvhWidth != 8)
+		bvhWidth = 2;
+
+	// --instances N places N copies of the suzanne and sphere meshes on a grid as instances of a two-level
+	// acceleration structure. Every unique mesh is stored once with its own bottom level BVH, and moving the
+	// instances with --animate-instances only rebuilds the top level BVH over them
+	const int instanceCopies = std::max(0, commandLine.GetInt("instances", 0));
+	const bool instancing = backend == RenderBackend::OpenCL && instanceCopies > 0;
+	if (instanceCopies > 0 && !instancing)
+		std::cout << "Instancing requires the OpenCL backend" << std::endl;
+
+	InstancedScene instancedScene;
+
+	// Grid transform of every animated instance, indexed like the instances
+	std::vector<Matrix4f> instancePlacements;
+	const bool animateInstances = instancing && commandLine.Has("animate-instances");
+	float instanceAngle = 0.0f;
+	if (instancing)
+	{
+		// The instances reference the bottom level roots by binary node index
+		if (bvhWidth != 2)
 		{
-			node.mStart = start;
-			node.mCount = count;
-			node.mLeft = -1;
-			node.mRight = -1;
-			continue;
+			std::cout << "Instancing traverses the binary BVH, ignoring --bvh-width " << bvhWidth << std::endl;
+			bvhWidth = 2;
 		}
 
-		Vector4f size = node.mBounds.mMax - node.mBounds.mMin;
-		int axis = (size.x > size.y && size.x > size.z) ? 0 : (size.y > size.z ? 1 : 2);
+		Timer bottomLevelTimer(true);
+		for (const Mesh& mesh : Meshes)
+			instancedScene.AddMesh(mesh, bvhSettings, &buildPool);
+		const double bottomLevelTime_ms = bottomLevelTimer.Stop_ms();
 
-		// Partition
-		int mid = (count > 1) ? static_cast<int>((start + end) / 2.0f) : 1;
-		std::nth_element(triangles.begin() + start, triangles.begin() + mid, triangles.begin() + end,
-						 [axis](const Triangle& a, const Triangle& b)
-						 {
-							return a.Centriod()[axis] < b.Centriod()[axis];
-						 });
+		// The copies of suzanne and the sphere keep the spacing of their bounds, centered on the original placement
+		AABB copyBounds = AABB::Empty();
+		for (int mesh = 0; mesh < 2; ++mesh)
+		{
+			for (const Vector4f& vertex : Meshes[mesh].vertices)
+				copyBounds.Grow(vertex);
+		}
+		const float spacingX = (copyBounds.mMax.x - copyBounds.mMin.x) * 1.25f;
+		const float spacingZ = (copyBounds.mMax.z - copyBounds.mMin.z) * 1.25f;
+		const int gridSize = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(instanceCopies))));
 
-		// Create children w/ placeholders
-		int leftChild = static_cast<int>(nodes.size());
-		nodes.push_back(BVHNode());
+		for (int copy = 0; copy < instanceCopies; ++copy)
+		{
+			const float x = (copy % gridSize - (gridSize - 1) * 0.5f) * spacingX;
+			const float z = (copy / gridSize - (gridSize - 1) * 0.5f) * spacingZ;
+			for (int mesh = 0; mesh < 2; ++mesh)
+			{
+				const Matrix4f placement = Matrix4f::Translation(x, 0.0f, z);
+				instancedScene.AddInstance(mesh, placement);
+				instancePlacements.push_back(placement);
+			}
+		}
+		instancedScene.AddInstance(2, Matrix4f::Identity());
 
-		int rightChild = static_cast<int>(nodes.size());
-		nodes.push_back(BVHNode());
+		Timer topLevelTimer(true);
+		instancedScene.BuildTopLevel();
+		const double topLevelTime_ms = topLevelTimer.Stop_ms();
 
-		node = nodes[nodeIndex];
-		node.mLeft = leftChild;
-		node.mRight = rightChild;
-		node.mStart = -1;
-		node.mCount = -1;
+		const size_t uniqueTriangles = instancedScene.GetGeometry().triangles.size();
+		const size_t placedTriangles = instancedScene.GetPlacedTriangleCount();
+		std::cout << "Instances: " << instancedScene.GetInstanceCount() << " of " << instancedScene.GetMeshCount() << " meshes"
+				  << "\tTriangles: " << uniqueTriangles << " unique, " << placedTriangles << " placed"
+				  << "\tBottom Level Build Time: " << std::to_string(bottomLevelTime_ms)
+				  << "\tTop Level Nodes: " << instancedScene.GetTopLevelNodes().size()
+				  << "\tTop Level Build Time: " << std::to_string(topLevelTime_ms) << std::endl;
 
-		stack.push_back({mid, end, rightChild});
-		stack.push_back({start, mid, leftChild});
+		BuildDeviceGeometry(instancedScene.GetGeometry(), deviceGeometry);
 	}
-}
 
-int main()
-{
-	const int Width		= 1280;
-	const int Height	= 720;
+	// --deform animates suzanne and the sphere with a wave along their normals. Every frame refits the BVH to the
+	// moved triangles instead of rebuilding it, and --bvh-rebuild-threshold rebuilds it once its SAH cost grew by that ratio
+	const bool deform = !instancing && commandLine.Has("deform");
+	if (commandLine.Has("deform") && !deform)
+		std::cout << "Deforming meshes are not supported with instancing" << std::endl;
 
-	// Camera setup
-	Vector4f CameraPos(0.0f, 2.0f, 8.0f, 0.0f);
-	Vector4f CameraDir(0.0f, -0.3f, -1.0f, 0.0f);
-	float fov = 60.0f;
+	BVHQualityMonitor bvhQuality(std::max(1.0f, commandLine.GetFloat("bvh-rebuild-threshold", 1.3f)));
+	bvhQuality.OnBuild(ComputeTriangleRelativeSAHCost(bvh, Geometry, bvhSettings));
 
-	std::vector<Material> Materials;
-	std::vector<Triangle> Triangles;
-	std::vector<Vector4f> Lights;
-	Lights.emplace_back(Vector4f(1.0f, 3.0f, 0.0f, 5.0f));
+	// The OpenCL backend refits the device nodes every frame and only refits the host copy every --bvh-quality-interval
+	// frames to sample its cost, the native backend traverses the host copy and refits it every frame
+	const int bvhQualityInterval = backend == RenderBackend::Cpu ? 1 : std::max(1, commandLine.GetInt("bvh-quality-interval", 4));
+	int framesSinceQualityCheck = 0;
+	bool bvhRebuilt = false;
 
-	InitializeScene(Materials, Triangles);
+	std::vector<Vector4f> restVertices;
+	float deformTime = 0.0f;
+	if (deform)
+	{
+		// The device refit updates binary nodes in place
+		if (bvhWidth != 2)
+		{
+			std::cout << "Deforming meshes refit the binary BVH, ignoring --bvh-width " << bvhWidth << std::endl;
+			bvhWidth = 2;
+		}
 
-	std::vector<BVHNode> bvh;
-	ConstructBVH(bvh, Triangles, 5);
+		// Suzanne and the sphere are the first meshes, the plane stays flat
+		const size_t deformedVertices = std::min(Geometry.normals.size(), Meshes[0].vertices.size() + Meshes[1].vertices.size());
+		restVertices.assign(Geometry.vertices.begin(), Geometry.vertices.begin() + deformedVertices);
+		std::cout << "Deforming " << deformedVertices << " vertices, rebuilding the BVH past " << std::to_string(bvhQuality.GetRebuildThreshold())
+				  << "x of its built SAH cost" << std::endl;
+	}
+
+	std::vector<uint8_t> packedBVH;
+	int bvhDepth = 0;
+	if (!PackBVH(instancing ? instancedScene.GetBottomLevelNodes() : bvh, bvhWidth, packedBVH, bvhDepth))
+	{
+		bvhWidth = 2;
+		PackBVH(bvh, bvhWidth, packedBVH, bvhDepth);
+	}
+
+	// The kernels are built with a traversal stack covering the deepest tree they traverse, so no subtree is ever skipped.
+	// It doesn't shrink below the previous fixed size, which leaves headroom for the trees rebuilt by --deform and --animate-instances
+	if (instancing)
+	{
+		bvhDepth = ComputeBVHDepth(instancedScene.GetTopLevelNodes());
+		for (const DeviceInstance& instance : instancedScene.GetDeviceInstances())
+			bvhDepth = std::max(bvhDepth, ComputeBVHDepth(instancedScene.GetBottomLevelNodes(), instance.mRoot));
+	}
+	const int bvhStackSize = std::max(bvhWidth > 4 ? 128 : 64, GetTraversalStackSize(bvhDepth, bvhWidth));
+	std::cout << "BVH Depth: " << bvhDepth << "\tTraversal Stack: " << bvhStackSize << std::endl;
+
+	// The ray sorting bins the ray origins and the extra lights are placed in the scene bounds
+	const AABB sceneBounds = instancing ? instancedScene.GetTopLevelNodes()[0].mBounds : bvh[0].mBounds;
+
+	// --light-count N scatters N additional point lights above the scene to stress the light loop
+	const int extraLights = std::max(0, commandLine.GetInt("light-count", 0));
+	if (extraLights > 0)
+	{
+		const float height = std::max(1.0f, sceneBounds.mMax.y - sceneBounds.mMin.y);
+		for (int i = 0; i < extraLights; ++i)
+		{
+			Lights.emplace_back(Vector4f(RandUtils::RandomRange<float>(sceneBounds.mMin.x, sceneBounds.mMax.x),
+										 RandUtils::RandomRange<float>(sceneBounds.mMax.y, sceneBounds.mMax.y + height),
+										 RandUtils::RandomRange<float>(sceneBounds.mMin.z, sceneBounds.mMax.z),
+										 1.0f));
+		}
+	}
+
+	// --light-tree shades every hit with a single light sampled from a tree over the lights instead of looping
+	// over all of them, so the shading cost grows with the logarithm of the light count
+	const bool useLightTree = backend == RenderBackend::OpenCL && commandLine.Has("light-tree");
+	if (commandLine.Has("light-tree") && !useLightTree)
+		std::cout << "The light tree requires the OpenCL backend" << std::endl;
+
+	std::vector<LightTreeNode> lightTree;
+	if (useLightTree)
+		ConstructLightTree(lightTree, Lights);
+	std::cout << "Lights: " << Lights.size();
+	if (useLightTree)
+		std::cout << " (light tree of " << lightTree.size() << " nodes)";
+	std::cout << std::endl;
+
+	const std::string buildOptions = "-DBVH_WIDTH=" + std::to_string(bvhWidth) + " -DBVH_STACK_SIZE=" + std::to_string(bvhStackSize) + (useLightTree ? " -DLIGHT_TREE" : "") + (instancing ? " -DINSTANCING" : "");
 
 
 	Vector4f ray_origin(1, -3, 2, 0);
@@ -213,111 +428,491 @@ int main()
 
 
 
-	if (!OpenCLUtils::initialize_device_and_context(device, context))
-		return -1;
+	// The kernels write the format OpenCV presents directly, the CPU backend writes RGBA8
+	const PixelFormat outputFormat = backend == RenderBackend::OpenCL ? ParsePixelFormat(commandLine, PixelFormat::BGRA8) : PixelFormat::RGBA8;
+
+	cl_mem lightsBuffer = nullptr;
+	cl_mem materialsBuffer = nullptr;
+	cl_mem lightTreeBuffer = nullptr;
+	cl_mem topLevelBuffer = nullptr;
+	cl_mem instancesBuffer = nullptr;
+	cl_mem trianglesBuffer = nullptr;
+	cl_mem triangleMaterialsBuffer = nullptr;
+	cl_mem bvhBuffer = nullptr;
 
-	if (!OpenCLUtils::initialize_program("shaders/tracing.cl", "trace", context, device, program, kernel, queue))
+	// --wavefront renders with the generate, extend, shade and compact kernels instead of the trace megakernel,
+	// --reorder-rays additionally sorts the secondary rays by direction octant and origin cell
+	const bool useWavefront = commandLine.Has("wavefront") || commandLine.Has("reorder-rays");
+	std::unique_ptr<WavefrontRenderer> wavefront;
+
+	// --adaptive stops sampling converged pixels and spends their time on the noisy ones, every pixel refines
+	// until the standard error of its mean relative to its brightness reached --adaptive-threshold.
+	// Only the trace megakernel skips converged pixels, the wavefront kernels sample every pixel uniformly
+	const bool adaptive = backend == RenderBackend::OpenCL && renderSettings.mAccumulate && !useWavefront && commandLine.Has("adaptive");
+	const float adaptiveThreshold = std::max(1e-4f, commandLine.GetFloat("adaptive-threshold", 0.02f));
+	cl_mem pixelSamplesBuffer = nullptr;
+	if (commandLine.Has("adaptive") && !adaptive)
 	{
-		assert(false);
-		return -1;
+		if (useWavefront)
+			std::cout << "Adaptive sampling isn't supported by --wavefront and --reorder-rays, ignoring --adaptive" << std::endl;
+		else
+			std::cout << "Adaptive sampling requires the OpenCL backend and the progressive accumulation" << std::endl;
 	}
 
-	cv::Mat outputImg(Height, Width, CV_8UC4, cv::Scalar(0));
-
-	const size_t imageBufferSize = Width * Height * sizeof(uint8_t) * 4;
-	cl_mem imageBuffer = OpenCLUtils::create_inout_buffer(context, outputImg.data, imageBufferSize);
-
-	const int lightsCount = static_cast<int>(Lights.size());
-	cl_mem lightsBuffer = OpenCLUtils::create_input_buffer(context, Lights.data(), lightsCount * sizeof(Vector4f));
-	const int materialsCount = static_cast<int>(Materials.size());
-	cl_mem materialsBuffer = OpenCLUtils::create_input_buffer(context, Materials.data(), materialsCount * sizeof(Material));
-	const int trianglesCount = static_cast<int>(Triangles.size());
-	cl_mem trianglesBuffer = OpenCLUtils::create_input_buffer(context, Triangles.data(), trianglesCount * sizeof(Triangle));
-
-	/* Create kernel arguments */
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &imageBuffer);
-	err |= clSetKernelArg(kernel, 1, sizeof(int), &Width);
-	err |= clSetKernelArg(kernel, 2, sizeof(int), &Height);
-	err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &lightsBuffer);
-	err |= clSetKernelArg(kernel, 4, sizeof(int), &lightsCount);
-	err |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &trianglesBuffer);
-	err |= clSetKernelArg(kernel, 6, sizeof(int), &trianglesCount);
-	err |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &materialsBuffer);
-	err |= clSetKernelArg(kernel, 8, sizeof(Vector4f), &CameraPos);
-	err |= clSetKernelArg(kernel, 9, sizeof(Vector4f), &CameraDir);
-	err |= clSetKernelArg(kernel, 10, sizeof(float), &fov);
-	if (err < 0)
+	// Refits the device BVH of the deforming meshes
+	std::unique_ptr<BVHRefitter> bvhRefitter;
+
+	// The native backend always traverses the binary BVH, its tracer is only created when it is selected
+	std::unique_ptr<CpuTracer> cpuTracer;
+
+	// Bakes the scene counts and resolution into the kernel unless --kernel-variant generic is passed
+	KernelVariant defaultVariant;
+	defaultVariant.mMaxBounces = CpuTracer::MaxBounces;
+	defaultVariant.mImageWidth = Width;
+	defaultVariant.mImageHeight = Height;
+	defaultVariant.mLightCount = static_cast<int>(Lights.size());
+	defaultVariant.mOptions = buildOptions;
+	defaultVariant.mOutputFormat = outputFormat;
+	const KernelVariant kernelVariant = ParseKernelVariant(commandLine, defaultVariant);
+	if (backend == RenderBackend::Cpu)
 	{
-		perror("Couldn't create a kernel argument");
-		return false;
+		cpuTracer = std::make_unique<CpuTracer>(deviceGeometry, bvh, Materials, Lights);
+		cpuTracer->SetShadows(kernelVariant.mShadows);
 	}
 
-	size_t global[2] = { Width, Height };
-
-	const std::string winName = "Mesh Tracing";
-	cv::namedWindow(winName, cv::WINDOW_AUTOSIZE);
-	cv::imshow(winName, outputImg);
+	// --profile records the device timestamps of every command
+	OpenCLProfiler profiler(backend == RenderBackend::OpenCL && commandLine.Has("profile"));
+	const cl_command_queue_properties queueProperties = profiler.IsEnabled() ? CL_QUEUE_PROFILING_ENABLE : 0;
 
-	Timer gpuBufferReadTimer;
-	Timer drawTimer;
+	FrameRenderer frameRenderer(commandLine, backend, renderSettings, outputFormat, profiler);
+	frameRenderer.SetPixelFunction([&](float px, float py, int* secondaryRays)
+	{
+		return cpuTracer->TracePixel(px, py, Width, Height, CameraPos, CameraDir, fov, secondaryRays);
+	});
 
-	float deltaTime_s = 0.01f;
-	while (true)
+	if (backend == RenderBackend::OpenCL)
 	{
-		gpuBufferReadTimer.Start();
-
-		err = clEnqueueNDRangeKernel(queue,
-									 kernel,
-									 2,
-									 NULL,
-									 (const size_t*)&global,
-									 NULL,
-									 0,
-									 NULL,
-									 NULL);
+		if (!OpenCLUtils::initialize_device_and_context(device, context))
+			return -1;
 
-		if (err < 0)
+		OpenCLUtils::set_program_cache_directory(commandLine.Has("no-kernel-cache") ? "" : commandLine.GetString("kernel-cache", "shader_cache"));
+
+		std::cout << "Kernel Variant: " << kernelVariant.GetName() << std::endl;
+		if (!OpenCLUtils::initialize_program("shaders/tracing.cl", "trace", context, device, program, kernel, queue, kernelVariant.GetBuildOptions(), queueProperties))
 		{
-			perror("Couldn't enqueue the kernel");
-			return false;
+			assert(false);
+			return -1;
 		}
 
-		///* Read the kernel's output    */
-		err = clEnqueueReadBuffer(queue,
-								  imageBuffer,
-								  CL_FALSE,
-								  0,
-								  imageBufferSize,
-								  outputImg.data,
-								  0,
-								  NULL,
-								  NULL);
+		const int lightsCount = static_cast<int>(Lights.size());
+		lightsBuffer = OpenCLUtils::create_input_buffer(context, Lights.data(), lightsCount * sizeof(Vector4f));
+		const int materialsCount = static_cast<int>(Materials.size());
+		materialsBuffer = OpenCLUtils::create_input_buffer(context, Materials.data(), materialsCount * sizeof(Material));
+		const int trianglesCount = static_cast<int>(deviceGeometry.triangles.size());
+		trianglesBuffer = OpenCLUtils::create_input_buffer(context, deviceGeometry.triangles.data(), trianglesCount * sizeof(TriangleAccel));
+		triangleMaterialsBuffer = OpenCLUtils::create_input_buffer(context, deviceGeometry.materials.data(), trianglesCount * sizeof(int));
+		cl_mem normalsBuffer = OpenCLUtils::create_input_buffer(context, deviceGeometry.normals.data(), deviceGeometry.normals.size() * sizeof(uint32_t));
+
+		// The deforming meshes refit the nodes on the device, and their rebuilds may change the node count
+		// within the 2N - 1 nodes of a binary BVH over N triangles
+		if (deform)
+		{
+			const size_t bvhCapacity = std::max(1, trianglesCount * 2 - 1);
+			bvhBuffer = OpenCLUtils::create_device_buffer(context, bvhCapacity * sizeof(BVHNode));
+			if (!bvhBuffer || clEnqueueWriteBuffer(queue, bvhBuffer, CL_TRUE, 0, packedBVH.size(), packedBVH.data(), 0, NULL, NULL) < 0)
+			{
+				perror("Couldn't upload the BVH");
+				return -1;
+			}
+
+			bvhRefitter = std::make_unique<BVHRefitter>(context, program, bvhCapacity);
+			if (!bvhRefitter->IsValid() || !bvhRefitter->SetTopology(queue, bvh))
+				return -1;
+			std::cout << "BVH Refit Levels: " << bvhRefitter->GetLevelCount() << std::endl;
+		}
+		else
+		{
+			bvhBuffer = OpenCLUtils::create_input_buffer(context, packedBVH.data(), packedBVH.size());
+		}
 
+		/* Create kernel arguments, the frame renderer binds the image, ray counter, accumulation and work counter */
+		err = clSetKernelArg(kernel, 1, sizeof(int), &Width);
+		err |= clSetKernelArg(kernel, 2, sizeof(int), &Height);
+		err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &lightsBuffer);
+		err |= clSetKernelArg(kernel, 4, sizeof(int), &lightsCount);
+		err |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &trianglesBuffer);
+		err |= clSetKernelArg(kernel, 6, sizeof(int), &trianglesCount);
+		err |= clSetKernelArg(kernel, 7, sizeof(cl_mem), &triangleMaterialsBuffer);
+		err |= clSetKernelArg(kernel, 8, sizeof(cl_mem), &normalsBuffer);
+		err |= clSetKernelArg(kernel, 9, sizeof(cl_mem), &bvhBuffer);
+		err |= clSetKernelArg(kernel, 10, sizeof(cl_mem), &materialsBuffer);
+		err |= clSetKernelArg(kernel, 11, sizeof(Vector4f), &CameraPos);
+		err |= clSetKernelArg(kernel, 12, sizeof(Vector4f), &CameraDir);
+		err |= clSetKernelArg(kernel, 13, sizeof(float), &fov);
+		err |= clSetKernelArg(kernel, 14, sizeof(int), &Samples);
+
+		// The per pixel sample counts are only bound in adaptive mode
+		if (adaptive)
+			pixelSamplesBuffer = OpenCLUtils::create_device_buffer(context, static_cast<size_t>(Width) * Height * sizeof(cl_uint));
+		err |= clSetKernelArg(kernel, 19, sizeof(cl_mem), &pixelSamplesBuffer);
+		err |= clSetKernelArg(kernel, 20, sizeof(float), &adaptiveThreshold);
+
+		// The light tree is only read by programs built with LIGHT_TREE
+		if (useLightTree)
+			lightTreeBuffer = OpenCLUtils::create_input_buffer(context, lightTree.data(), lightTree.size() * sizeof(LightTreeNode));
+		err |= clSetKernelArg(kernel, 21, sizeof(cl_mem), &lightTreeBuffer);
+
+		// The top level BVH and the instances are only read by programs built with INSTANCING.
+		// A top level BVH over N instances never exceeds 2N - 1 nodes, so the rebuilt ones fit the buffer
+		if (instancing)
+		{
+			const std::vector<BVHNode>& topLevel = instancedScene.GetTopLevelNodes();
+			const std::vector<DeviceInstance>& instances = instancedScene.GetDeviceInstances();
+			topLevelBuffer = OpenCLUtils::create_device_buffer(context, std::max<size_t>(1, instances.size() * 2 - 1) * sizeof(BVHNode));
+			instancesBuffer = OpenCLUtils::create_device_buffer(context, instances.size() * sizeof(DeviceInstance));
+			err |= clEnqueueWriteBuffer(queue, topLevelBuffer, CL_TRUE, 0, topLevel.size() * sizeof(BVHNode), topLevel.data(), 0, NULL, NULL);
+			err |= clEnqueueWriteBuffer(queue, instancesBuffer, CL_TRUE, 0, instances.size() * sizeof(DeviceInstance), instances.data(), 0, NULL, NULL);
+		}
+		err |= clSetKernelArg(kernel, 22, sizeof(cl_mem), &topLevelBuffer);
+		err |= clSetKernelArg(kernel, 23, sizeof(cl_mem), &instancesBuffer);
 		if (err < 0)
 		{
-			perror("Couldn't read the buffer");
+			perror("Couldn't create a kernel argument");
 			return false;
 		}
 
-		clFinish(queue);
+		if (useWavefront)
+		{
+			wavefront = std::make_unique<WavefrontRenderer>(context, program, Width, Height, CpuTracer::MaxBounces);
+			if (!wavefront->IsValid() ||
+				!wavefront->SetScene(lightsBuffer, lightsCount, trianglesBuffer, triangleMaterialsBuffer, normalsBuffer, bvhBuffer, materialsBuffer, lightTreeBuffer, topLevelBuffer, instancesBuffer, sceneBounds) ||
+				!wavefront->SetCamera(CameraPos, CameraDir, fov))
+			{
+				return -1;
+			}
+			wavefront->SetRayReordering(commandLine.Has("reorder-rays"));
+			std::cout << "Execution: wavefront" << (wavefront->IsRayReordering() ? " with ray reordering" : "") << std::endl;
+		}
 
-		const double gpuBufferTime_ms = gpuBufferReadTimer.Elapsed_ms();
+		// The wavefront kernels render whole frames in place of the trace kernel
+		FrameRenderer::DispatchFunction wavefrontDispatch;
+		if (wavefront)
+		{
+			wavefrontDispatch = [&](cl_mem image, cl_mem accumulation, int accumulatedSamples, cl_mem rayCounter, OpenCLProfiler* frameProfiler, cl_event* event)
+			{
+				return wavefront->Render(queue, image, Samples, accumulation, accumulatedSamples, rayCounter, frameProfiler, event);
+			};
+		}
 
-		// Visualization logic
-		drawTimer.Start();
+		TraceKernelArguments frameArguments;
+		frameArguments.mImage = 0;
+		frameArguments.mRayCounter = 15;
+		frameArguments.mAccumulation = 16;
+		frameArguments.mAccumulatedSamples = 17;
+		frameArguments.mWorkCounter = 18;
+		if (!frameRenderer.Initialize(context, device, queue, kernel, frameArguments, kernelVariant.mPersistentThreads, wavefrontDispatch))
+			return -1;
+	}
 
-		cv::cvtColor(outputImg, outputImg, cv::COLOR_RGBA2BGRA);
-		cv::imshow(winName, outputImg);
+	const auto renderFrame = [&](bool countRays, uint64_t& secondaryRays) -> bool
+	{
+		return frameRenderer.RenderFrame(countRays, secondaryRays);
+	};
 
-		// Press 'ESC' to exit
-		if (cv::waitKey(1) == 27)
+	if (commandLine.Has("benchmark"))
+	{
+		BenchmarkResult result;
+		result.mScene = "Mesh Tracing";
+		result.mBackend = ToString(backend);
+		if (backend == RenderBackend::OpenCL)
+			result.mBackend += " " + kernelVariant.GetName();
+		if (adaptive)
+			result.mBackend += " adaptive";
+		if (useLightTree)
+			result.mBackend += " light-tree";
+		result.mWidth = Width;
+		result.mHeight = Height;
+		result.mSamples = Samples;
+		result.mMaxBounces = CpuTracer::MaxBounces;
+		result.mBVHBuildTime_ms = bvhBuildTime_ms;
+
+		// The wavefront run is compared against the megakernel on the same scene
+		frameRenderer.SetDispatchEnabled(false);
+
+		const Benchmark benchmark(ParseBenchmarkSettings(commandLine));
+		if (!benchmark.Run(result, renderFrame, &profiler))
+			return -1;
+
+		profiler.PrintSummary();
+		bool success = benchmark.Report(result);
+
+		BenchmarkResult wavefrontResult = result;
+		if (wavefront)
 		{
-			break;
+			// Ray reordering is compared against the unsorted wavefront run
+			const bool reorderRays = wavefront->IsRayReordering();
+			wavefront->SetRayReordering(false);
+
+			frameRenderer.SetDispatchEnabled(true);
+			wavefrontResult.mBackend += " wavefront";
+
+			if (!benchmark.Run(wavefrontResult, renderFrame, &profiler))
+				return -1;
+
+			profiler.PrintSummary();
+			success &= benchmark.Report(wavefrontResult);
+			Benchmark::PrintSpeedup(result, wavefrontResult);
+
+			if (reorderRays)
+			{
+				BenchmarkResult reorderedResult = wavefrontResult;
+				reorderedResult.mBackend += " reordered";
+				wavefront->SetRayReordering(true);
+	
+				if (!benchmark.Run(reorderedResult, renderFrame, &profiler))
+					return -1;
+
+				profiler.PrintSummary();
+				success &= benchmark.Report(reorderedResult);
+				Benchmark::PrintSpeedup(wavefrontResult, reorderedResult);
+				wavefrontResult = reorderedResult;
+			}
 		}
 
-		const double drawTime_ms = drawTimer.Elapsed_ms();
+		if (!frameRenderer.RunPipelinedBenchmark(benchmark, wavefrontResult, success))
+			return -1;
 
-		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms) << std::endl;
-		deltaTime_s = static_cast<float>(gpuBufferTime_ms + drawTime_ms) * 0.01f; // Convert back to seconds
+		// Time until the image reaches --target-error against a uniformly sampled reference, uniform versus adaptive sampling
+		if (adaptive && frameRenderer.GetAccumulationBuffer())
+		{
+			frameRenderer.SetDispatchEnabled(false);
+
+			const float targetError = std::max(1e-5f, commandLine.GetFloat("target-error", 0.01f));
+
+			// The runs share the first samples of the reference, which underestimates their error by about sqrt(1 - n / reference samples)
+			const int referenceSamples = std::max(Samples, commandLine.GetInt("reference-samples", 1024));
+
+			const auto setAdaptive = [&](bool enabled) -> bool
+			{
+				const cl_mem buffer = enabled ? pixelSamplesBuffer : nullptr;
+				err = clSetKernelArg(kernel, 19, sizeof(cl_mem), &buffer);
+				if (err < 0)
+				{
+					perror("Couldn't bind the pixel sample counts");
+					return false;
+				}
+				return true;
+			};
+
+			// Mean luminance per pixel of the accumulated samples
+			std::vector<Vector4f> totals(static_cast<size_t>(Width) * Height);
+			std::vector<cl_uint> pixelSamples(totals.size());
+			const auto readLuminance = [&](bool perPixelSamples, std::vector<float>& luminance) -> bool
+			{
+				err = clEnqueueReadBuffer(queue, frameRenderer.GetAccumulationBuffer(), CL_TRUE, 0, totals.size() * sizeof(Vector4f), totals.data(), 0, NULL, NULL);
+				if (perPixelSamples)
+					err |= clEnqueueReadBuffer(queue, pixelSamplesBuffer, CL_TRUE, 0, pixelSamples.size() * sizeof(cl_uint), pixelSamples.data(), 0, NULL, NULL);
+				if (err < 0)
+				{
+					perror("Couldn't read the accumulation");
+					return false;
+				}
+
+				luminance.resize(totals.size());
+				for (size_t i = 0; i < totals.size(); ++i)
+				{
+					const int samples = perPixelSamples ? static_cast<int>(pixelSamples[i]) : frameRenderer.GetAccumulatedSamples();
+					const Vector4f& total = totals[i];
+					luminance[i] = samples > 0 ? (0.2126f * total.x + 0.7152f * total.y + 0.0722f * total.z) / samples : 0.0f;
+				}
+				return true;
+			};
+
+			uint64_t secondaryRays = 0;
+			std::vector<float> reference;
+			std::vector<float> luminance;
+
+			if (!setAdaptive(false))
+				return -1;
+
+			frameRenderer.RestartAccumulation();
+			while (frameRenderer.GetAccumulatedSamples() < referenceSamples)
+			{
+				if (!renderFrame(false, secondaryRays))
+					return -1;
+			}
+			if (!readLuminance(false, reference))
+				return -1;
+
+			const auto timeToError = [&](bool adaptiveSampling, double& time_ms, int& frames) -> bool
+			{
+				if (!setAdaptive(adaptiveSampling))
+					return false;
+
+				frameRenderer.RestartAccumulation();
+				time_ms = 0.0;
+				for (frames = 0; frames * Samples < referenceSamples;)
+				{
+					Timer frameTimer(true);
+					if (!renderFrame(false, secondaryRays))
+						return false;
+					time_ms += frameTimer.Stop_ms();
+					++frames;
+
+					if (!readLuminance(adaptiveSampling, luminance))
+						return false;
+
+					double squaredError = 0.0;
+					for (size_t i = 0; i < luminance.size(); ++i)
+						squaredError += static_cast<double>(luminance[i] - reference[i]) * (luminance[i] - reference[i]);
+
+					if (std::sqrt(squaredError / luminance.size()) <= targetError)
+						break;
+				}
+				return true;
+			};
+
+			double uniformTime_ms = 0.0;
+			double adaptiveTime_ms = 0.0;
+			int uniformFrames = 0;
+			int adaptiveFrames = 0;
+			if (!timeToError(false, uniformTime_ms, uniformFrames) || !timeToError(true, adaptiveTime_ms, adaptiveFrames))
+				return -1;
+
+			std::cout << "Time to RMSE " << std::to_string(targetError) << " (reference " << referenceSamples << " spp)"
+					  << "\tUniform: " << std::to_string(uniformTime_ms) << " ms, " << uniformFrames << " frames"
+					  << "\tAdaptive: " << std::to_string(adaptiveTime_ms) << " ms, " << adaptiveFrames << " frames"
+					  << "\tSpeedup: " << std::to_string(uniformTime_ms / std::max(adaptiveTime_ms, 1e-6)) << "x" << std::endl;
+		}
+		return success ? 0 : 1;
 	}
-}
\ No newline at end of file
+
+	FrameLoopCallbacks callbacks;
+	callbacks.mUpdate = [&](SceneChangeTracker& sceneChanges, float deltaTime_s)
+	{
+		// Animated copies turn in place in alternating directions, which only rebuilds and uploads the top level BVH
+		if (animateInstances)
+		{
+			instanceAngle += deltaTime_s;
+			for (size_t i = 0; i < instancePlacements.size(); ++i)
+				instancedScene.SetTransform(static_cast<int>(i), instancePlacements[i] * Matrix4f::RotationY((i / 2) % 2 == 0 ? instanceAngle : -instanceAngle));
+			instancedScene.BuildTopLevel();
+			sceneChanges.Mark(SceneChange::Geometry);
+		}
+
+		// Deformed meshes keep the BVH topology and only refit its bounds, until the sampled SAH cost degraded past the threshold
+		if (deform)
+		{
+			deformTime += deltaTime_s;
+			DeformVertices(Geometry, restVertices, deformTime);
+
+			if (++framesSinceQualityCheck >= bvhQualityInterval)
+			{
+				framesSinceQualityCheck = 0;
+
+				Timer refitTimer(true);
+				RefitBVH(bvh, Geometry);
+				const double refitTime_ms = refitTimer.Stop_ms();
+
+				if (bvhQuality.OnRefit(ComputeTriangleRelativeSAHCost(bvh, Geometry, bvhSettings)))
+				{
+					std::cout << "BVH Relative SAH Cost: " << bvhQuality.GetCost() << " (" << std::to_string(bvhQuality.GetDegradation()) << "x of the build after "
+							  << bvhQuality.GetRefitCount() << " refits)\tRefit Time: " << std::to_string(refitTime_ms) << "\tRebuilding" << std::endl;
+
+					Timer rebuildTimer(true);
+					ConstructBVH(bvh, Geometry, bvhSettings, &buildPool);
+					ReportBVH(bvh, bvhSettings, rebuildTimer.Stop_ms());
+
+					bvhQuality.OnBuild(ComputeTriangleRelativeSAHCost(bvh, Geometry, bvhSettings));
+					bvhRebuilt = true;
+				}
+			}
+
+			BuildDeviceGeometry(Geometry, deviceGeometry);
+			sceneChanges.Mark(SceneChange::Geometry);
+		}
+
+		// Hashing the mesh every frame would cost more than it saves, edits of the geometry and BVH have to be marked explicitly
+		sceneChanges.Track(SceneChange::Lights, Lights);
+		sceneChanges.Track(SceneChange::Materials, Materials);
+	};
+
+	// Uploads the scene state changed since the last rendered frame, the scene buffers keep their size
+	callbacks.mUpload = [&](const SceneChangeTracker& sceneChanges) -> bool
+	{
+		err = CL_SUCCESS;
+		if (sceneChanges.IsDirty(SceneChange::Camera))
+		{
+			err |= clSetKernelArg(kernel, 11, sizeof(Vector4f), &CameraPos);
+			err |= clSetKernelArg(kernel, 12, sizeof(Vector4f), &CameraDir);
+			if (wavefront && !wavefront->SetCamera(CameraPos, CameraDir, fov))
+				return false;
+		}
+		if (sceneChanges.IsDirty(SceneChange::Lights))
+		{
+			err |= clEnqueueWriteBuffer(queue, lightsBuffer, CL_FALSE, 0, Lights.size() * sizeof(Vector4f), Lights.data(), 0, NULL, profiler.Track("Write Lights"));
+
+			// Moved lights change the bounds of the tree, the light count and so the node count stay the same
+			if (lightTreeBuffer)
+			{
+				ConstructLightTree(lightTree, Lights);
+				err |= clEnqueueWriteBuffer(queue, lightTreeBuffer, CL_FALSE, 0, lightTree.size() * sizeof(LightTreeNode), lightTree.data(), 0, NULL, profiler.Track("Write Light Tree"));
+			}
+		}
+		if (sceneChanges.IsDirty(SceneChange::Geometry) && instancing)
+		{
+			// Moved instances only upload the rebuilt top level, the meshes and their bottom levels stay resident.
+			// The writes block, the next BuildTopLevel rewrites the host vectors while pipelined frames are still in flight
+			const std::vector<BVHNode>& topLevel = instancedScene.GetTopLevelNodes();
+			const std::vector<DeviceInstance>& instances = instancedScene.GetDeviceInstances();
+			if (GetTraversalStackSize(ComputeBVHDepth(topLevel), 2) > bvhStackSize)
+			{
+				std::cout << "The rebuilt top level BVH exceeds the traversal stack of " << bvhStackSize << " entries" << std::endl;
+				return false;
+			}
+			err |= clEnqueueWriteBuffer(queue, topLevelBuffer, CL_TRUE, 0, topLevel.size() * sizeof(BVHNode), topLevel.data(), 0, NULL, profiler.Track("Write Top Level BVH"));
+			err |= clEnqueueWriteBuffer(queue, instancesBuffer, CL_TRUE, 0, instances.size() * sizeof(DeviceInstance), instances.data(), 0, NULL, profiler.Track("Write Instances"));
+		}
+		if (sceneChanges.IsDirty(SceneChange::Geometry) && deform)
+		{
+			// The deformed triangles are written in place, the device refits the nodes to them unless the host rebuilt the BVH.
+			// The writes block, the next frame deforms and rebuilds the host vectors while pipelined frames are still in flight
+			err |= clEnqueueWriteBuffer(queue, trianglesBuffer, CL_TRUE, 0, deviceGeometry.triangles.size() * sizeof(TriangleAccel), deviceGeometry.triangles.data(), 0, NULL, profiler.Track("Write Triangles"));
+			if (bvhRebuilt)
+			{
+				// A rebuild reorders the triangles with their materials and changes the topology
+				if (GetTraversalStackSize(ComputeBVHDepth(bvh), 2) > bvhStackSize)
+				{
+					std::cout << "The rebuilt BVH exceeds the traversal stack of " << bvhStackSize << " entries" << std::endl;
+					return false;
+				}
+				err |= clEnqueueWriteBuffer(queue, triangleMaterialsBuffer, CL_TRUE, 0, deviceGeometry.materials.size() * sizeof(int), deviceGeometry.materials.data(), 0, NULL, profiler.Track("Write Triangle Materials"));
+				err |= clEnqueueWriteBuffer(queue, bvhBuffer, CL_TRUE, 0, bvh.size() * sizeof(BVHNode), bvh.data(), 0, NULL, profiler.Track("Write BVH"));
+				if (!bvhRefitter->SetTopology(queue, bvh))
+					return false;
+				bvhRebuilt = false;
+			}
+			else if (!bvhRefitter->Refit(queue, bvhBuffer, trianglesBuffer, &profiler))
+			{
+				return false;
+			}
+		}
+		if (sceneChanges.IsDirty(SceneChange::Materials))
+			err |= clEnqueueWriteBuffer(queue, materialsBuffer, CL_FALSE, 0, Materials.size() * sizeof(Material), Materials.data(), 0, NULL, profiler.Track("Write Materials"));
+		if (err < 0)
+		{
+			perror("Couldn't upload the scene changes");
+			return false;
+		}
+		return true;
+	};
+
+	callbacks.mMoveCamera = [&](const Float3& movement)
+	{
+		CameraPos.x += movement.x;
+		CameraPos.y += movement.y;
+		CameraPos.z += movement.z;
+	};
+
+	return frameRenderer.Run("Mesh Tracing", callbacks) ? 0 : -1;
+}
@@ -0,0 +1,201 @@
+#include "CommandLine.h"
+#include "RandomUtils.h"
+#include "RayPacket.h"
+#include "Timer.h"
+
+#include <cfloat>
+#include <iostream>
+#include <string>
+#include <vector>
+
+Float3 RandomPoint(float extent)
+{
+	return { RandUtils::RandomRange<float>(-extent, extent),
+			 RandUtils::RandomRange<float>(-extent, extent),
+			 RandUtils::RandomRange<float>(-extent, extent) };
+}
+
+/// <summary>
+/// Generates packets of rays from a camera region towards the primitive volume, so a share of the tests hit.
+/// </summary>
+void GenerateRays(int packetCount, std::vector<RayPacket>& packets)
+{
+	packets.resize(packetCount);
+	for (RayPacket& packet : packets)
+	{
+		for (int lane = 0; lane < kRayPacketWidth; ++lane)
+		{
+			const Float3 origin = Float3(0.0f, 0.0f, 20.0f) + RandomPoint(2.0f);
+			const Float3 target = RandomPoint(5.0f);
+			packet.SetRay(lane, origin, CpuMath::Normalize(target - origin));
+		}
+	}
+}
+
+void GenerateTriangles(int count, std::vector<PacketTriangle>& triangles)
+{
+	triangles.resize(count);
+	for (PacketTriangle& tri : triangles)
+	{
+		tri.mVertex0 = RandomPoint(5.0f);
+		tri.mEdge1 = RandomPoint(1.5f);
+		tri.mEdge2 = RandomPoint(1.5f);
+	}
+}
+
+void GenerateSpheres(int count, std::vector<PacketSphere>& spheres)
+{
+	spheres.resize(count);
+	for (PacketSphere& sphere : spheres)
+	{
+		sphere.mCenter = RandomPoint(5.0f);
+		sphere.mRadius = RandUtils::RandomRange<float>(0.1f, 0.75f);
+	}
+}
+
+void GenerateBoxes(int count, std::vector<PacketBox>& boxes)
+{
+	boxes.resize(count);
+	for (PacketBox& box : boxes)
+	{
+		const Float3 center = RandomPoint(5.0f);
+		const Float3 extent(RandUtils::RandomRange<float>(0.1f, 1.0f),
+							RandUtils::RandomRange<float>(0.1f, 1.0f),
+							RandUtils::RandomRange<float>(0.1f, 1.0f));
+		box.mMin = center - extent;
+		box.mMax = center + extent;
+	}
+}
+
+/// <summary>
+/// Runs the intersection over every packet and returns the best time of the passed iterations.
+/// </summary>
+template<typename Func>
+double MeasureBest_ms(int iterations, const Func& func)
+{
+	double best_ms = DBL_MAX;
+	for (int iteration = 0; iteration < iterations; ++iteration)
+	{
+		Timer timer(true);
+		func();
+		best_ms = std::min(best_ms, timer.Stop_ms());
+	}
+	return best_ms;
+}
+
+int CountHitMismatches(const std::vector<PacketHit>& expected, const std::vector<PacketHit>& actual)
+{
+	int mismatches = 0;
+	for (size_t p = 0; p < expected.size(); ++p)
+	{
+		for (int lane = 0; lane < kRayPacketWidth; ++lane)
+		{
+			const bool samePrimitive = expected[p].mPrimitive[lane] == actual[p].mPrimitive[lane];
+			const bool sameDistance = std::abs(expected[p].mT[lane] - actual[p].mT[lane]) <= 1e-3f * std::max(1.0f, expected[p].mT[lane]);
+			if (!samePrimitive || !sameDistance)
+				++mismatches;
+		}
+	}
+	return mismatches;
+}
+
+void Report(const std::string& name, size_t tests, double scalar_ms, double packet_ms, int mismatches)
+{
+	std::cout << name
+			  << "\tScalar: " << std::to_string(tests / (scalar_ms * 1000.0)) << " MTests/s"
+			  << "\tPacket: " << std::to_string(tests / (packet_ms * 1000.0)) << " MTests/s"
+			  << "\tSpeedup: " << std::to_string(scalar_ms / packet_ms)
+			  << "\tMismatches: " << mismatches << std::endl;
+}
+
+template<typename Primitive, typename Func>
+void BenchmarkHits(const std::string& name,
+				   const std::vector<RayPacket>& packets,
+				   const std::vector<Primitive>& primitives,
+				   int iterations,
+				   const Func& scalarFunc,
+				   const Func& packetFunc)
+{
+	std::vector<PacketHit> scalarHits(packets.size());
+	std::vector<PacketHit> packetHits(packets.size());
+
+	const auto run = [&](const Func& func, std::vector<PacketHit>& hits)
+	{
+		for (size_t p = 0; p < packets.size(); ++p)
+		{
+			hits[p].Reset();
+			func(packets[p], primitives.data(), static_cast<int>(primitives.size()), hits[p]);
+		}
+	};
+
+	const double scalar_ms = MeasureBest_ms(iterations, [&]() { run(scalarFunc, scalarHits); });
+	const double packet_ms = MeasureBest_ms(iterations, [&]() { run(packetFunc, packetHits); });
+
+	const size_t tests = packets.size() * kRayPacketWidth * primitives.size();
+	Report(name, tests, scalar_ms, packet_ms, CountHitMismatches(scalarHits, packetHits));
+}
+
+void BenchmarkBoxes(const std::vector<RayPacket>& packets, const std::vector<PacketBox>& boxes, int iterations)
+{
+	PacketHit hit;
+	hit.Reset();
+
+	std::vector<uint8_t> scalarMasks(packets.size() * boxes.size());
+	std::vector<uint8_t> packetMasks(packets.size() * boxes.size());
+
+	const auto run = [&](auto func, std::vector<uint8_t>& masks)
+	{
+		for (size_t p = 0; p < packets.size(); ++p)
+			func(packets[p], boxes.data(), static_cast<int>(boxes.size()), hit, masks.data() + p * boxes.size());
+	};
+
+	const double scalar_ms = MeasureBest_ms(iterations, [&]() { run(RayPacketMath::Scalar::IntersectBoxes, scalarMasks); });
+	const double packet_ms = MeasureBest_ms(iterations, [&]() { run(RayPacketMath::IntersectBoxes, packetMasks); });
+
+	int mismatches = 0;
+	for (size_t i = 0; i < scalarMasks.size(); ++i)
+		mismatches += scalarMasks[i] != packetMasks[i] ? 1 : 0;
+
+	Report("Ray-AABB", packets.size() * kRayPacketWidth * boxes.size(), scalar_ms, packet_ms, mismatches);
+}
+
+int main(int argc, char** argv)
+{
+	CommandLine commandLine(argc, argv);
+
+	const int rayCount = std::max(kRayPacketWidth, commandLine.GetInt("rays", 1 << 16));
+	const int primitiveCount = std::max(1, commandLine.GetInt("primitives", 64));
+	const int iterations = std::max(1, commandLine.GetInt("iterations", 5));
+
+	RandUtils::SeedRandom(static_cast<uint32_t>(commandLine.GetInt("seed", 1)));
+
+	std::vector<RayPacket> packets;
+	GenerateRays(rayCount / kRayPacketWidth, packets);
+
+	std::vector<PacketTriangle> triangles;
+	GenerateTriangles(primitiveCount, triangles);
+
+	std::vector<PacketSphere> spheres;
+	GenerateSpheres(primitiveCount, spheres);
+
+	std::vector<PacketBox> boxes;
+	GenerateBoxes(primitiveCount, boxes);
+
+	std::cout << "Instruction Set: " << RayPacketMath::GetInstructionSet()
+			  << "\tRays: " << packets.size() * kRayPacketWidth
+			  << "\tPrimitives: " << primitiveCount
+			  << "\tIterations: " << iterations << std::endl;
+
+	using TriangleFunc = int(*)(const RayPacket&, const PacketTriangle*, int, PacketHit&);
+	BenchmarkHits<PacketTriangle, TriangleFunc>("Ray-Triangle", packets, triangles, iterations,
+												RayPacketMath::Scalar::IntersectTriangles,
+												RayPacketMath::IntersectTriangles);
+
+	using SphereFunc = int(*)(const RayPacket&, const PacketSphere*, int, PacketHit&);
+	BenchmarkHits<PacketSphere, SphereFunc>("Ray-Sphere", packets, spheres, iterations,
+											RayPacketMath::Scalar::IntersectSpheres,
+											RayPacketMath::IntersectSpheres);
+
+	BenchmarkBoxes(packets, boxes, iterations);
+	return 0;
+}
@@ -0,0 +1,31 @@
+@echo off
+rem Runs the sphere, triangle and mesh scene benchmarks at a fixed resolution and collects the results in Benchmarks\results.csv
+rem Every scene runs with the generic and the specialized kernel variant, each with the serialized and the pipelined loop,
+rem and the specialized variant once more with persistent threads.
+rem Usage: Win-RunBenchmarks.bat [baseline.csv]
+rem Passing the results.csv of a previous run fails the script when a scene regressed by more than 5%.
+
+set BASELINE=
+if not "%~1"=="" set BASELINE=--baseline "%~f1"
+
+pushd ..
+set BINARIES=%CD%\Binaries\windows-Release-x86_64
+set RESULTS=%CD%\Benchmarks\results.csv
+
+if not exist Benchmarks mkdir Benchmarks
+if exist "%RESULTS%" del "%RESULTS%"
+
+set FAILED=0
+for %%P in (SphereTracing TriangleTracing MeshTracing) do (
+	pushd %%P
+	for %%V in (generic specialized) do (
+		"%BINARIES%\%%P\%%P.exe" --benchmark --kernel-variant %%V --pipeline 2 --width 1280 --height 720 --samples 1 --warmup 5 --runs 30 --benchmark-output "%RESULTS%" %BASELINE%
+		if errorlevel 1 set FAILED=1
+	)
+	"%BINARIES%\%%P\%%P.exe" --benchmark --kernel-variant specialized --persistent-threads --pipeline 2 --width 1280 --height 720 --samples 1 --warmup 5 --runs 30 --benchmark-output "%RESULTS%" %BASELINE%
+	if errorlevel 1 set FAILED=1
+	popd
+)
+popd
+
+exit /b %FAILED%
@@ -1,7 +1,16 @@
+#include "Benchmark.h"
+#include "CommandLine.h"
+#include "CpuMath.h"
+#include "FrameRenderer.h"
+#include "KernelVariant.h"
+#include "OpenCLProfiler.h"
 #include "OpenCLUtils.h"
 #include "OpenCVUtils.h"
+#include "PixelFormat.h"
 #include "RandomUtils.h"
-#include "Timer.h"
+#include "RenderBackend.h"
+#include "RenderSettings.h"
+#include "SceneChangeTracker.h"
 
 cl_device_id device = nullptr;
 cl_context context = nullptr;
@@ -10,6 +19,9 @@ cl_kernel kernel = nullptr;
 cl_command_queue queue = nullptr;
 cl_int err = -1;
 
+// Bounces per ray of the trace kernel (MAX_BOUNCES) and the CPU backend
+constexpr int MaxBounces = 2;
+
 struct Vector2f
 {
 public:
@@ -58,15 +70,170 @@ public:
 	float pad2 = 0;
 };
 
-int main()
+inline Float3 ToFloat3(const Vector4f& v)
+{
+	return { v.x, v.y, v.z };
+}
+
+bool RaySphereIntersect(const Float3& rayOrigin,
+						const Float3& rayDir,
+						const Float3& sphereCenter,
+						float sphereRadius,
+						float& t)
+{
+	const Float3 oc = rayOrigin - sphereCenter;
+	const float a = CpuMath::Dot(rayDir, rayDir);
+	const float b = 2.0f * CpuMath::Dot(oc, rayDir);
+	const float c = CpuMath::Dot(oc, oc) - sphereRadius * sphereRadius;
+	const float discriminant = b * b - 4 * a * c;
+
+	if (discriminant >= 0)
+	{
+		const float sqrt_d = std::sqrt(discriminant);
+		const float t1 = (-b - sqrt_d) / (2.0f * a);
+		const float t2 = (-b + sqrt_d) / (2.0f * a);
+		t = t1 > 0 ? t1 : t2; // Use the closest valid intersection
+		return t > 0;
+	}
+	return false;
+}
+
+/// <summary>
+/// Native port of the any-hit shadow query of the trace kernel.
+/// </summary>
+bool Occluded(const Float3& rayOrigin, const Float3& rayDir, float tMax, const std::vector<Sphere>& spheres)
+{
+	for (const Sphere& sphere : spheres)
+	{
+		float tIntersect = 0;
+		if (RaySphereIntersect(rayOrigin, rayDir, ToFloat3(sphere.position), sphere.radius, tIntersect) && tIntersect < tMax)
+			return true;
+	}
+	return false;
+}
+
+/// <summary>
+/// Native port of the trace kernel for a single ray through the image position (px, py).
+/// The lights are shadow tested like the SHADOWS kernel variant when shadows is set.
+/// The secondary ray count is incremented when passed.
+/// </summary>
+Float3 TracePixel(float px, float py, int width, int height,
+				  const std::vector<Vector4f>& lights,
+				  const std::vector<Sphere>& spheres,
+				  const Vector4f& cameraPos,
+				  const Vector4f& cameraDir,
+				  float fov,
+				  bool shadows,
+				  int* secondaryRays = nullptr)
+{
+	Float3 rayOrigin = ToFloat3(cameraPos);
+	Float3 rayDirection = CpuMath::CameraRayDirection(px, py, width, height, fov, ToFloat3(cameraDir));
+
+	Float3 color(0.0f, 0.0f, 0.0f);
+	const Float3 skyColorTop(0.757f, 0.965f, 1.0f);
+	const Float3 skyColorBottom(0.0f, 0.0f, 0.0f);
+
+	// Energy carried by the ray
+	Float3 throughput(1.0f, 1.0f, 1.0f);
+
+	for (int b = 0; b < MaxBounces; ++b)
+	{
+		// Every bounce after the primary ray traces a secondary ray
+		if (b > 0 && secondaryRays)
+			++(*secondaryRays);
+
+		float tMin = 1e20f;
+		int hitSphereIndex = -1;
+
+		Float3 hitNormal;
+		Float3 hitPoint;
+
+		for (int i = 0; i < static_cast<int>(spheres.size()); ++i)
+		{
+			const Float3 sphereCenter = ToFloat3(spheres[i].position);
+
+			float tIntersect = 0;
+			if (RaySphereIntersect(rayOrigin, rayDirection, sphereCenter, spheres[i].radius, tIntersect))
+			{
+				if (tIntersect > 0.0f && tIntersect < tMin)
+				{
+					tMin = tIntersect;
+					hitSphereIndex = i;
+
+					hitPoint = rayOrigin + tMin * rayDirection;
+					hitNormal = CpuMath::Normalize(hitPoint - sphereCenter);
+				}
+			}
+		}
+
+		// No intersection
+		if (hitSphereIndex == -1)
+		{
+			const float a = std::clamp(0.5f * (rayDirection.y + 1.0f), 0.0f, 1.0f);
+			color += throughput * CpuMath::Mix(skyColorBottom, skyColorTop, a);
+			break;
+		}
+
+		const Sphere& sphere = spheres[hitSphereIndex];
+		const Float3 sphereColor = ToFloat3(sphere.color);
+
+		// Accumulate color from lights (basic Phong shading)
+		Float3 directLight(0.0f, 0.0f, 0.0f);
+		for (const Vector4f& light : lights)
+		{
+			const Float3 lightDir = CpuMath::Normalize(ToFloat3(light) - hitPoint);
+			const float lightIntensity = std::max(CpuMath::Dot(hitNormal, lightDir), 0.0f);
+
+			// Lights behind the surface are self-shadowed and need no shadow ray
+			if (shadows && (lightIntensity <= 0.0f ||
+				Occluded(hitPoint + 0.001f * hitNormal, lightDir, CpuMath::Length(ToFloat3(light) - hitPoint) - 0.001f, spheres)))
+				continue;
+
+			directLight += lightIntensity * Float3(1.0f, 1.0f, 1.0f); // White light
+		}
+
+		Float3 reflectedColor(0.0f, 0.0f, 0.0f);
+		if (sphere.reflectivity > 0.0f)
+		{
+			rayDirection = CpuMath::Reflect(rayDirection, hitNormal);
+			rayOrigin = hitPoint + 0.001f * hitNormal;
+
+			reflectedColor = throughput * sphereColor;
+		}
+
+		// Blend colors based on reflectivity
+		const Float3 diffuseColor = sphereColor * directLight;
+		color += throughput * CpuMath::Mix(diffuseColor, reflectedColor, sphere.reflectivity);
+
+		// Scale throughput by remaining reflectivity
+		throughput *= sphere.reflectivity;
+
+		// If throughput becomes negligible, terminate early
+		if (CpuMath::Length(throughput) < 0.001f)
+			break;
+	}
+	return color;
+}
+
+int main(int argc, char** argv)
 {
-	const int Width		= 1280;
-	const int Height	= 720;
+	CommandLine commandLine(argc, argv);
+	const RenderBackend backend = SelectRenderBackend(commandLine);
+	std::cout << "Backend: " << ToString(backend) << std::endl;
+
+	RenderSettings defaultSettings;
+	defaultSettings.mCameraPosition = { 0.0f, 0.0f, 10.0f };
+	defaultSettings.mCameraDirection = { 0.0f, 0.0f, -1.0f };
+	const RenderSettings renderSettings = ParseRenderSettings(commandLine, defaultSettings);
+
+	const int Width		= renderSettings.mWidth;
+	const int Height	= renderSettings.mHeight;
+	const int Samples	= renderSettings.mSamples;
 
 	// Camera setup
-	Vector4f CameraPos(0.0f, 0.0f, 10.0f, 0.0f);
-	Vector4f CameraDir(0.0f, 0.0f, -1.0f, 0.0f);
-	float fov = 60.0f;
+	Vector4f CameraPos(renderSettings.mCameraPosition.x, renderSettings.mCameraPosition.y, renderSettings.mCameraPosition.z, 0.0f);
+	Vector4f CameraDir(renderSettings.mCameraDirection.x, renderSettings.mCameraDirection.y, renderSettings.mCameraDirection.z, 0.0f);
+	float fov = renderSettings.mFov;
 
 	std::vector<Sphere> Spheres;
 
@@ -98,108 +265,144 @@ int main()
 	std::vector<Vector4f> Lights;
 	Lights.emplace_back(Vector4f(2.0f, 2.0f, -3.0f, 1.0f));
 
-	if (!OpenCLUtils::initialize_device_and_context(device, context))
-		return -1;
-
-	if (!OpenCLUtils::initialize_program("shaders/tracing.cl", "trace", context, device, program, kernel, queue))
+	// The kernels write the format OpenCV presents directly, the CPU backend writes RGBA8
+	const PixelFormat outputFormat = backend == RenderBackend::OpenCL ? ParsePixelFormat(commandLine, PixelFormat::BGRA8) : PixelFormat::RGBA8;
+
+	cl_mem lightsBuffer = nullptr;
+	cl_mem spheresBuffer = nullptr;
+
+	// Bakes the scene counts and resolution into the kernel unless --kernel-variant generic is passed
+	KernelVariant defaultVariant;
+	defaultVariant.mMaxBounces = MaxBounces;
+	defaultVariant.mImageWidth = Width;
+	defaultVariant.mImageHeight = Height;
+	defaultVariant.mLightCount = static_cast<int>(Lights.size());
+	defaultVariant.mPrimitiveDefine = "NUM_SPHERES";
+	defaultVariant.mPrimitiveCount = static_cast<int>(Spheres.size());
+	defaultVariant.mOutputFormat = outputFormat;
+	const KernelVariant kernelVariant = ParseKernelVariant(commandLine, defaultVariant);
+
+	// --profile records the device timestamps of every command
+	OpenCLProfiler profiler(backend == RenderBackend::OpenCL && commandLine.Has("profile"));
+	const cl_command_queue_properties queueProperties = profiler.IsEnabled() ? CL_QUEUE_PROFILING_ENABLE : 0;
+
+	FrameRenderer frameRenderer(commandLine, backend, renderSettings, outputFormat, profiler);
+	frameRenderer.SetPixelFunction([&](float px, float py, int* secondaryRays)
 	{
-		assert(false);
-		return -1;
-	}
+		return TracePixel(px, py, Width, Height, Lights, Spheres, CameraPos, CameraDir, fov, kernelVariant.mShadows, secondaryRays);
+	});
 
-	cv::Mat outputImg(Height, Width, CV_8UC4, cv::Scalar(0));
-
-	const size_t imageBufferSize = Width * Height * sizeof(uint8_t) * 4;
-	cl_mem imageBuffer = OpenCLUtils::create_inout_buffer(context, outputImg.data, imageBufferSize);
-
-	int lightsCount = static_cast<int>(Lights.size());
-	cl_mem lightsBuffer = OpenCLUtils::create_input_buffer(context, Lights.data(), lightsCount * sizeof(Vector4f));
-	int spheresCount = static_cast<int>(Spheres.size());
-	cl_mem spheresBuffer = OpenCLUtils::create_input_buffer(context, Spheres.data(), spheresCount * sizeof(Sphere));
-
-	/* Create kernel arguments */
-	err = clSetKernelArg(kernel, 0, sizeof(cl_mem), &imageBuffer);
-	err |= clSetKernelArg(kernel, 1, sizeof(int), &Width);
-	err |= clSetKernelArg(kernel, 2, sizeof(int), &Height);
-	err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &lightsBuffer);
-	err |= clSetKernelArg(kernel, 4, sizeof(int), &lightsCount);
-	err |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &spheresBuffer);
-	err |= clSetKernelArg(kernel, 6, sizeof(int), &spheresCount);
-	err |= clSetKernelArg(kernel, 7, sizeof(Vector4f), &CameraPos);
-	err |= clSetKernelArg(kernel, 8, sizeof(Vector4f), &CameraDir);
-	err |= clSetKernelArg(kernel, 9, sizeof(float), &fov);
-	if (err < 0)
+	if (backend == RenderBackend::OpenCL)
 	{
-		perror("Couldn't create a kernel argument");
-		return false;
-	}
-
-	size_t global[2] = { Width, Height };
+		if (!OpenCLUtils::initialize_device_and_context(device, context))
+			return -1;
 
-	const std::string winName = "Sphere Tracing";
-	cv::namedWindow(winName, cv::WINDOW_AUTOSIZE);
-	cv::imshow(winName, outputImg);
+		OpenCLUtils::set_program_cache_directory(commandLine.Has("no-kernel-cache") ? "" : commandLine.GetString("kernel-cache", "shader_cache"));
 
-	Timer gpuBufferReadTimer;
-	Timer drawTimer;
-
-	float deltaTime_s = 0.01f;
-	while (true)
-	{
-		gpuBufferReadTimer.Start();
-
-		err = clEnqueueNDRangeKernel(queue,
-									 kernel,
-									 2,
-									 NULL,
-									 (const size_t*)&global,
-									 NULL,
-									 0,
-									 NULL,
-									 NULL);
-
-		if (err < 0)
+		std::cout << "Kernel Variant: " << kernelVariant.GetName() << std::endl;
+		if (!OpenCLUtils::initialize_program("shaders/tracing.cl", "trace", context, device, program, kernel, queue, kernelVariant.GetBuildOptions(), queueProperties))
 		{
-			perror("Couldn't enqueue the kernel");
-			return false;
+			assert(false);
+			return -1;
 		}
 
-		///* Read the kernel's output    */
-		err = clEnqueueReadBuffer(queue,
-								  imageBuffer,
-								  CL_FALSE,
-								  0,
-								  imageBufferSize,
-								  outputImg.data,
-								  0,
-								  NULL,
-								  NULL);
-
+		int lightsCount = static_cast<int>(Lights.size());
+		lightsBuffer = OpenCLUtils::create_input_buffer(context, Lights.data(), lightsCount * sizeof(Vector4f));
+		int spheresCount = static_cast<int>(Spheres.size());
+		spheresBuffer = OpenCLUtils::create_input_buffer(context, Spheres.data(), spheresCount * sizeof(Sphere));
+
+		/* Create kernel arguments, the frame renderer binds the image, ray counter, accumulation and work counter */
+		err = clSetKernelArg(kernel, 1, sizeof(int), &Width);
+		err |= clSetKernelArg(kernel, 2, sizeof(int), &Height);
+		err |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &lightsBuffer);
+		err |= clSetKernelArg(kernel, 4, sizeof(int), &lightsCount);
+		err |= clSetKernelArg(kernel, 5, sizeof(cl_mem), &spheresBuffer);
+		err |= clSetKernelArg(kernel, 6, sizeof(int), &spheresCount);
+		err |= clSetKernelArg(kernel, 7, sizeof(Vector4f), &CameraPos);
+		err |= clSetKernelArg(kernel, 8, sizeof(Vector4f), &CameraDir);
+		err |= clSetKernelArg(kernel, 9, sizeof(float), &fov);
+		err |= clSetKernelArg(kernel, 10, sizeof(int), &Samples);
 		if (err < 0)
 		{
-			perror("Couldn't read the buffer");
+			perror("Couldn't create a kernel argument");
 			return false;
 		}
 
-		clFinish(queue);
+		TraceKernelArguments frameArguments;
+		frameArguments.mImage = 0;
+		frameArguments.mRayCounter = 11;
+		frameArguments.mAccumulation = 12;
+		frameArguments.mAccumulatedSamples = 13;
+		frameArguments.mWorkCounter = 14;
+		if (!frameRenderer.Initialize(context, device, queue, kernel, frameArguments, kernelVariant.mPersistentThreads))
+			return -1;
+	}
+
+	const auto renderFrame = [&](bool countRays, uint64_t& secondaryRays) -> bool
+	{
+		return frameRenderer.RenderFrame(countRays, secondaryRays);
+	};
 
-		const double gpuBufferTime_ms = gpuBufferReadTimer.Elapsed_ms();
+	if (commandLine.Has("benchmark"))
+	{
+		BenchmarkResult result;
+		result.mScene = "Sphere Tracing";
+		result.mBackend = ToString(backend);
+		if (backend == RenderBackend::OpenCL)
+			result.mBackend += " " + kernelVariant.GetName();
+		result.mWidth = Width;
+		result.mHeight = Height;
+		result.mSamples = Samples;
+		result.mMaxBounces = MaxBounces;
+
+		const Benchmark benchmark(ParseBenchmarkSettings(commandLine));
+		if (!benchmark.Run(result, renderFrame, &profiler))
+			return -1;
+
+		profiler.PrintSummary();
+		bool success = benchmark.Report(result);
+
+		if (!frameRenderer.RunPipelinedBenchmark(benchmark, result, success))
+			return -1;
+		return success ? 0 : 1;
+	}
 
-		// Visualization logic
-		drawTimer.Start();
+	FrameLoopCallbacks callbacks;
 
-		cv::cvtColor(outputImg, outputImg, cv::COLOR_RGBA2BGRA);
-		cv::imshow(winName, outputImg);
+	// Spheres carry their material, so material edits are tracked as geometry
+	callbacks.mUpdate = [&](SceneChangeTracker& sceneChanges, float /*deltaTime_s*/)
+	{
+		sceneChanges.Track(SceneChange::Lights, Lights);
+		sceneChanges.Track(SceneChange::Geometry, Spheres);
+	};
 
-		// Press 'ESC' to exit
-		if (cv::waitKey(1) == 27)
+	// Uploads the scene state changed since the last rendered frame, the scene buffers keep their size
+	callbacks.mUpload = [&](const SceneChangeTracker& sceneChanges) -> bool
+	{
+		err = CL_SUCCESS;
+		if (sceneChanges.IsDirty(SceneChange::Camera))
 		{
-			break;
+			err |= clSetKernelArg(kernel, 7, sizeof(Vector4f), &CameraPos);
+			err |= clSetKernelArg(kernel, 8, sizeof(Vector4f), &CameraDir);
+		}
+		if (sceneChanges.IsDirty(SceneChange::Lights))
+			err |= clEnqueueWriteBuffer(queue, lightsBuffer, CL_FALSE, 0, Lights.size() * sizeof(Vector4f), Lights.data(), 0, NULL, profiler.Track("Write Lights"));
+		if (sceneChanges.IsDirty(SceneChange::Geometry))
+			err |= clEnqueueWriteBuffer(queue, spheresBuffer, CL_FALSE, 0, Spheres.size() * sizeof(Sphere), Spheres.data(), 0, NULL, profiler.Track("Write Spheres"));
+		if (err < 0)
+		{
+			perror("Couldn't upload the scene changes");
+			return false;
 		}
+		return true;
+	};
 
-		const double drawTime_ms = drawTimer.Elapsed_ms();
+	callbacks.mMoveCamera = [&](const Float3& movement)
+	{
+		CameraPos.x += movement.x;
+		CameraPos.y += movement.y;
+		CameraPos.z += movement.z;
+	};
 
-		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms) << std::endl;
-		deltaTime_s = static_cast<float>(gpuBufferTime_ms + drawTime_ms) * 0.01f; // Convert back to seconds
-	}
-}
\ No newline at end of file
+	return frameRenderer.Run("Sphere Tracing", callbacks) ? 0 : -1;
+}
@@ -38,6 +38,9 @@ project "TriangleTracing"
 	
 	filter "system:windows"
 		systemversion "latest"
+		-- Delay load OpenCL so the CPU backend runs on machines without an OpenCL runtime
+		linkoptions { "/DELAYLOAD:OpenCL.dll" }
+		links { "delayimp" }
 	filter "configurations:Debug"
 		symbols "On"
 	filter "configurations:Release"
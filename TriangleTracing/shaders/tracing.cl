@@ -1,4 +1,29 @@
+#ifndef EPSILON
 #define EPSILON 0.001f
+#endif
+
+// Bounces per ray, always passed by the host so the CPU backend traces the same paths
+#ifndef MAX_BOUNCES
+#define MAX_BOUNCES 2
+#endif
+
+// Pixel format of the image, see PixelFormat.h
+#define OUTPUT_RGBA8 0
+#define OUTPUT_BGRA8 1
+#define OUTPUT_RGBA16F 2
+#define OUTPUT_RGBA32F 3
+
+#ifndef OUTPUT_FORMAT
+#define OUTPUT_FORMAT OUTPUT_RGBA8
+#endif
+
+#if OUTPUT_FORMAT == OUTPUT_RGBA16F
+#define OUTPUT_PIXEL half
+#elif OUTPUT_FORMAT == OUTPUT_RGBA32F
+#define OUTPUT_PIXEL float4
+#else
+#define OUTPUT_PIXEL uchar4
+#endif
 
 typedef struct
 {
@@ -53,42 +78,90 @@ bool ray_triangle_intersect(float3 ray_origin,
     return *t > 1e-6;
 }
 
+// Any-hit query for shadow rays, returns at the first triangle in front of t_max
+// without searching for the closest hit or computing its normal and material
+bool occluded(float3 ray_origin,
+              float3 ray_dir,
+              float t_max,
+              const __global Triangle* triangles,
+              int num_triangles)
+{
+    for (int i = 0; i < num_triangles; i++)
+    {
+        float t_intersect = 0;
+        if (ray_triangle_intersect(ray_origin, ray_dir, triangles[i], &t_intersect) && t_intersect < t_max)
+            return true;
+    }
+    return false;
+}
+
 float3 reflect(float3 I, float3 N) 
 {
     return I - 2.0f * dot(I, N) * N;
 }
 
-__kernel void trace(__global uchar4* image,
-                    int width,
-                    int height,
-                    const __global float4* lights,
-                    int num_lights,
-                    const __global Triangle* triangles,
-                    int num_triangles,
-                    const __global Material* materials,
-                    float4 camera_pos,
-                    float4 camera_dir,
-                    float fov) 
+uint hash_uint(uint x)
 {
-    int x = get_global_id(0);
-    int y = get_global_id(1);
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
 
-    if (x >= width || y >= height) 
-        return;
-    
-    if (get_global_id(0) == 0)
-    {
-        // Example debug output to confirm num_lights value
-        //printf("Num Lights: %d\n", num_lights);
-        //printf("Num Triangles: %d\n", num_triangles);
+uint sample_seed(uint pixel_index, uint sample_index)
+{
+    return pixel_index ^ hash_uint(sample_index);
+}
 
-        //printf("Camera: (%f, %f, %f)   %f\n", camera_pos.x, camera_pos.y, camera_pos.z, fov);
+int sample_stride(int samples)
+{
+    // Smallest stride from samples / golden ratio on that is coprime to the sample count
+    int stride = max(1, (int)(samples * 0.618034f + 0.5f));
+    for (;;)
+    {
+        int a = stride;
+        int b = samples;
+        while (b != 0)
+        {
+            int t = a % b;
+            a = b;
+            b = t;
+        }
+        if (a == 1)
+            return stride;
+        ++stride;
     }
+}
+
+float2 sample_offset(int sample, int samples, uint seed, bool accumulate)
+{
+    // A single sample of a frame that isn't accumulated stays at the pixel centre, like the unstratified image
+    if (samples == 1 && !accumulate)
+        return (float2)(0.5f, 0.5f);
 
+    // Jittered N-rooks sub pixel position. Sample s is placed randomly within column s and row (s * stride) % samples
+    // of a samples x samples grid. The coprime stride permutes the rows, so every column and row holds exactly one sample
+    // for any sample count, and strides near samples / golden ratio spread the samples like a Fibonacci lattice
+    int row = (int)(((long)sample * sample_stride(samples)) % samples);
+    uint hash = hash_uint(seed);
+    float2 jitter = (float2)((hash & 0xFFFF) / 65536.0f, (hash >> 16) / 65536.0f);
+    return (float2)((sample + jitter.x) / samples, (row + jitter.y) / samples);
+}
+
+Ray camera_ray(float x,
+               float y,
+               int width,
+               int height,
+               float4 camera_pos,
+               float4 camera_dir,
+               float fov)
+{
     // Compute normalized screen coordinates
     float aspect_ratio = (float)width / height;
-    float px = (2.0f * ((x + 0.5f) / width) - 1.0f) * tan(radians(fov) / 2.0f) * aspect_ratio;
-    float py = (1.0f - 2.0f * ((y + 0.5f) / height)) * tan(radians(fov) / 2.0f);
+    float px = (2.0f * (x / width) - 1.0f) * tan(radians(fov) / 2.0f) * aspect_ratio;
+    float py = (1.0f - 2.0f * (y / height)) * tan(radians(fov) / 2.0f);
 
     Ray ray;
 
@@ -98,7 +171,17 @@ __kernel void trace(__global uchar4* image,
     // Initialize ray
     ray.origin = camera_pos.xyz;
     ray.direction = normalize(camera_dir.xyz + ray.direction);
+    return ray;
+}
 
+float3 trace_ray(Ray ray,
+                 const __global float4* lights,
+                 int num_lights,
+                 const __global Triangle* triangles,
+                 int num_triangles,
+                 const __global Material* materials,
+                 int* secondary_rays)
+{
     // Initialize color
     float3 color = (float3)(0.0f, 0.0f, 0.0f);
     float3 sky_color_top = (float3)(0.757f, 0.965f, 1.0f);
@@ -107,9 +190,13 @@ __kernel void trace(__global uchar4* image,
     // Energy carried by the ray
     float3 throughput = (float3)(1.0f, 1.0f, 1.0f);
 
-    const int max_bounces = 2;
+    const int max_bounces = MAX_BOUNCES;
     for (int b = 0; b < max_bounces; ++b)
     {
+        // Every bounce after the primary ray traces a secondary ray
+        if (b > 0)
+            ++(*secondary_rays);
+
         // Trace ray for sphere intersections
         float t_min = 1e20f;
         int hit_idx = -1;
@@ -167,6 +254,13 @@ __kernel void trace(__global uchar4* image,
         
             float3 light_dir = normalize(light_pos - hit_point);
             float light_intensity = fmax(dot(hit_normal, light_dir), 0.0f);
+
+#ifdef SHADOWS
+            // Lights behind the surface are self-shadowed and need no shadow ray
+            float light_distance = length(light_pos - hit_point);
+            if (light_intensity <= 0.0f || occluded(hit_point + hit_normal * 1e-4f, light_dir, light_distance - 1e-4f, triangles, num_triangles))
+                continue;
+#endif
         
             float3 view_dir = normalize(ray.origin - hit_point);
             float3 reflect_dir = normalize(reflect(-light_dir, hit_normal));
@@ -201,10 +295,76 @@ __kernel void trace(__global uchar4* image,
         }
     }
 
-    // Write to image
-    image[y * width + x] = (uchar4)((uchar)(clamp(color.x, 0.0f, 1.0f) * 255),
-                                    (uchar)(clamp(color.y, 0.0f, 1.0f) * 255),
-                                    (uchar)(clamp(color.z, 0.0f, 1.0f) * 255), 255);
+    return color;
+}
+
+void store_pixel(__global OUTPUT_PIXEL* image, int index, float3 color)
+{
+#if OUTPUT_FORMAT == OUTPUT_RGBA16F
+    vstore_half4((float4)(color, 1.0f), index, image);
+#elif OUTPUT_FORMAT == OUTPUT_RGBA32F
+    image[index] = (float4)(color, 1.0f);
+#else
+    uchar r = (uchar)(clamp(color.x, 0.0f, 1.0f) * 255);
+    uchar g = (uchar)(clamp(color.y, 0.0f, 1.0f) * 255);
+    uchar b = (uchar)(clamp(color.z, 0.0f, 1.0f) * 255);
+#if OUTPUT_FORMAT == OUTPUT_BGRA8
+    image[index] = (uchar4)(b, g, r, 255);
+#else
+    image[index] = (uchar4)(r, g, b, 255);
+#endif
+#endif
+}
+
+// Traces the samples of the pixel and writes its running average
+void trace_pixel(int x,
+                 int y,
+                 __global OUTPUT_PIXEL* image,
+                 int width,
+                 int height,
+                 const __global float4* lights,
+                 int num_lights,
+                 const __global Triangle* triangles,
+                 int num_triangles,
+                 const __global Material* materials,
+                 float4 camera_pos,
+                 float4 camera_dir,
+                 float fov,
+                 int samples,
+                 __global uint* ray_counts,
+                 __global float4* accumulation,
+                 int accumulated_samples)
+{
+    // Sum the jittered stratified samples of the pixel
+    uint pixel_index = y * width + x;
+    float3 color = (float3)(0.0f, 0.0f, 0.0f);
+    int secondary_rays = 0;
+    for (int s = 0; s < samples; ++s)
+    {
+        float2 offset = sample_offset(s, samples, sample_seed(pixel_index, accumulated_samples + s), accumulation != 0);
+        Ray ray = camera_ray(x + offset.x, y + offset.y, width, height, camera_pos, camera_dir, fov);
+        color += trace_ray(ray, lights, num_lights, triangles, num_triangles, materials, &secondary_rays);
+    }
+
+    // Progressive accumulation adds the samples to the previous frames and shows the running average
+    if (accumulation)
+    {
+        float4 total = accumulated_samples > 0 ? accumulation[pixel_index] : (float4)(0.0f);
+        total.xyz += color;
+        accumulation[pixel_index] = total;
+        color = total.xyz / (float)(accumulated_samples + samples);
+    }
+    else
+    {
+        color /= (float)samples;
+    }
+
+    // Ray statistics are only gathered when a counter is bound, e.g. for benchmarking
+    if (ray_counts)
+        atomic_add(ray_counts, (uint)secondary_rays);
+
+    // Write to image in the format of the consumer
+    store_pixel(image, pixel_index, color);
 
     // Write to image
     //image[y * width + x] = (uchar4)((uchar)(255),
@@ -212,3 +372,74 @@ __kernel void trace(__global uchar4* image,
     //                                (uchar)(0), 
     //                                255);
 }
+
+__kernel void trace(__global OUTPUT_PIXEL* image,
+                    int width,
+                    int height,
+                    const __global float4* lights,
+                    int num_lights,
+                    const __global Triangle* triangles,
+                    int num_triangles,
+                    const __global Material* materials,
+                    float4 camera_pos,
+                    float4 camera_dir,
+                    float fov,
+                    int samples,
+                    __global uint* ray_counts,
+                    __global float4* accumulation,
+                    int accumulated_samples,
+                    __global uint* work_counter) 
+{
+    // Specialized variants replace the arguments by compile-time constants, so the loops over them can be unrolled
+#ifdef IMAGE_WIDTH
+    width = IMAGE_WIDTH;
+    height = IMAGE_HEIGHT;
+#endif
+#ifdef NUM_LIGHTS
+    num_lights = NUM_LIGHTS;
+#endif
+#ifdef NUM_TRIANGLES
+    num_triangles = NUM_TRIANGLES;
+#endif
+
+#ifdef PERSISTENT_THREADS
+    // Only enough work-groups to fill the device are launched. They pull batches of consecutive pixels from the
+    // work counter until the image is done, so groups that finished cheap sky pixels take over the remaining ones
+    // instead of idling next to groups tracing expensive reflective pixels
+    __local uint batch_start;
+    uint pixel_count = width * height;
+    for (;;)
+    {
+        if (get_local_id(0) == 0)
+            batch_start = atomic_add(work_counter, (uint)get_local_size(0));
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Every work item reads the batch before the next one is fetched, so the whole group leaves together
+        uint batch = batch_start;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        if (batch >= pixel_count)
+            return;
+
+        uint pixel_index = batch + get_local_id(0);
+        if (pixel_index < pixel_count)
+            trace_pixel(pixel_index % width, pixel_index / width, image, width, height, lights, num_lights, triangles, num_triangles, materials, camera_pos, camera_dir, fov, samples, ray_counts, accumulation, accumulated_samples);
+    }
+#else
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+
+    if (x >= width || y >= height) 
+        return;
+    
+    if (get_global_id(0) == 0)
+    {
+        // Example debug output to confirm num_lights value
+        //printf("Num Lights: %d\n", num_lights);
+        //printf("Num Triangles: %d\n", num_triangles);
+
+        //printf("Camera: (%f, %f, %f)   %f\n", camera_pos.x, camera_pos.y, camera_pos.z, fov);
+    }
+
+    trace_pixel(x, y, image, width, height, lights, num_lights, triangles, num_triangles, materials, camera_pos, camera_dir, fov, samples, ray_counts, accumulation, accumulated_samples);
+#endif
+}
@@ -35,6 +35,8 @@ project "Utils"
 	
 	filter "system:windows"
 		systemversion "latest"
+	filter "options:avx2"
+		vectorextensions "AVX2"
 	filter "configurations:Debug"
 		symbols "On"
 	filter "configurations:Release"
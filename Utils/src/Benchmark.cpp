@@ -0,0 +1,367 @@
+#include "Benchmark.h"
+
+#include "OpenCLProfiler.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	bool HasExtension(const std::string& path, const std::string& extension)
+	{
+		return path.size() >= extension.size() && path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+	}
+
+	/// <summary>
+	/// Escapes the text for a JSON string or CSV cell, the names written here never contain quotes or separators.
+	/// </summary>
+	std::string Quote(const std::string& text)
+	{
+		return "\"" + text + "\"";
+	}
+
+	/// <summary>
+	/// Parses a median frame time of the baseline, reporting malformed values instead of throwing.
+	/// </summary>
+	bool ParseMedian(const std::string& text, const std::string& path, double& median_ms)
+	{
+		try
+		{
+			median_ms = std::stod(text);
+			return true;
+		}
+		catch (const std::exception&)
+		{
+			std::cout << "Malformed baseline median '" << text << "' in " << path << std::endl;
+			return false;
+		}
+	}
+
+	/// <summary>
+	/// Finds the raw value of the key in a flat JSON object, strings without their quotes.
+	/// </summary>
+	bool FindJSONValue(const std::string& object, const std::string& key, std::string& value)
+	{
+		const std::string quotedKey = Quote(key) + ":";
+		size_t position = object.find(quotedKey);
+		if (position == std::string::npos)
+			return false;
+
+		position = object.find_first_not_of(" \t\r\n", position + quotedKey.size());
+		if (position == std::string::npos)
+			return false;
+
+		if (object[position] == '"')
+		{
+			const size_t end = object.find('"', position + 1);
+			if (end == std::string::npos)
+				return false;
+			value = object.substr(position + 1, end - position - 1);
+			return true;
+		}
+
+		const size_t end = object.find_first_of(",}\r\n", position);
+		value = object.substr(position, end == std::string::npos ? std::string::npos : end - position);
+		return true;
+	}
+
+	/// <summary>
+	/// Reads the median frame time of the result's configuration from a result file written by Benchmark::Report.
+	/// Only records of the same scene, backend, resolution, sample and bounce count match, found is cleared if there is none.
+	/// </summary>
+	bool ReadBaselineMedian(const std::string& path, const BenchmarkResult& result, bool& found, double& median_ms)
+	{
+		found = false;
+		std::ifstream file(path);
+		if (!file.is_open())
+			return false;
+
+		const std::string width = std::to_string(result.mWidth);
+		const std::string height = std::to_string(result.mHeight);
+		const std::string samples = std::to_string(result.mSamples);
+		const std::string maxBounces = std::to_string(result.mMaxBounces);
+
+		// The last matching record is the most recent run
+		std::string median;
+		if (HasExtension(path, ".csv"))
+		{
+			std::string header;
+			std::getline(file, header);
+
+			// The scene, backend and median columns are written first, the width, height, samples and max bounces follow the frame times
+			std::string line;
+			while (std::getline(file, line))
+			{
+				std::vector<std::string> cells;
+				std::stringstream stream(line);
+				std::string cell;
+				while (std::getline(stream, cell, ','))
+				{
+					cell.erase(std::remove(cell.begin(), cell.end(), '"'), cell.end());
+					cells.push_back(cell);
+				}
+
+				if (cells.size() > 8 && cells[0] == result.mScene && cells[1] == result.mBackend &&
+					cells[5] == width && cells[6] == height && cells[7] == samples && cells[8] == maxBounces)
+				{
+					median = cells[2];
+				}
+			}
+		}
+		else
+		{
+			std::stringstream buffer;
+			buffer << file.rdbuf();
+			const std::string json = buffer.str();
+
+			// An array of flat records, or the single record of older results
+			for (size_t start = json.find('{'); start != std::string::npos; start = json.find('{', start + 1))
+			{
+				const size_t end = json.find('}', start);
+				if (end == std::string::npos)
+					break;
+
+				const std::string object = json.substr(start, end - start + 1);
+				const auto matches = [&](const std::string& key, const std::string& expected)
+				{
+					std::string value;
+					return FindJSONValue(object, key, value) && value == expected;
+				};
+
+				std::string recordMedian;
+				if (matches("scene", result.mScene) && matches("backend", result.mBackend) &&
+					matches("width", width) && matches("height", height) &&
+					matches("samples", samples) && matches("max_bounces", maxBounces) &&
+					FindJSONValue(object, "median_ms", recordMedian))
+				{
+					median = recordMedian;
+				}
+				start = end;
+			}
+		}
+
+		if (median.empty())
+			return true;
+
+		found = true;
+		return ParseMedian(median, path, median_ms) && median_ms > 0.0;
+	}
+}
+
+BenchmarkSettings ParseBenchmarkSettings(const CommandLine& commandLine)
+{
+	BenchmarkSettings settings;
+	settings.mWarmupFrames = std::max(0, commandLine.GetInt("warmup", settings.mWarmupFrames));
+	settings.mTimedFrames = std::max(1, commandLine.GetInt("runs", settings.mTimedFrames));
+	settings.mOutputPath = commandLine.GetString("benchmark-output", settings.mOutputPath);
+	settings.mBaselinePath = commandLine.GetString("baseline", settings.mBaselinePath);
+	settings.mRegressionTolerance = commandLine.GetFloat("regression-tolerance", settings.mRegressionTolerance);
+	return settings;
+}
+
+Benchmark::Benchmark(const BenchmarkSettings& settings)
+	: mSettings(settings)
+{
+}
+
+bool Benchmark::Run(BenchmarkResult& result, const FrameFunction& func, OpenCLProfiler* profiler) const
+{
+	// The summary covers the timed frames only, not the cold warm-up frames or the instrumented ray counting frame
+	if (profiler)
+		profiler->SetSummaryEnabled(false);
+
+	uint64_t secondaryRays = 0;
+	for (int frame = 0; frame < mSettings.mWarmupFrames; ++frame)
+	{
+		if (!func(false, secondaryRays))
+			return false;
+	}
+
+	if (profiler)
+	{
+		profiler->ResetSummary();
+		profiler->SetSummaryEnabled(true);
+	}
+
+	result.mFrameTimes_ms.clear();
+	for (int frame = 0; frame < mSettings.mTimedFrames; ++frame)
+	{
+		Timer frameTimer(true);
+		if (!func(false, secondaryRays))
+			return false;
+		result.mFrameTimes_ms.push_back(frameTimer.Stop_ms());
+	}
+
+	std::vector<double> sorted = result.mFrameTimes_ms;
+	std::sort(sorted.begin(), sorted.end());
+
+	const size_t middle = sorted.size() / 2;
+	result.mMedianFrameTime_ms = sorted.size() % 2 == 0 ? 0.5 * (sorted[middle - 1] + sorted[middle]) : sorted[middle];
+	result.mMinFrameTime_ms = sorted.front();
+	result.mMaxFrameTime_ms = sorted.back();
+
+	result.mPrimaryRays = static_cast<uint64_t>(result.mWidth) * result.mHeight * result.mSamples;
+	if (profiler)
+		profiler->SetSummaryEnabled(false);
+
+	const bool counted = func(true, secondaryRays);
+	if (profiler)
+		profiler->SetSummaryEnabled(true);
+	if (!counted)
+		return false;
+	result.mSecondaryRays = secondaryRays;
+
+	// Rays per microsecond equals million rays per second
+	const double median_us = std::max(result.mMedianFrameTime_ms, 1e-6) * 1000.0;
+	result.mPrimaryMRaysPerSecond = result.mPrimaryRays / median_us;
+	result.mSecondaryMRaysPerSecond = result.mSecondaryRays / median_us;
+	return true;
+}
+
+bool Benchmark::Report(const BenchmarkResult& result) const
+{
+	std::cout << "Benchmark: " << result.mScene << " (" << result.mBackend << ")"
+			  << "\tResolution: " << result.mWidth << "x" << result.mHeight
+			  << "\tSamples: " << result.mSamples
+			  << "\tMax Bounces: " << result.mMaxBounces << std::endl;
+	std::cout << "Frame Time (ms)\tMedian: " << std::to_string(result.mMedianFrameTime_ms)
+			  << "\tMin: " << std::to_string(result.mMinFrameTime_ms)
+			  << "\tMax: " << std::to_string(result.mMaxFrameTime_ms) << std::endl;
+	std::cout << "Primary: " << std::to_string(result.mPrimaryMRaysPerSecond) << " MRays/s"
+			  << "\tSecondary: " << std::to_string(result.mSecondaryMRaysPerSecond) << " MRays/s";
+	if (result.mBVHBuildTime_ms >= 0.0)
+		std::cout << "\tBVH Build Time: " << std::to_string(result.mBVHBuildTime_ms);
+	std::cout << std::endl;
+
+	bool success = true;
+	if (!mSettings.mBaselinePath.empty())
+		success &= CompareBaseline(result);
+
+	if (!mSettings.mOutputPath.empty())
+		success &= HasExtension(mSettings.mOutputPath, ".csv") ? WriteCSV(result) : WriteJSON(result);
+	return success;
+}
+
+void Benchmark::PrintSpeedup(const BenchmarkResult& reference, const BenchmarkResult& result)
+{
+	std::cout << result.mBackend << " vs " << reference.mBackend
+			  << "\tSpeedup: " << std::to_string(reference.mMedianFrameTime_ms / std::max(result.mMedianFrameTime_ms, 1e-6)) << "x" << std::endl;
+}
+
+bool Benchmark::WriteJSON(const BenchmarkResult& result) const
+{
+	// Every report appends a record to the array, so the variants of a run and previous runs are kept
+	std::string existing;
+	{
+		std::ifstream input(mSettings.mOutputPath);
+		if (input.is_open())
+		{
+			std::stringstream buffer;
+			buffer << input.rdbuf();
+			existing = buffer.str();
+		}
+	}
+	existing.erase(existing.find_last_not_of(" \t\r\n") + 1);
+
+	std::ostringstream record;
+	record << "{"
+		   << "\"scene\": " << Quote(result.mScene) << ", "
+		   << "\"backend\": " << Quote(result.mBackend) << ", "
+		   << "\"width\": " << result.mWidth << ", "
+		   << "\"height\": " << result.mHeight << ", "
+		   << "\"samples\": " << result.mSamples << ", "
+		   << "\"max_bounces\": " << result.mMaxBounces << ", "
+		   << "\"median_ms\": " << result.mMedianFrameTime_ms << ", "
+		   << "\"min_ms\": " << result.mMinFrameTime_ms << ", "
+		   << "\"max_ms\": " << result.mMaxFrameTime_ms << ", "
+		   << "\"primary_rays\": " << result.mPrimaryRays << ", "
+		   << "\"secondary_rays\": " << result.mSecondaryRays << ", "
+		   << "\"primary_mrays_per_s\": " << result.mPrimaryMRaysPerSecond << ", "
+		   << "\"secondary_mrays_per_s\": " << result.mSecondaryMRaysPerSecond << ", "
+		   << "\"bvh_build_ms\": ";
+	if (result.mBVHBuildTime_ms >= 0.0)
+		record << result.mBVHBuildTime_ms;
+	else
+		record << "null";
+	record << ", \"frame_times_ms\": [";
+	for (size_t i = 0; i < result.mFrameTimes_ms.size(); ++i)
+		record << (i > 0 ? ", " : "") << result.mFrameTimes_ms[i];
+	record << "]}";
+
+	// Older results hold a single record instead of an array
+	std::string records;
+	if (!existing.empty() && existing.back() == ']')
+		records = existing.substr(existing.find('[') + 1, existing.size() - existing.find('[') - 2);
+	else if (!existing.empty() && existing.back() == '}')
+		records = "\n\t" + existing;
+	records.erase(records.find_last_not_of(" \t\r\n") + 1);
+
+	std::ofstream file(mSettings.mOutputPath);
+	if (!file.is_open())
+	{
+		std::cout << "Couldn't write the benchmark results to " << mSettings.mOutputPath << std::endl;
+		return false;
+	}
+
+	file << "[" << records << (records.empty() ? "" : ",") << "\n\t" << record.str() << "\n]\n";
+	return true;
+}
+
+bool Benchmark::WriteCSV(const BenchmarkResult& result) const
+{
+	const bool writeHeader = !std::ifstream(mSettings.mOutputPath).good();
+
+	std::ofstream file(mSettings.mOutputPath, std::ios::app);
+	if (!file.is_open())
+	{
+		std::cout << "Couldn't write the benchmark results to " << mSettings.mOutputPath << std::endl;
+		return false;
+	}
+
+	if (writeHeader)
+	{
+		file << "scene,backend,median_ms,min_ms,max_ms,width,height,samples,max_bounces,"
+			 << "primary_rays,secondary_rays,primary_mrays_per_s,secondary_mrays_per_s,bvh_build_ms\n";
+	}
+
+	file << Quote(result.mScene) << "," << Quote(result.mBackend) << ","
+		 << result.mMedianFrameTime_ms << "," << result.mMinFrameTime_ms << "," << result.mMaxFrameTime_ms << ","
+		 << result.mWidth << "," << result.mHeight << "," << result.mSamples << "," << result.mMaxBounces << ","
+		 << result.mPrimaryRays << "," << result.mSecondaryRays << ","
+		 << result.mPrimaryMRaysPerSecond << "," << result.mSecondaryMRaysPerSecond << ",";
+	if (result.mBVHBuildTime_ms >= 0.0)
+		file << result.mBVHBuildTime_ms;
+	file << "\n";
+	return true;
+}
+
+bool Benchmark::CompareBaseline(const BenchmarkResult& result) const
+{
+	double baseline_ms = 0.0;
+	bool found = false;
+	if (!ReadBaselineMedian(mSettings.mBaselinePath, result, found, baseline_ms))
+	{
+		std::cout << "Couldn't read a " << result.mScene << " (" << result.mBackend << ") baseline from " << mSettings.mBaselinePath << std::endl;
+		return false;
+	}
+
+	// A different resolution, sample or bounce count isn't comparable, so the comparison is skipped instead
+	if (!found)
+	{
+		std::cout << "No " << result.mScene << " (" << result.mBackend << ") baseline at " << result.mWidth << "x" << result.mHeight
+				  << ", " << result.mSamples << " samples and " << result.mMaxBounces << " bounces in " << mSettings.mBaselinePath
+				  << ", skipping the comparison" << std::endl;
+		return true;
+	}
+
+	const double change = result.mMedianFrameTime_ms / baseline_ms - 1.0;
+	const bool regressed = change > mSettings.mRegressionTolerance;
+
+	std::cout << "Baseline Median: " << std::to_string(baseline_ms)
+			  << "\tChange: " << std::to_string(change * 100.0) << "%"
+			  << (regressed ? "\tREGRESSION" : "\tOK") << std::endl;
+	return !regressed;
+}
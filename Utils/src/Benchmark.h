@@ -0,0 +1,114 @@
+#pragma once
+
+#include "CommandLine.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class OpenCLProfiler;
+
+/// <summary>
+/// Configuration of a benchmark run.
+/// </summary>
+struct BenchmarkSettings
+{
+	// Untimed frames rendered first to settle caches, clocks and lazy driver work
+	int mWarmupFrames = 3;
+	int mTimedFrames = 20;
+
+	// Result file, written as CSV for .csv paths and as a JSON array of records otherwise. Every report appends its result
+	std::string mOutputPath;
+
+	// Result file of a previous run to compare against
+	std::string mBaselinePath;
+
+	// Relative median frame time increase reported as a regression
+	float mRegressionTolerance = 0.05f;
+};
+
+/// <summary>
+/// Parses the benchmark settings from the command line.
+/// Supported arguments: --warmup, --runs, --benchmark-output, --baseline and --regression-tolerance.
+/// </summary>
+/// <param name="commandLine">The command line</param>
+/// <returns>The benchmark settings</returns>
+BenchmarkSettings ParseBenchmarkSettings(const CommandLine& commandLine);
+
+/// <summary>
+/// Statistics of a benchmark run of one scene.
+/// </summary>
+struct BenchmarkResult
+{
+	std::string mScene;
+	std::string mBackend;
+	int mWidth = 0;
+	int mHeight = 0;
+	int mSamples = 1;
+	int mMaxBounces = 0;
+
+	std::vector<double> mFrameTimes_ms;
+	double mMedianFrameTime_ms = 0.0;
+	double mMinFrameTime_ms = 0.0;
+	double mMaxFrameTime_ms = 0.0;
+
+	uint64_t mPrimaryRays = 0;
+	uint64_t mSecondaryRays = 0;
+	double mPrimaryMRaysPerSecond = 0.0;
+	double mSecondaryMRaysPerSecond = 0.0;
+
+	// Negative when the scene has no BVH
+	double mBVHBuildTime_ms = -1.0;
+};
+
+/// <summary>
+/// Runs the warm-up and timed frames of a scene and reports the frame time and ray throughput statistics.
+/// </summary>
+class Benchmark
+{
+public:
+	/// <summary>
+	/// Renders a complete frame, blocking until it finished, and returns false on failure.
+	/// When countRays is set, the frame reports the number of secondary rays it traced.
+	/// </summary>
+	using FrameFunction = std::function<bool(bool countRays, uint64_t& secondaryRays)>;
+public:
+	/// <summary>
+	/// Constructor initializing a Benchmark.
+	/// </summary>
+	/// <param name="settings">The benchmark settings</param>
+	Benchmark(const BenchmarkSettings& settings);
+public:
+	/// <summary>
+	/// Runs the benchmark. The ray counts are gathered in a separate untimed frame,
+	/// so the timed frames run without any counting overhead.
+	/// </summary>
+	/// <param name="result">The result, the scene description fields are expected to be filled in</param>
+	/// <param name="func">The frame function</param>
+	/// <param name="profiler">The optional profiler the frames end on, its summary is reset to cover only the timed frames</param>
+	/// <returns>False if a frame failed, otherwise true</returns>
+	bool Run(BenchmarkResult& result, const FrameFunction& func, OpenCLProfiler* profiler = nullptr) const;
+
+	/// <summary>
+	/// Prints the result, writes it to the output path and compares it against the baseline.
+	/// </summary>
+	/// <param name="result">The benchmark result</param>
+	/// <returns>False if writing failed or the result regressed against the baseline, otherwise true</returns>
+	bool Report(const BenchmarkResult& result) const;
+
+	/// <summary>
+	/// Prints the throughput gain of a result over a reference run of the same scene, e.g. a different render loop.
+	/// </summary>
+	/// <param name="reference">The reference result</param>
+	/// <param name="result">The compared result</param>
+	static void PrintSpeedup(const BenchmarkResult& reference, const BenchmarkResult& result);
+private:
+	bool WriteJSON(const BenchmarkResult& result) const;
+
+	bool WriteCSV(const BenchmarkResult& result) const;
+
+	bool CompareBaseline(const BenchmarkResult& result) const;
+private:
+	BenchmarkSettings mSettings;
+};
@@ -0,0 +1,76 @@
+#include "CommandLine.h"
+
+CommandLine::CommandLine(int argc, char** argv)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string argument = argv[i];
+		if (argument.rfind("--", 0) != 0)
+			continue;
+
+		argument = argument.substr(2);
+
+		// --name=value
+		const size_t separator = argument.find('=');
+		if (separator != std::string::npos)
+		{
+			mArguments[argument.substr(0, separator)] = argument.substr(separator + 1);
+			continue;
+		}
+
+		// --name value
+		if (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0)
+		{
+			mArguments[argument] = argv[++i];
+			continue;
+		}
+
+		// --name
+		mArguments[argument] = "";
+	}
+}
+
+bool CommandLine::Has(const std::string& name) const
+{
+	return mArguments.find(name) != mArguments.end();
+}
+
+std::string CommandLine::GetString(const std::string& name, const std::string& defaultValue) const
+{
+	auto it = mArguments.find(name);
+	if (it == mArguments.end())
+		return defaultValue;
+	return it->second;
+}
+
+int CommandLine::GetInt(const std::string& name, int defaultValue) const
+{
+	auto it = mArguments.find(name);
+	if (it == mArguments.end())
+		return defaultValue;
+
+	try
+	{
+		return std::stoi(it->second);
+	}
+	catch (const std::exception&)
+	{
+		return defaultValue;
+	}
+}
+
+float CommandLine::GetFloat(const std::string& name, float defaultValue) const
+{
+	auto it = mArguments.find(name);
+	if (it == mArguments.end())
+		return defaultValue;
+
+	try
+	{
+		return std::stof(it->second);
+	}
+	catch (const std::exception&)
+	{
+		return defaultValue;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+/// <summary>
+/// Simple command line argument parser.
+/// Arguments are expected in the form "--name value", "--name=value" or "--name" for flags.
+/// </summary>
+class CommandLine
+{
+public:
+	/// <summary>
+	/// Constructor parsing the passed program arguments.
+	/// </summary>
+	/// <param name="argc">The argument count</param>
+	/// <param name="argv">The argument values</param>
+	CommandLine(int argc, char** argv);
+public:
+	/// <summary>
+	/// Checks whether the argument was passed.
+	/// </summary>
+	/// <param name="name">The argument name without leading dashes</param>
+	/// <returns>True if the argument was passed, otherwise false</returns>
+	bool Has(const std::string& name) const;
+
+	/// <summary>
+	/// Retrieves the argument value as a string.
+	/// </summary>
+	/// <param name="name">The argument name without leading dashes</param>
+	/// <param name="defaultValue">The value returned when the argument was not passed</param>
+	/// <returns>The argument value</returns>
+	std::string GetString(const std::string& name, const std::string& defaultValue = "") const;
+
+	/// <summary>
+	/// Retrieves the argument value as an integer.
+	/// </summary>
+	/// <param name="name">The argument name without leading dashes</param>
+	/// <param name="defaultValue">The value returned when the argument was not passed or is invalid</param>
+	/// <returns>The argument value</returns>
+	int GetInt(const std::string& name, int defaultValue) const;
+
+	/// <summary>
+	/// Retrieves the argument value as a float.
+	/// </summary>
+	/// <param name="name">The argument name without leading dashes</param>
+	/// <param name="defaultValue">The value returned when the argument was not passed or is invalid</param>
+	/// <returns>The argument value</returns>
+	float GetFloat(const std::string& name, float defaultValue) const;
+private:
+	std::unordered_map<std::string, std::string> mArguments;
+};
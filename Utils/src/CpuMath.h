@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+
+/// <summary>
+/// Host equivalent of the OpenCL float3 used by the native rendering backend.
+/// </summary>
+struct Float3
+{
+public:
+	Float3() = default;
+
+	Float3(float _x, float _y, float _z)
+		: x(_x),
+		y(_y),
+		z(_z)
+	{
+	}
+public:
+	inline Float3 operator-() const { return { -x, -y, -z }; }
+
+	inline Float3 operator+(const Float3& other) const { return { x + other.x, y + other.y, z + other.z }; }
+	inline Float3 operator-(const Float3& other) const { return { x - other.x, y - other.y, z - other.z }; }
+	inline Float3 operator*(const Float3& other) const { return { x * other.x, y * other.y, z * other.z }; }
+	inline Float3 operator*(float scalar) const { return { x * scalar, y * scalar, z * scalar }; }
+	inline Float3 operator/(float scalar) const { return { x / scalar, y / scalar, z / scalar }; }
+
+	inline Float3& operator+=(const Float3& other) { x += other.x; y += other.y; z += other.z; return *this; }
+	inline Float3& operator*=(const Float3& other) { x *= other.x; y *= other.y; z *= other.z; return *this; }
+	inline Float3& operator*=(float scalar) { x *= scalar; y *= scalar; z *= scalar; return *this; }
+
+	inline float operator[](int index) const { return index == 0 ? x : (index == 1 ? y : z); }
+public:
+	float x = 0;
+	float y = 0;
+	float z = 0;
+};
+
+inline Float3 operator*(float scalar, const Float3& v) { return v * scalar; }
+
+namespace CpuMath
+{
+	inline float Dot(const Float3& a, const Float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+	inline Float3 Cross(const Float3& a, const Float3& b)
+	{
+		return { a.y * b.z - a.z * b.y,
+				 a.z * b.x - a.x * b.z,
+				 a.x * b.y - a.y * b.x };
+	}
+
+	inline float Length(const Float3& v) { return std::sqrt(Dot(v, v)); }
+
+	inline Float3 Normalize(const Float3& v) { return v / Length(v); }
+
+	inline Float3 Reflect(const Float3& I, const Float3& N) { return I - 2.0f * Dot(I, N) * N; }
+
+	inline Float3 Min(const Float3& a, const Float3& b) { return { std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z) }; }
+
+	inline Float3 Max(const Float3& a, const Float3& b) { return { std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z) }; }
+
+	inline Float3 Mix(const Float3& a, const Float3& b, float t) { return a + (b - a) * t; }
+
+	inline float Radians(float degrees) { return degrees * 0.017453292519943295f; }
+
+	/// <summary>
+	/// Computes the primary ray direction through a continuous pixel position, 
+	/// matching the camera model of the trace kernels.
+	/// </summary>
+	/// <param name="px">The horizontal pixel position, pixel centers are at x + 0.5</param>
+	/// <param name="py">The vertical pixel position, pixel centers are at y + 0.5</param>
+	/// <param name="width">The image width</param>
+	/// <param name="height">The image height</param>
+	/// <param name="fov">The vertical field of view in degrees</param>
+	/// <param name="cameraDir">The camera direction</param>
+	/// <returns>The normalized ray direction</returns>
+	inline Float3 CameraRayDirection(float px, float py, int width, int height, float fov, const Float3& cameraDir)
+	{
+		const float aspectRatio = static_cast<float>(width) / height;
+		const float tanHalfFov = std::tan(Radians(fov) / 2.0f);
+		const float sx = (2.0f * (px / width) - 1.0f) * tanHalfFov * aspectRatio;
+		const float sy = (1.0f - 2.0f * (py / height)) * tanHalfFov;
+
+		return Normalize(cameraDir + Normalize(Float3(sx, sy, -1.0f)));
+	}
+
+	/// <summary>
+	/// Integer hash matching hash_uint of the trace kernels.
+	/// </summary>
+	/// <param name="x">The value to hash</param>
+	/// <returns>The hashed value</returns>
+	inline uint32_t HashUint(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352dU;
+		x ^= x >> 15;
+		x *= 0x846ca68bU;
+		x ^= x >> 16;
+		return x;
+	}
+
+	/// <summary>
+	/// Computes the random seed of a pixel sample, matching sample_seed of the trace kernels.
+	/// </summary>
+	/// <param name="pixelIndex">The pixel index y * width + x</param>
+	/// <param name="sampleIndex">The sample index since the accumulation started</param>
+	/// <returns>The sample seed</returns>
+	inline uint32_t SampleSeed(uint32_t pixelIndex, uint32_t sampleIndex)
+	{
+		return pixelIndex ^ HashUint(sampleIndex);
+	}
+
+	/// <summary>
+	/// Computes the row stride of the N-rooks sample pattern, matching sample_stride of the trace kernels.
+	/// </summary>
+	/// <param name="samples">The samples per pixel of the frame</param>
+	/// <returns>The smallest stride from samples / golden ratio on that is coprime to the sample count</returns>
+	inline int SampleStride(int samples)
+	{
+		int stride = std::max(1, static_cast<int>(samples * 0.618034f + 0.5f));
+		while (std::gcd(stride, samples) != 1)
+			++stride;
+		return stride;
+	}
+
+	/// <summary>
+	/// Computes the jittered stratified sub pixel position of a sample, matching sample_offset of the trace kernels.
+	/// The pixel is split into samples x samples cells and sample s is placed at a random position within the cell in column s
+	/// and row (s * stride) % samples. Every column and row holds exactly one sample for any sample count.
+	/// A single sample of a frame that isn't accumulated stays at the pixel centre.
+	/// </summary>
+	/// <param name="sample">The sample index within the frame</param>
+	/// <param name="samples">The samples per pixel of the frame</param>
+	/// <param name="seed">The random seed of the sample</param>
+	/// <param name="accumulate">Whether the sample is added to the progressive accumulation</param>
+	/// <param name="dx">The output horizontal offset in [0, 1)</param>
+	/// <param name="dy">The output vertical offset in [0, 1)</param>
+	inline void StratifiedOffset(int sample, int samples, uint32_t seed, bool accumulate, float& dx, float& dy)
+	{
+		if (samples == 1 && !accumulate)
+		{
+			dx = dy = 0.5f;
+			return;
+		}
+
+		const int row = static_cast<int>((static_cast<int64_t>(sample) * SampleStride(samples)) % samples);
+		const uint32_t hash = HashUint(seed);
+		dx = (sample + (hash & 0xFFFF) / 65536.0f) / samples;
+		dy = (row + (hash >> 16) / 65536.0f) / samples;
+	}
+
+	/// <summary>
+	/// Writes the color into a uchar4 RGBA image, clamped like the trace kernels.
+	/// </summary>
+	/// <param name="image">The image data</param>
+	/// <param name="width">The image width</param>
+	/// <param name="x">The pixel x coordinate</param>
+	/// <param name="y">The pixel y coordinate</param>
+	/// <param name="color">The color to store</param>
+	inline void StorePixel(uint8_t* image, int width, int x, int y, const Float3& color)
+	{
+		uint8_t* pixel = image + (static_cast<size_t>(y) * width + x) * 4;
+		pixel[0] = static_cast<uint8_t>(std::clamp(color.x, 0.0f, 1.0f) * 255);
+		pixel[1] = static_cast<uint8_t>(std::clamp(color.y, 0.0f, 1.0f) * 255);
+		pixel[2] = static_cast<uint8_t>(std::clamp(color.z, 0.0f, 1.0f) * 255);
+		pixel[3] = 255;
+	}
+}
@@ -0,0 +1,59 @@
+#include "CpuRenderer.h"
+
+#include <algorithm>
+
+CpuRenderer::CpuRenderer(uint32_t threadCount, int tileSize)
+	: mPool(threadCount),
+	mTileSize(std::max(1, tileSize))
+{
+}
+
+void CpuRenderer::Render(int width, int height, const TileFunction& func)
+{
+	for (int y0 = 0; y0 < height; y0 += mTileSize)
+	{
+		for (int x0 = 0; x0 < width; x0 += mTileSize)
+		{
+			const int x1 = std::min(width, x0 + mTileSize);
+			const int y1 = std::min(height, y0 + mTileSize);
+			mPool.Submit([&func, x0, y0, x1, y1]()
+			{
+				func(x0, y0, x1, y1);
+			});
+		}
+	}
+	mPool.Wait();
+}
+
+void CpuRenderer::RenderImage(int width, int height, int samples, const PixelFunction& func, uint8_t* image,
+							  Float3* accumulation, int accumulatedSamples)
+{
+	Render(width, height, [&](int x0, int y0, int x1, int y1)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			for (int x = x0; x < x1; ++x)
+			{
+				const uint32_t pixelIndex = static_cast<uint32_t>(y * width + x);
+
+				Float3 color(0.0f, 0.0f, 0.0f);
+				for (int sample = 0; sample < samples; ++sample)
+				{
+					float dx, dy;
+					CpuMath::StratifiedOffset(sample, samples, CpuMath::SampleSeed(pixelIndex, accumulatedSamples + sample), accumulation != nullptr, dx, dy);
+					color += func(x + dx, y + dy);
+				}
+
+				if (!accumulation)
+				{
+					CpuMath::StorePixel(image, width, x, y, color / static_cast<float>(samples));
+					continue;
+				}
+
+				Float3& total = accumulation[pixelIndex];
+				total = accumulatedSamples > 0 ? total + color : color;
+				CpuMath::StorePixel(image, width, x, y, total / static_cast<float>(accumulatedSamples + samples));
+			}
+		}
+	});
+}
\ No newline at end of file
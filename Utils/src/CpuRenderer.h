@@ -0,0 +1,64 @@
+#pragma once
+
+#include "CpuMath.h"
+#include "ThreadPool.h"
+
+#include <cstdint>
+#include <functional>
+
+/// <summary>
+/// Native multithreaded rendering backend.
+/// The frame is split into tiles that are scheduled on a work stealing thread pool,
+/// so expensive regions are picked up by whichever threads finish their tiles first.
+/// </summary>
+class CpuRenderer
+{
+public:
+	/// <summary>
+	/// Tile callback receiving the tile bounds [x0, x1) x [y0, y1).
+	/// </summary>
+	using TileFunction = std::function<void(int x0, int y0, int x1, int y1)>;
+
+	/// <summary>
+	/// Pixel callback tracing the continuous image position (px, py), pixel centers are at x + 0.5.
+	/// </summary>
+	using PixelFunction = std::function<Float3(float px, float py)>;
+public:
+	/// <summary>
+	/// Constructor initializing a CpuRenderer.
+	/// </summary>
+	/// <param name="threadCount">The render thread count, 0 uses all hardware threads</param>
+	/// <param name="tileSize">The tile edge length in pixels</param>
+	CpuRenderer(uint32_t threadCount = 0, int tileSize = 16);
+public:
+	/// <summary>
+	/// Renders every tile of the frame and returns once all tiles completed.
+	/// </summary>
+	/// <param name="width">The image width</param>
+	/// <param name="height">The image height</param>
+	/// <param name="func">The tile function</param>
+	void Render(int width, int height, const TileFunction& func);
+
+	/// <summary>
+	/// Renders the RGBA image, averaging the jittered stratified samples of every pixel like the trace kernels.
+	/// With an accumulation buffer, the samples are added to the previous frames and the image shows the running average.
+	/// </summary>
+	/// <param name="width">The image width</param>
+	/// <param name="height">The image height</param>
+	/// <param name="samples">The samples per pixel of the frame</param>
+	/// <param name="func">The pixel function</param>
+	/// <param name="image">The output image data</param>
+	/// <param name="accumulation">Optional width * height color sums of the previous frames</param>
+	/// <param name="accumulatedSamples">The samples per pixel in the accumulation buffer, 0 restarts the running average</param>
+	void RenderImage(int width, int height, int samples, const PixelFunction& func, uint8_t* image,
+					 Float3* accumulation = nullptr, int accumulatedSamples = 0);
+
+	/// <summary>
+	/// Retrieves the render thread count.
+	/// </summary>
+	/// <returns>The thread count</returns>
+	inline uint32_t GetThreadCount() const { return mPool.GetThreadCount(); }
+private:
+	ThreadPool mPool;
+	int mTileSize;
+};
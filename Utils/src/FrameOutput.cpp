@@ -0,0 +1,153 @@
+#include "FrameOutput.h"
+
+#include <cctype>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+	bool IsHDRPath(const std::string& path)
+	{
+		const size_t extension = path.find_last_of('.');
+		if (extension == std::string::npos)
+			return false;
+
+		std::string name = path.substr(extension);
+		for (char& c : name)
+			c = static_cast<char>(std::tolower(c));
+		return name == ".exr" || name == ".hdr";
+	}
+}
+
+FrameOutput::FrameOutput(const RenderSettings& settings, const std::string& windowName, PixelFormat format)
+	: mSettings(settings),
+	mWindowName(windowName),
+	mFormat(format)
+{
+	if (mSettings.mHeadless)
+	{
+		if (mSettings.mOutputPath.empty())
+			std::cout << "Headless render without --output, frames are not saved" << std::endl;
+		return;
+	}
+
+	cv::namedWindow(mWindowName, cv::WINDOW_AUTOSIZE);
+	cv::imshow(mWindowName, cv::Mat(mSettings.mHeight, mSettings.mWidth, CV_8UC4, cv::Scalar(0)));
+}
+
+bool FrameOutput::Present(const cv::Mat& image, int frameIndex)
+{
+	// Kernels writing BGRA8 skip the swizzle pass, OpenCV has no 16 bit float display or PNG support
+	const cv::Mat* bgraImage = &mBGRAImage;
+	switch (mFormat)
+	{
+		case PixelFormat::BGRA8:
+			bgraImage = &image;
+			break;
+		case PixelFormat::RGBA16F:
+			image.convertTo(mConvertedImage, CV_32FC4);
+			cv::cvtColor(mConvertedImage, mBGRAImage, cv::COLOR_RGBA2BGRA);
+			break;
+		default:
+			cv::cvtColor(image, mBGRAImage, cv::COLOR_RGBA2BGRA);
+			break;
+	}
+
+	if (!mSettings.mOutputPath.empty())
+	{
+		const std::string path = GetFramePath(frameIndex);
+
+		const cv::Mat* writtenImage = bgraImage;
+		if (bgraImage->depth() == CV_32F && !IsHDRPath(path))
+		{
+			bgraImage->convertTo(mConvertedImage, CV_8UC4, 255.0);
+			writtenImage = &mConvertedImage;
+		}
+
+		if (!cv::imwrite(path, *writtenImage))
+			std::cout << "Couldn't write the frame to " << path << std::endl;
+	}
+
+	if (mSettings.mHeadless)
+		return true;
+
+	cv::imshow(mWindowName, *bgraImage);
+
+	// Press 'ESC' to exit
+	mLastKey = cv::waitKey(1);
+	return mLastKey != 27;
+}
+
+bool FrameOutput::WaitForInput(int timeout_ms)
+{
+	if (mSettings.mHeadless)
+	{
+		mLastKey = -1;
+		return true;
+	}
+
+	mLastKey = cv::waitKey(timeout_ms);
+	return mLastKey != 27;
+}
+
+bool FrameOutput::GetCameraMovement(float step, Float3& movement) const
+{
+	movement = Float3(0.0f, 0.0f, 0.0f);
+	if (mLastKey < 0)
+		return false;
+
+	switch (std::tolower(mLastKey & 0xFF))
+	{
+		case 'w':
+			movement.z = -step;
+			return true;
+		case 's':
+			movement.z = step;
+			return true;
+		case 'a':
+			movement.x = -step;
+			return true;
+		case 'd':
+			movement.x = step;
+			return true;
+		case 'q':
+			movement.y = -step;
+			return true;
+		case 'e':
+			movement.y = step;
+			return true;
+		default:
+			return false;
+	}
+}
+
+std::string FrameOutput::GetFramePath(int frameIndex) const
+{
+	if (mSettings.mFrames == 1)
+		return mSettings.mOutputPath;
+
+	// image.png -> image_0000.png
+	const size_t extension = mSettings.mOutputPath.find_last_of('.');
+	const size_t directory = mSettings.mOutputPath.find_last_of("/\\");
+	const bool hasExtension = extension != std::string::npos && (directory == std::string::npos || extension > directory);
+
+	std::ostringstream path;
+	path << mSettings.mOutputPath.substr(0, hasExtension ? extension : std::string::npos)
+		 << "_" << std::setw(4) << std::setfill('0') << frameIndex
+		 << (hasExtension ? mSettings.mOutputPath.substr(extension) : ".png");
+	return path.str();
+}
+
+int FrameOutput::GetImageType(PixelFormat format)
+{
+	switch (format)
+	{
+		case PixelFormat::RGBA16F:
+			return CV_16FC4;
+		case PixelFormat::RGBA32F:
+			return CV_32FC4;
+		default:
+			return CV_8UC4;
+	}
+}
\ No newline at end of file
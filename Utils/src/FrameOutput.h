@@ -0,0 +1,76 @@
+#pragma once
+
+#include "CpuMath.h"
+#include "PixelFormat.h"
+#include "RenderSettings.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <string>
+
+/// <summary>
+/// Presents rendered frames, writing them to the output path and showing them 
+/// in a window unless the render is headless.
+/// </summary>
+class FrameOutput
+{
+public:
+	/// <summary>
+	/// Constructor initializing a FrameOutput, creating the window for non headless renders.
+	/// </summary>
+	/// <param name="settings">The render settings</param>
+	/// <param name="windowName">The window name</param>
+	/// <param name="format">The pixel format of the presented images</param>
+	FrameOutput(const RenderSettings& settings, const std::string& windowName, PixelFormat format = PixelFormat::RGBA8);
+public:
+	/// <summary>
+	/// Presents the frame. BGRA8 images are shown and written as they are, the other formats are converted first.
+	/// HDR images are written as floats to .exr and .hdr paths and tone clamped to 8 bits otherwise.
+	/// </summary>
+	/// <param name="image">The rendered image in the pixel format of the output</param>
+	/// <param name="frameIndex">The frame index used to number the output images</param>
+	/// <returns>False once the window was closed with 'ESC', otherwise true</returns>
+	bool Present(const cv::Mat& image, int frameIndex);
+
+	/// <summary>
+	/// Keeps the window responsive without presenting a new frame, blocking until a key is pressed or the timeout passed.
+	/// </summary>
+	/// <param name="timeout_ms">The maximum wait time</param>
+	/// <returns>False once the window was closed with 'ESC', otherwise true</returns>
+	bool WaitForInput(int timeout_ms);
+
+	/// <summary>
+	/// Retrieves the camera movement of the last key pressed, W/S move along -z/+z, A/D along -x/+x and Q/E along -y/+y.
+	/// </summary>
+	/// <param name="step">The distance moved per key press</param>
+	/// <param name="movement">The output movement</param>
+	/// <returns>True if a movement key was pressed, otherwise false</returns>
+	bool GetCameraMovement(float step, Float3& movement) const;
+
+	/// <summary>
+	/// Checks whether the frames are shown in a window.
+	/// </summary>
+	/// <returns>True if the render isn't headless, otherwise false</returns>
+	inline bool IsInteractive() const { return !mSettings.mHeadless; }
+
+	/// <summary>
+	/// Retrieves the image path of the frame.
+	/// </summary>
+	/// <param name="frameIndex">The frame index</param>
+	/// <returns>The output path, suffixed with the frame index when rendering more than one frame</returns>
+	std::string GetFramePath(int frameIndex) const;
+
+	/// <summary>
+	/// Retrieves the OpenCV image type of the pixel format.
+	/// </summary>
+	/// <param name="format">The pixel format</param>
+	/// <returns>The image type, e.g. CV_8UC4</returns>
+	static int GetImageType(PixelFormat format);
+private:
+	RenderSettings mSettings;
+	std::string mWindowName;
+	PixelFormat mFormat;
+	cv::Mat mBGRAImage;
+	cv::Mat mConvertedImage;
+	int mLastKey = -1;
+};
@@ -0,0 +1,453 @@
+#include "FrameRenderer.h"
+
+#include "FrameOutput.h"
+#include "OpenCLUtils.h"
+#include "Timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <stdio.h>
+#include <string>
+
+FrameRenderer::FrameRenderer(const CommandLine& commandLine, RenderBackend backend, const RenderSettings& settings, PixelFormat outputFormat, OpenCLProfiler& profiler)
+	: mBackend(backend),
+	mSettings(settings),
+	mOutputFormat(outputFormat),
+	mProfiler(profiler),
+	mZeroCopy(backend == RenderBackend::OpenCL && commandLine.Has("zero-copy")),
+	mOutputImage(settings.mHeight, settings.mWidth, FrameOutput::GetImageType(outputFormat), cv::Scalar(0)),
+	mDisplayImage(mOutputImage),
+	mImageBufferSize(static_cast<size_t>(settings.mWidth) * settings.mHeight * GetPixelSize(outputFormat)),
+	mTileSettings(ParseTileSettings(commandLine)),
+	mPipelineDepth(commandLine.GetInt("pipeline", 0))
+{
+	if (mBackend == RenderBackend::Cpu)
+	{
+		mCpuRenderer = std::make_unique<CpuRenderer>(static_cast<uint32_t>(std::max(0, commandLine.GetInt("threads", 0))));
+		if (mSettings.mAccumulate)
+			mCpuAccumulation.resize(static_cast<size_t>(mSettings.mWidth) * mSettings.mHeight);
+	}
+	else if (mTileSettings.mTileSize > 0)
+	{
+		mTileScheduler = std::make_unique<TileScheduler>(mSettings.mWidth, mSettings.mHeight, mTileSettings.mTileSize, mTileSettings.mOrder);
+		mTileScheduler->SetRegionOfInterest(mTileSettings.mRegionOfInterest);
+	}
+}
+
+FrameRenderer::~FrameRenderer()
+{
+	if (mImageBuffer)
+		clReleaseMemObject(mImageBuffer);
+	if (mRayCountBuffer)
+		clReleaseMemObject(mRayCountBuffer);
+	if (mAccumulationBuffer)
+		clReleaseMemObject(mAccumulationBuffer);
+}
+
+bool FrameRenderer::Initialize(cl_context context, cl_device_id device, cl_command_queue queue, cl_kernel kernel,
+							   const TraceKernelArguments& arguments, bool persistentThreads, const DispatchFunction& dispatch)
+{
+	mQueue = queue;
+	mKernel = kernel;
+	mArguments = arguments;
+	mDispatch = dispatch;
+
+	std::cout << "Output Format: " << ToString(mOutputFormat) << (mZeroCopy ? " (zero-copy)" : "") << std::endl;
+	mImageBuffer = mZeroCopy ? OpenCLUtils::create_output_buffer(context, mImageBufferSize) : OpenCLUtils::create_inout_buffer(context, mOutputImage.data, mImageBufferSize);
+
+	cl_uint rayCount = 0;
+	mRayCountBuffer = OpenCLUtils::create_inout_buffer(context, &rayCount, sizeof(cl_uint));
+
+	if (mSettings.mAccumulate)
+		mAccumulationBuffer = OpenCLUtils::create_device_buffer(context, static_cast<size_t>(mSettings.mWidth) * mSettings.mHeight * sizeof(float) * 4);
+
+	// The ray counter is only bound while counting and the work counter only by the persistent threads dispatch
+	const cl_mem noBuffer = nullptr;
+	cl_int err = clSetKernelArg(mKernel, mArguments.mImage, sizeof(cl_mem), &mImageBuffer);
+	err |= clSetKernelArg(mKernel, mArguments.mRayCounter, sizeof(cl_mem), &noBuffer);
+	err |= clSetKernelArg(mKernel, mArguments.mAccumulation, sizeof(cl_mem), &mAccumulationBuffer);
+	err |= clSetKernelArg(mKernel, mArguments.mAccumulatedSamples, sizeof(int), &mAccumulatedSamples);
+	err |= clSetKernelArg(mKernel, mArguments.mWorkCounter, sizeof(cl_mem), &noBuffer);
+	if (!mImageBuffer || !mRayCountBuffer || (mSettings.mAccumulate && !mAccumulationBuffer) || err < 0)
+	{
+		perror("Couldn't create the frame buffers");
+		return false;
+	}
+
+	if (persistentThreads)
+	{
+		mPersistentDispatch = std::make_unique<OpenCLPersistentDispatch>(context, device, mKernel, mArguments.mWorkCounter);
+		if (!mPersistentDispatch->IsValid())
+			return false;
+	}
+
+	// Persistent work-groups and frame dispatches already cover the whole image
+	if (mTileScheduler && (mPersistentDispatch || mDispatch))
+	{
+		std::cout << "Tile rendering is ignored by the " << (mPersistentDispatch ? "persistent threads" : "frame dispatch") << std::endl;
+		mTileScheduler.reset();
+	}
+	else if (mTileScheduler)
+	{
+		std::cout << "Tiles: " << mTileScheduler->GetTileCount() << " of " << mTileSettings.mTileSize << "x" << mTileSettings.mTileSize
+				  << " (" << ToString(mTileSettings.mOrder) << (mTileScheduler->HasRegionOfInterest() ? ", region of interest" : "") << ")" << std::endl;
+	}
+
+	if (mPipelineDepth > 1)
+	{
+		mPipeline = std::make_unique<OpenCLFramePipeline>(context, device, mImageBufferSize, mPipelineDepth);
+		if (!mPipeline->IsValid())
+			return false;
+	}
+	return true;
+}
+
+bool FrameRenderer::EnqueueTrace(bool profile, cl_event* event)
+{
+	// Profiled frames track every command, pipelined frames retrieve the event of the last one
+	const auto track = [&](const char* stage, bool last) -> cl_event*
+	{
+		if (last && event)
+			return event;
+		return profile ? mProfiler.Track(stage) : NULL;
+	};
+
+	if (mPersistentDispatch)
+		return mPersistentDispatch->Enqueue(mQueue, track("Reset Work Counter", false), track("Trace Kernel", true));
+
+	cl_int err = CL_SUCCESS;
+	if (mTileScheduler)
+	{
+		// Every tile continues its own running average, so a region of interest refines independently of the rest
+		const std::vector<int>& tiles = mTileScheduler->BeginFrame();
+		for (size_t i = 0; i < tiles.size(); ++i)
+		{
+			const TileRegion& tile = mTileScheduler->GetTile(tiles[i]);
+			const int tileSamples = mTileScheduler->GetTileSamples(tiles[i]);
+			const size_t offset[2] = { static_cast<size_t>(tile.mX), static_cast<size_t>(tile.mY) };
+			const size_t size[2] = { static_cast<size_t>(tile.mWidth), static_cast<size_t>(tile.mHeight) };
+
+			err = clSetKernelArg(mKernel, mArguments.mAccumulatedSamples, sizeof(int), &tileSamples);
+			if (err >= 0)
+				err = clEnqueueNDRangeKernel(mQueue, mKernel, 2, offset, size, NULL, 0, NULL, track("Trace Kernel", i + 1 == tiles.size()));
+			if (err < 0)
+			{
+				perror("Couldn't enqueue a tile");
+				return false;
+			}
+		}
+
+		// A frame without tiles still signals its event
+		if (tiles.empty() && event)
+			clEnqueueMarkerWithWaitList(mQueue, 0, NULL, event);
+
+		mTileScheduler->EndFrame(mSettings.mSamples);
+		return true;
+	}
+
+	const size_t global[2] = { static_cast<size_t>(mSettings.mWidth), static_cast<size_t>(mSettings.mHeight) };
+	err = clEnqueueNDRangeKernel(mQueue, mKernel, 2, NULL, global, NULL, 0, NULL, track("Trace Kernel", true));
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the kernel");
+		return false;
+	}
+	return true;
+}
+
+bool FrameRenderer::RenderFrame(bool countRays, uint64_t& secondaryRays)
+{
+	if (mBackend == RenderBackend::Cpu)
+	{
+		std::atomic<uint64_t> rayCount = 0;
+		mCpuRenderer->RenderImage(mSettings.mWidth, mSettings.mHeight, mSettings.mSamples, [&](float px, float py)
+		{
+			int pixelRays = 0;
+			const Float3 color = mPixelFunction(px, py, countRays ? &pixelRays : nullptr);
+			if (pixelRays > 0)
+				rayCount += pixelRays;
+			return color;
+		}, mOutputImage.data, mCpuAccumulation.empty() ? nullptr : mCpuAccumulation.data(), mAccumulatedSamples);
+
+		if (!mCpuAccumulation.empty())
+			mAccumulatedSamples += mSettings.mSamples;
+
+		secondaryRays = rayCount;
+		return true;
+	}
+
+	// The previous frame stays mapped until it was presented
+	cl_int err = CL_SUCCESS;
+	if (mMappedImage)
+	{
+		err = clEnqueueUnmapMemObject(mQueue, mImageBuffer, mMappedImage, 0, NULL, mProfiler.Track("Unmap Image"));
+		mMappedImage = nullptr;
+		if (err < 0)
+		{
+			perror("Couldn't unmap the image");
+			return false;
+		}
+	}
+
+	// The ray counter is only bound while counting, so regular frames skip the atomics
+	if (countRays)
+	{
+		const cl_uint zero = 0;
+		err = clEnqueueWriteBuffer(mQueue, mRayCountBuffer, CL_TRUE, 0, sizeof(cl_uint), &zero, 0, NULL, mProfiler.Track("Write Ray Counter"));
+		err |= clSetKernelArg(mKernel, mArguments.mRayCounter, sizeof(cl_mem), &mRayCountBuffer);
+		if (err < 0)
+		{
+			perror("Couldn't bind the ray counter");
+			return false;
+		}
+	}
+
+	if (IsDispatching())
+	{
+		if (!mDispatch(mImageBuffer, mAccumulationBuffer, mAccumulatedSamples, countRays ? mRayCountBuffer : nullptr, &mProfiler, nullptr))
+			return false;
+	}
+	else
+	{
+		// Pipelined frames bind their own images, and the accumulated samples of the previous frames
+		// continue the running average, 0 restarts it
+		err = clSetKernelArg(mKernel, mArguments.mImage, sizeof(cl_mem), &mImageBuffer);
+		err |= clSetKernelArg(mKernel, mArguments.mAccumulatedSamples, sizeof(int), &mAccumulatedSamples);
+		if (err < 0)
+		{
+			perror("Couldn't set the frame arguments");
+			return false;
+		}
+
+		if (!EnqueueTrace(true, NULL))
+			return false;
+	}
+
+	if (mZeroCopy)
+	{
+		// Host accessible memory is mapped in place, without a copy on integrated and unified memory devices
+		mMappedImage = clEnqueueMapBuffer(mQueue, mImageBuffer, CL_FALSE, CL_MAP_READ, 0, mImageBufferSize, 0, NULL, mProfiler.Track("Map Image"), &err);
+	}
+	else
+	{
+		err = clEnqueueReadBuffer(mQueue, mImageBuffer, CL_FALSE, 0, mImageBufferSize, mOutputImage.data, 0, NULL, mProfiler.Track("Read Image"));
+	}
+
+	if (err < 0)
+	{
+		perror("Couldn't read the buffer");
+		return false;
+	}
+
+	clFinish(mQueue);
+
+	if (mMappedImage)
+		mDisplayImage = cv::Mat(mSettings.mHeight, mSettings.mWidth, FrameOutput::GetImageType(mOutputFormat), mMappedImage);
+
+	if (countRays)
+	{
+		const cl_mem noRayCountBuffer = nullptr;
+		cl_uint rayCount = 0;
+		err = clEnqueueReadBuffer(mQueue, mRayCountBuffer, CL_TRUE, 0, sizeof(cl_uint), &rayCount, 0, NULL, mProfiler.Track("Read Ray Counter"));
+		err |= clSetKernelArg(mKernel, mArguments.mRayCounter, sizeof(cl_mem), &noRayCountBuffer);
+		if (err < 0)
+		{
+			perror("Couldn't read the ray counter");
+			return false;
+		}
+		secondaryRays = rayCount;
+	}
+
+	if (mAccumulationBuffer)
+		mAccumulatedSamples = mTileScheduler ? mTileScheduler->GetAccumulatedSamples() : mAccumulatedSamples + mSettings.mSamples;
+
+	mProfiler.EndFrame();
+	return true;
+}
+
+bool FrameRenderer::SubmitFrame()
+{
+	// Renders the next frame into a free pipeline slot without waiting for it
+	cl_event renderEvent = nullptr;
+	if (IsDispatching())
+	{
+		if (!mDispatch(mPipeline->BeginFrame(), mAccumulationBuffer, mAccumulatedSamples, nullptr, nullptr, &renderEvent))
+			return false;
+	}
+	else
+	{
+		cl_int err = clSetKernelArg(mKernel, mArguments.mImage, sizeof(cl_mem), &mPipeline->BeginFrame());
+		err |= clSetKernelArg(mKernel, mArguments.mAccumulatedSamples, sizeof(int), &mAccumulatedSamples);
+		if (err < 0)
+		{
+			perror("Couldn't set the pipelined frame arguments");
+			return false;
+		}
+
+		if (!EnqueueTrace(false, &renderEvent))
+			return false;
+	}
+
+	if (mAccumulationBuffer)
+		mAccumulatedSamples = mTileScheduler ? mTileScheduler->GetAccumulatedSamples() : mAccumulatedSamples + mSettings.mSamples;
+
+	return mPipeline->EndFrame(mQueue, renderEvent);
+}
+
+bool FrameRenderer::PipelinedFrame(bool submit)
+{
+	// Presents the oldest frame in flight, after topping the pipeline up with new frames when submit is set
+	while (submit && !mPipeline->IsFull())
+	{
+		if (!SubmitFrame())
+			return false;
+	}
+
+	const uint8_t* image = mPipeline->WaitFrame();
+	if (!image)
+		return false;
+
+	mDisplayImage = cv::Mat(mSettings.mHeight, mSettings.mWidth, FrameOutput::GetImageType(mOutputFormat), const_cast<uint8_t*>(image));
+	return true;
+}
+
+bool FrameRenderer::RunPipelinedBenchmark(const Benchmark& benchmark, const BenchmarkResult& reference, bool& success)
+{
+	if (!mPipeline)
+		return true;
+
+	// The pipelined run measures the steady state, every frame completes while the next ones render
+	BenchmarkResult pipelinedResult = reference;
+	pipelinedResult.mBackend += " pipelined x" + std::to_string(mPipeline->GetDepth());
+
+	const auto pipelinedBenchmarkFrame = [&](bool countRays, uint64_t& secondaryRays) -> bool
+	{
+		if (!countRays)
+			return PipelinedFrame(true);
+
+		// The rays are counted by a serialized frame once the frames in flight completed
+		while (mPipeline->GetInFlightCount() > 0)
+		{
+			if (!mPipeline->WaitFrame())
+				return false;
+		}
+		return RenderFrame(true, secondaryRays);
+	};
+
+	if (!benchmark.Run(pipelinedResult, pipelinedBenchmarkFrame))
+		return false;
+
+	success &= benchmark.Report(pipelinedResult);
+	Benchmark::PrintSpeedup(reference, pipelinedResult);
+	return true;
+}
+
+void FrameRenderer::InvalidateAccumulation(const SceneChangeTracker& sceneChanges)
+{
+	// Scene changes invalidate the accumulated samples. With a region of interest, edits of the lights and
+	// materials are expected to be local to it, so only its tiles are re-rendered
+	if (mTileScheduler)
+	{
+		if (sceneChanges.IsDirty(SceneChange::Camera) || sceneChanges.IsDirty(SceneChange::Geometry) || !mTileScheduler->HasRegionOfInterest())
+			mTileScheduler->Invalidate();
+		else
+			mTileScheduler->InvalidateRegionOfInterest();
+		mAccumulatedSamples = mTileScheduler->GetAccumulatedSamples();
+	}
+	else
+	{
+		mAccumulatedSamples = 0;
+	}
+}
+
+bool FrameRenderer::Run(const std::string& windowName, const FrameLoopCallbacks& callbacks)
+{
+	FrameOutput frameOutput(mSettings, windowName, mOutputFormat);
+
+	// Frames are only re-rendered once the camera moved or the scene was edited
+	SceneChangeTracker sceneChanges;
+
+	const auto moveCamera = [&]()
+	{
+		Float3 movement;
+		if (!frameOutput.GetCameraMovement(0.25f, movement))
+			return;
+
+		callbacks.mMoveCamera(movement);
+		sceneChanges.Mark(SceneChange::Camera);
+	};
+
+	Timer gpuBufferReadTimer;
+	Timer drawTimer;
+
+	float deltaTime_s = 0.01f;
+	for (int frame = 0; mSettings.mFrames == 0 || frame < mSettings.mFrames;)
+	{
+		if (callbacks.mUpdate)
+			callbacks.mUpdate(sceneChanges, deltaTime_s);
+
+		// An unchanged scene keeps refining its running average until it reached the maximum samples per pixel
+		const bool refine = IsAccumulating() && (mSettings.mMaxSamples == 0 || mAccumulatedSamples < mSettings.mMaxSamples);
+		const bool render = sceneChanges.NeedsRender() || refine;
+
+		// Frames still in flight are presented even once nothing new is rendered
+		const bool pending = mPipeline && mPipeline->GetInFlightCount() > 0;
+
+		if (!render && !pending && frameOutput.IsInteractive())
+		{
+			// The shown frame is still valid, so idle until a key is pressed instead of re-rendering it
+			if (!frameOutput.WaitForInput(100))
+				break;
+
+			moveCamera();
+			continue;
+		}
+
+		// Headless frames of an unchanged, fully refined scene reuse the last image
+		double gpuBufferTime_ms = 0.0;
+		if (render || pending)
+		{
+			if (sceneChanges.NeedsRender())
+				InvalidateAccumulation(sceneChanges);
+
+			gpuBufferReadTimer.Start();
+
+			if (mBackend == RenderBackend::OpenCL && callbacks.mUpload && !callbacks.mUpload(sceneChanges))
+				return false;
+
+			if (mPipeline)
+			{
+				// Only submits the frames that will be presented
+				const bool submit = render && (mSettings.mFrames == 0 || mPipeline->GetSubmittedCount() < static_cast<uint64_t>(mSettings.mFrames));
+				if (!PipelinedFrame(submit))
+					return false;
+			}
+			else
+			{
+				uint64_t secondaryRays = 0;
+				if (!RenderFrame(false, secondaryRays))
+					return false;
+			}
+			sceneChanges.FrameRendered();
+
+			gpuBufferTime_ms = gpuBufferReadTimer.Elapsed_ms();
+		}
+
+		// Visualization logic
+		drawTimer.Start();
+
+		if (!frameOutput.Present(mDisplayImage, frame++))
+			break;
+
+		const double drawTime_ms = drawTimer.Elapsed_ms();
+
+		std::cout << "GPU Read Time: " << std::to_string(gpuBufferTime_ms) << "\tDraw Time: " << std::to_string(drawTime_ms)
+				  << "\tAccumulated Samples: " << mAccumulatedSamples << std::endl;
+		mProfiler.PrintFrame();
+		deltaTime_s = static_cast<float>(gpuBufferTime_ms + drawTime_ms) * 0.01f; // Convert back to seconds
+
+		moveCamera();
+	}
+	return true;
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "Cl/cl.h"
+
+#include "Benchmark.h"
+#include "CommandLine.h"
+#include "CpuMath.h"
+#include "CpuRenderer.h"
+#include "OpenCLFramePipeline.h"
+#include "OpenCLPersistentDispatch.h"
+#include "OpenCLProfiler.h"
+#include "PixelFormat.h"
+#include "RenderBackend.h"
+#include "RenderSettings.h"
+#include "SceneChangeTracker.h"
+#include "TileScheduler.h"
+
+#include <opencv2/opencv.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/// <summary>
+/// Argument indices of the frame state every trace kernel takes besides its scene.
+/// </summary>
+struct TraceKernelArguments
+{
+	cl_uint mImage = 0;
+	cl_uint mRayCounter = 0;
+	cl_uint mAccumulation = 0;
+	cl_uint mAccumulatedSamples = 0;
+	cl_uint mWorkCounter = 0;
+};
+
+/// <summary>
+/// Scene specific steps of the interactive frame loop.
+/// </summary>
+struct FrameLoopCallbacks
+{
+	// Animates the scene before every frame and tracks or marks the changed state
+	std::function<void(SceneChangeTracker& sceneChanges, float deltaTime_s)> mUpdate;
+
+	// Uploads the state changed since the last rendered frame, only called on the OpenCL backend
+	std::function<bool(const SceneChangeTracker& sceneChanges)> mUpload;
+
+	// Moves the camera by the movement of the camera keys, the loop marks the change
+	std::function<void(const Float3& movement)> mMoveCamera;
+};
+
+/// <summary>
+/// Renders the frames of a scene on the selected backend and runs the interactive or headless frame loop.
+/// On the OpenCL backend it owns the image, ray counter and accumulation buffers and dispatches the trace kernel
+/// over the whole image, per tile or as persistent threads, serialized or with --pipeline N frames in flight.
+/// Frames are only re-rendered once the scene changed or its running average isn't refined yet.
+///
+/// Usage:
+///		FrameRenderer renderer(commandLine, backend, renderSettings, outputFormat, profiler);
+///		renderer.SetPixelFunction(tracePixel);
+///		renderer.Initialize(context, device, queue, kernel, arguments, persistentThreads);
+///		renderer.Run("Scene", callbacks);
+/// </summary>
+class FrameRenderer
+{
+public:
+	/// <summary>
+	/// Native pixel callback tracing the continuous image position (px, py), the secondary ray count is incremented when passed.
+	/// </summary>
+	using PixelFunction = std::function<Float3(float px, float py, int* secondaryRays)>;
+
+	/// <summary>
+	/// Enqueues a whole frame in place of the trace kernel without waiting for it, e.g. the stages of a wavefront renderer.
+	/// The ray counter, profiler and event are optional.
+	/// </summary>
+	using DispatchFunction = std::function<bool(cl_mem image, cl_mem accumulation, int accumulatedSamples, cl_mem rayCounter,
+												OpenCLProfiler* profiler, cl_event* event)>;
+public:
+	/// <summary>
+	/// Constructor initializing a FrameRenderer, creating the native renderer threads when the CPU backend is selected.
+	/// Supported arguments: --threads, --zero-copy, --pipeline, --tile-size, --tile-order and --roi.
+	/// </summary>
+	/// <param name="commandLine">The command line</param>
+	/// <param name="backend">The render backend</param>
+	/// <param name="settings">The render settings</param>
+	/// <param name="outputFormat">The pixel format of the rendered images</param>
+	/// <param name="profiler">The profiler the OpenCL commands are tracked by</param>
+	FrameRenderer(const CommandLine& commandLine, RenderBackend backend, const RenderSettings& settings, PixelFormat outputFormat, OpenCLProfiler& profiler);
+
+	/// <summary>
+	/// Destructor releasing the frame buffers.
+	/// </summary>
+	~FrameRenderer();
+
+	FrameRenderer(const FrameRenderer&) = delete;
+	FrameRenderer& operator=(const FrameRenderer&) = delete;
+public:
+	/// <summary>
+	/// Creates the frame buffers and binds them to the trace kernel, the scene arguments are expected to be bound by the caller.
+	/// Tiles are ignored by the persistent threads and the frame dispatch, as both cover the whole image.
+	/// </summary>
+	/// <param name="context">The context</param>
+	/// <param name="device">The device</param>
+	/// <param name="queue">The command queue the frames are rendered on</param>
+	/// <param name="kernel">The trace kernel</param>
+	/// <param name="arguments">The frame argument indices of the trace kernel</param>
+	/// <param name="persistentThreads">Whether the kernel was built with -DPERSISTENT_THREADS</param>
+	/// <param name="dispatch">The optional frame dispatch rendering in place of the trace kernel while enabled</param>
+	/// <returns>False if a buffer couldn't be created or bound, otherwise true</returns>
+	bool Initialize(cl_context context, cl_device_id device, cl_command_queue queue, cl_kernel kernel,
+					const TraceKernelArguments& arguments, bool persistentThreads, const DispatchFunction& dispatch = nullptr);
+
+	/// <summary>
+	/// Renders a complete frame, blocking until it was read back.
+	/// Matches the Benchmark::FrameFunction, when countRays is set the frame reports the secondary rays it traced.
+	/// </summary>
+	/// <param name="countRays">Whether the secondary rays are counted</param>
+	/// <param name="secondaryRays">The output secondary ray count</param>
+	/// <returns>False if the frame failed, otherwise true</returns>
+	bool RenderFrame(bool countRays, uint64_t& secondaryRays);
+
+	/// <summary>
+	/// Benchmarks the pipelined frames against a serialized reference run, when --pipeline N was passed.
+	/// </summary>
+	/// <param name="benchmark">The benchmark</param>
+	/// <param name="reference">The result of the serialized run</param>
+	/// <param name="success">Cleared if the pipelined result failed to report or regressed</param>
+	/// <returns>False if a frame failed, otherwise true</returns>
+	bool RunPipelinedBenchmark(const Benchmark& benchmark, const BenchmarkResult& reference, bool& success);
+
+	/// <summary>
+	/// Runs the frame loop until the window is closed or the --frames were presented.
+	/// </summary>
+	/// <param name="windowName">The window name</param>
+	/// <param name="callbacks">The scene steps of every frame</param>
+	/// <returns>False if a frame failed, otherwise true</returns>
+	bool Run(const std::string& windowName, const FrameLoopCallbacks& callbacks);
+
+	/// <summary>
+	/// Drops the accumulated samples, so the next frame restarts the running average.
+	/// </summary>
+	inline void RestartAccumulation() { mAccumulatedSamples = 0; }
+
+	inline void SetPixelFunction(const PixelFunction& func) { mPixelFunction = func; }
+
+	inline void SetDispatchEnabled(bool enabled) { mDispatchEnabled = enabled; }
+
+	inline int GetAccumulatedSamples() const { return mAccumulatedSamples; }
+
+	inline cl_mem GetAccumulationBuffer() const { return mAccumulationBuffer; }
+
+	inline bool IsAccumulating() const { return mAccumulationBuffer || !mCpuAccumulation.empty(); }
+private:
+	bool EnqueueTrace(bool profile, cl_event* event);
+
+	bool SubmitFrame();
+
+	bool PipelinedFrame(bool submit);
+
+	void InvalidateAccumulation(const SceneChangeTracker& sceneChanges);
+
+	inline bool IsDispatching() const { return mDispatch && mDispatchEnabled; }
+private:
+	RenderBackend mBackend;
+	RenderSettings mSettings;
+	PixelFormat mOutputFormat;
+	OpenCLProfiler& mProfiler;
+
+	cl_command_queue mQueue = nullptr;
+	cl_kernel mKernel = nullptr;
+	TraceKernelArguments mArguments;
+
+	// --zero-copy maps a host accessible image after every frame instead of copying it back
+	bool mZeroCopy = false;
+	void* mMappedImage = nullptr;
+
+	cv::Mat mOutputImage;
+
+	// The presented image, the mapped image in zero-copy mode or the host copy of a pipeline slot in pipelined mode
+	cv::Mat mDisplayImage;
+
+	size_t mImageBufferSize = 0;
+	cl_mem mImageBuffer = nullptr;
+	cl_mem mRayCountBuffer = nullptr;
+	cl_mem mAccumulationBuffer = nullptr;
+
+	// Progressive accumulation, every frame adds its samples to the running average until the scene changes
+	int mAccumulatedSamples = 0;
+
+	// The native backend's renderer threads are only created when it is selected
+	std::unique_ptr<CpuRenderer> mCpuRenderer;
+	std::vector<Float3> mCpuAccumulation;
+	PixelFunction mPixelFunction;
+
+	DispatchFunction mDispatch;
+	bool mDispatchEnabled = true;
+
+	// --persistent-threads launches device filling work-groups that pull pixel batches instead of a work item per pixel
+	std::unique_ptr<OpenCLPersistentDispatch> mPersistentDispatch;
+
+	// --tile-size N dispatches the trace kernel per tile in --tile-order, --roi x,y,width,height re-renders only the tiles of the region
+	TileSettings mTileSettings;
+	std::unique_ptr<TileScheduler> mTileScheduler;
+
+	// --pipeline N keeps up to N frames in flight, so the device renders a frame while the previous ones are read back and presented
+	int mPipelineDepth = 0;
+	std::unique_ptr<OpenCLFramePipeline> mPipeline;
+};
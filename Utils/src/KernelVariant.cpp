@@ -0,0 +1,66 @@
+#include "KernelVariant.h"
+
+#include <iostream>
+
+std::string KernelVariant::GetBuildOptions() const
+{
+	std::string options = mOptions;
+	const auto define = [&options](const std::string& name, int value)
+	{
+		if (!options.empty())
+			options += " ";
+		options += "-D" + name + "=" + std::to_string(value);
+	};
+
+	define("MAX_BOUNCES", mMaxBounces);
+	define("OUTPUT_FORMAT", static_cast<int>(mOutputFormat));
+
+	if (mSpecialized)
+	{
+		define("IMAGE_WIDTH", mImageWidth);
+		define("IMAGE_HEIGHT", mImageHeight);
+		define("NUM_LIGHTS", mLightCount);
+		if (!mPrimitiveDefine.empty())
+			define(mPrimitiveDefine, mPrimitiveCount);
+	}
+
+	if (mPersistentThreads)
+		options += " -DPERSISTENT_THREADS";
+
+	if (mShadows)
+		options += " -DSHADOWS";
+
+	if (mFastRelaxedMath)
+		options += " -cl-fast-relaxed-math";
+	return options;
+}
+
+std::string KernelVariant::GetName() const
+{
+	std::string name = mSpecialized ? "specialized" : "generic";
+	if (mFastRelaxedMath)
+		name += " fast-math";
+	if (mPersistentThreads)
+		name += " persistent";
+	if (mShadows)
+		name += " shadows";
+	return name;
+}
+
+KernelVariant ParseKernelVariant(const CommandLine& commandLine, const KernelVariant& defaults)
+{
+	KernelVariant variant = defaults;
+
+	const std::string name = commandLine.GetString("kernel-variant", defaults.mSpecialized ? "specialized" : "generic");
+	if (name == "generic")
+		variant.mSpecialized = false;
+	else if (name == "specialized")
+		variant.mSpecialized = true;
+	else
+		std::cout << "Unknown kernel variant '" << name << "', using " << (defaults.mSpecialized ? "specialized" : "generic") << std::endl;
+
+	variant.mFastRelaxedMath = defaults.mFastRelaxedMath || commandLine.Has("fast-math");
+	variant.mPersistentThreads = defaults.mPersistentThreads || commandLine.Has("persistent-threads");
+	variant.mShadows = defaults.mShadows || commandLine.Has("shadows");
+	return variant;
+}
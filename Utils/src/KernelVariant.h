@@ -0,0 +1,65 @@
+#pragma once
+
+#include "CommandLine.h"
+#include "PixelFormat.h"
+
+#include <string>
+
+/// <summary>
+/// Compile-time specialization of a trace kernel, passed to the OpenCL compiler as -D defines.
+/// A specialized kernel bakes the scene and image constants into the program, so the compiler can
+/// unroll and constant fold the loops over them, but has to be rebuilt for every other scene or resolution.
+/// Every variant is built from its own options, so the program binary cache keeps one binary per variant.
+/// </summary>
+struct KernelVariant
+{
+	// Bakes the counts below into the kernel instead of reading the kernel arguments
+	bool mSpecialized = true;
+
+	// Builds with -cl-fast-relaxed-math, trading IEEE precision for speed
+	bool mFastRelaxedMath = false;
+
+	// Launches only enough work-groups to fill the device, which pull pixel batches from a global atomic counter
+	bool mPersistentThreads = false;
+
+	// Casts an any-hit shadow ray per light, the occluded lights don't contribute to the direct lighting
+	bool mShadows = false;
+
+	// Always compiled in, the CPU backend traces with the same bounce count
+	int mMaxBounces = 2;
+
+	int mImageWidth = 0;
+	int mImageHeight = 0;
+	int mLightCount = 0;
+
+	// Name of the primitive count define, e.g. NUM_SPHERES, empty when the kernel doesn't loop over primitives
+	std::string mPrimitiveDefine;
+	int mPrimitiveCount = 0;
+
+	// Format the kernel writes the image in, always compiled in
+	PixelFormat mOutputFormat = PixelFormat::RGBA8;
+
+	// Options passed to every variant, e.g. -DBVH_WIDTH=4
+	std::string mOptions;
+
+	/// <summary>
+	/// Retrieves the build options of the variant.
+	/// </summary>
+	/// <returns>The build options</returns>
+	std::string GetBuildOptions() const;
+
+	/// <summary>
+	/// Retrieves the display name of the variant, e.g. "specialized" or "generic fast-math".
+	/// </summary>
+	/// <returns>The display name</returns>
+	std::string GetName() const;
+};
+
+/// <summary>
+/// Parses the kernel variant from the command line.
+/// Supported arguments: --kernel-variant generic|specialized, --fast-math, --persistent-threads and --shadows.
+/// </summary>
+/// <param name="commandLine">The command line</param>
+/// <param name="defaults">The variant holding the scene constants and defaults</param>
+/// <returns>The kernel variant</returns>
+KernelVariant ParseKernelVariant(const CommandLine& commandLine, const KernelVariant& defaults);
@@ -0,0 +1,107 @@
+#include "OpenCLFramePipeline.h"
+
+#include "OpenCLUtils.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+OpenCLFramePipeline::OpenCLFramePipeline(cl_context context, cl_device_id device, size_t imageSize, int depth)
+	: mImageSize(imageSize),
+	mDepth(std::max(2, depth))
+{
+	cl_int err = 0;
+	mTransferQueue = clCreateCommandQueue(context, device, 0, &err);
+	if (err < 0)
+	{
+		perror("Couldn't create the transfer queue");
+		mTransferQueue = nullptr;
+		return;
+	}
+
+	mSlots.resize(mDepth);
+	for (Slot& slot : mSlots)
+	{
+		slot.mImageBuffer = OpenCLUtils::create_device_buffer(context, mImageSize);
+		slot.mHostImage.resize(mImageSize);
+		if (!slot.mImageBuffer)
+		{
+			perror("Couldn't create a pipeline image buffer");
+			clReleaseCommandQueue(mTransferQueue);
+			mTransferQueue = nullptr;
+			return;
+		}
+	}
+}
+
+OpenCLFramePipeline::~OpenCLFramePipeline()
+{
+	if (mTransferQueue)
+	{
+		clFinish(mTransferQueue);
+		clReleaseCommandQueue(mTransferQueue);
+	}
+
+	for (Slot& slot : mSlots)
+	{
+		if (slot.mReadEvent)
+			clReleaseEvent(slot.mReadEvent);
+		if (slot.mImageBuffer)
+			clReleaseMemObject(slot.mImageBuffer);
+	}
+}
+
+const cl_mem& OpenCLFramePipeline::BeginFrame() const
+{
+	return mSlots[mNextSlot].mImageBuffer;
+}
+
+bool OpenCLFramePipeline::EndFrame(cl_command_queue renderQueue, cl_event renderEvent)
+{
+	Slot& slot = mSlots[mNextSlot];
+	if (slot.mReadEvent)
+	{
+		clReleaseEvent(slot.mReadEvent);
+		slot.mReadEvent = nullptr;
+	}
+
+	cl_int err = clEnqueueReadBuffer(mTransferQueue,
+									 slot.mImageBuffer,
+									 CL_FALSE,
+									 0,
+									 mImageSize,
+									 slot.mHostImage.data(),
+									 1,
+									 &renderEvent,
+									 &slot.mReadEvent);
+	clReleaseEvent(renderEvent);
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the pipelined readback");
+		return false;
+	}
+
+	// Submit both queues now, nothing else flushes them until the frame is waited on
+	clFlush(renderQueue);
+	clFlush(mTransferQueue);
+
+	mInFlight.push_back(mNextSlot);
+	mNextSlot = (mNextSlot + 1) % mDepth;
+	++mSubmitted;
+	return true;
+}
+
+const uint8_t* OpenCLFramePipeline::WaitFrame()
+{
+	if (mInFlight.empty())
+		return nullptr;
+
+	Slot& slot = mSlots[mInFlight.front()];
+	mInFlight.pop_front();
+
+	if (clWaitForEvents(1, &slot.mReadEvent) < 0)
+	{
+		perror("Couldn't wait for the pipelined readback");
+		return nullptr;
+	}
+	return slot.mHostImage.data();
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "Cl/cl.h"
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+/// <summary>
+/// Keeps several frames in flight, so the device renders a frame while the previous ones are read back and presented.
+/// Every frame slot has its own device image and host copy. The readback runs on a separate transfer queue
+/// and waits on the render event of its frame, so it overlaps the render of the next frame instead of 
+/// serializing behind it.
+/// 
+/// Usage:
+///		clSetKernelArg(kernel, 0, sizeof(cl_mem), &pipeline.BeginFrame());
+///		clEnqueueNDRangeKernel(queue, kernel, ..., 0, NULL, &renderEvent);
+///		pipeline.EndFrame(queue, renderEvent);
+///		const uint8_t* image = pipeline.WaitFrame();
+/// </summary>
+class OpenCLFramePipeline
+{
+public:
+	/// <summary>
+	/// Constructor initializing an OpenCLFramePipeline.
+	/// </summary>
+	/// <param name="context">The context</param>
+	/// <param name="device">The device the transfer queue is created on</param>
+	/// <param name="imageSize">The image size in bytes</param>
+	/// <param name="depth">The maximum number of frames in flight, at least 2</param>
+	OpenCLFramePipeline(cl_context context, cl_device_id device, size_t imageSize, int depth);
+
+	/// <summary>
+	/// Destructor waiting for the frames in flight and releasing the buffers.
+	/// </summary>
+	~OpenCLFramePipeline();
+
+	OpenCLFramePipeline(const OpenCLFramePipeline&) = delete;
+	OpenCLFramePipeline& operator=(const OpenCLFramePipeline&) = delete;
+public:
+	/// <summary>
+	/// Retrieves the device image the next frame renders into.
+	/// Expects a free slot, i.e. fewer than depth frames in flight.
+	/// </summary>
+	/// <returns>The device image buffer</returns>
+	const cl_mem& BeginFrame() const;
+
+	/// <summary>
+	/// Enqueues the readback of the frame once its render completed, without waiting for either.
+	/// Takes ownership of the render event.
+	/// </summary>
+	/// <param name="renderQueue">The queue the frame was rendered on</param>
+	/// <param name="renderEvent">The event of the last render command of the frame</param>
+	/// <returns>False if the readback couldn't be enqueued, otherwise true</returns>
+	bool EndFrame(cl_command_queue renderQueue, cl_event renderEvent);
+
+	/// <summary>
+	/// Blocks until the oldest frame in flight arrived on the host.
+	/// The image stays valid until its slot is reused, i.e. depth frames later.
+	/// </summary>
+	/// <returns>The RGBA image data, or nullptr if no frame is in flight or the readback failed</returns>
+	const uint8_t* WaitFrame();
+
+	inline bool IsValid() const { return mTransferQueue != nullptr; }
+
+	inline bool IsFull() const { return static_cast<int>(mInFlight.size()) >= mDepth; }
+
+	inline int GetInFlightCount() const { return static_cast<int>(mInFlight.size()); }
+
+	inline int GetDepth() const { return mDepth; }
+
+	inline uint64_t GetSubmittedCount() const { return mSubmitted; }
+private:
+	struct Slot
+	{
+		cl_mem mImageBuffer = nullptr;
+		std::vector<uint8_t> mHostImage;
+		cl_event mReadEvent = nullptr;
+	};
+private:
+	cl_command_queue mTransferQueue = nullptr;
+	size_t mImageSize;
+	int mDepth;
+
+	std::vector<Slot> mSlots;
+	std::deque<int> mInFlight;
+	int mNextSlot = 0;
+	uint64_t mSubmitted = 0;
+};
@@ -0,0 +1,68 @@
+#include "OpenCLPersistentDispatch.h"
+
+#include "OpenCLUtils.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+namespace
+{
+	// Pixels per batch at most, a row segment of one or two hardware wavefronts keeps the batch coherent
+	constexpr size_t MaxBatchSize = 64;
+}
+
+OpenCLPersistentDispatch::OpenCLPersistentDispatch(cl_context context, cl_device_id device, cl_kernel kernel, cl_uint counterArgIndex, int groupsPerComputeUnit)
+	: mKernel(kernel)
+{
+	cl_uint computeUnits = 0;
+	size_t maxGroupSize = 0;
+	cl_int err = clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &computeUnits, NULL);
+	err |= clGetKernelWorkGroupInfo(kernel, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &maxGroupSize, NULL);
+	if (err < 0 || computeUnits == 0 || maxGroupSize == 0)
+	{
+		perror("Couldn't query the persistent threads launch size");
+		return;
+	}
+
+	// Every work-group stays resident, so the launch only has to fill the compute units
+	mLocalSize = std::min(MaxBatchSize, maxGroupSize);
+	mGlobalSize = mLocalSize * computeUnits * static_cast<size_t>(std::max(1, groupsPerComputeUnit));
+
+	mWorkCounter = OpenCLUtils::create_device_buffer(context, sizeof(cl_uint));
+	if (!mWorkCounter)
+	{
+		perror("Couldn't create the work counter");
+		return;
+	}
+
+	err = clSetKernelArg(mKernel, counterArgIndex, sizeof(cl_mem), &mWorkCounter);
+	if (err < 0)
+	{
+		perror("Couldn't bind the work counter");
+		clReleaseMemObject(mWorkCounter);
+		mWorkCounter = nullptr;
+		return;
+	}
+
+	printf("Persistent Threads: %zu work-groups of %zu work items\n", mGlobalSize / mLocalSize, mLocalSize);
+}
+
+OpenCLPersistentDispatch::~OpenCLPersistentDispatch()
+{
+	if (mWorkCounter)
+		clReleaseMemObject(mWorkCounter);
+}
+
+bool OpenCLPersistentDispatch::Enqueue(cl_command_queue queue, cl_event* resetEvent, cl_event* event) const
+{
+	cl_int err = clEnqueueWriteBuffer(queue, mWorkCounter, CL_FALSE, 0, sizeof(cl_uint), &mZero, 0, NULL, resetEvent);
+	if (err >= 0)
+		err = clEnqueueNDRangeKernel(queue, mKernel, 1, NULL, &mGlobalSize, &mLocalSize, 0, NULL, event);
+
+	if (err < 0)
+	{
+		perror("Couldn't enqueue the persistent threads kernel");
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "Cl/cl.h"
+
+/// <summary>
+/// Dispatches a persistent threads kernel. Instead of one work item per pixel, only enough work-groups to fill
+/// the device are launched, and they pull batches of work from a global atomic counter until the frame is done.
+/// Groups that finish cheap work keep taking new batches, which balances scenes with uneven per pixel cost.
+/// The kernel has to be built with -DPERSISTENT_THREADS.
+///
+/// Usage:
+///		OpenCLPersistentDispatch dispatch(context, device, kernel, workCounterArgIndex);
+///		dispatch.Enqueue(queue, NULL, profiler.Track("Trace Kernel"));
+/// </summary>
+class OpenCLPersistentDispatch
+{
+public:
+	/// <summary>
+	/// Constructor initializing an OpenCLPersistentDispatch, creating the work counter and binding it to the kernel.
+	/// </summary>
+	/// <param name="context">The context</param>
+	/// <param name="device">The device the launch is sized for</param>
+	/// <param name="kernel">The persistent threads kernel</param>
+	/// <param name="counterArgIndex">The kernel argument index of the work counter</param>
+	/// <param name="groupsPerComputeUnit">The resident work-groups per compute unit, more groups hide more memory latency</param>
+	OpenCLPersistentDispatch(cl_context context, cl_device_id device, cl_kernel kernel, cl_uint counterArgIndex, int groupsPerComputeUnit = 4);
+
+	/// <summary>
+	/// Destructor releasing the work counter.
+	/// </summary>
+	~OpenCLPersistentDispatch();
+
+	OpenCLPersistentDispatch(const OpenCLPersistentDispatch&) = delete;
+	OpenCLPersistentDispatch& operator=(const OpenCLPersistentDispatch&) = delete;
+public:
+	/// <summary>
+	/// Resets the work counter and enqueues the kernel without waiting for either.
+	/// </summary>
+	/// <param name="queue">The command queue</param>
+	/// <param name="resetEvent">The optional event of the counter reset</param>
+	/// <param name="event">The optional event of the kernel</param>
+	/// <returns>False if a command couldn't be enqueued, otherwise true</returns>
+	bool Enqueue(cl_command_queue queue, cl_event* resetEvent, cl_event* event) const;
+
+	inline bool IsValid() const { return mWorkCounter != nullptr; }
+
+	inline size_t GetGlobalSize() const { return mGlobalSize; }
+
+	inline size_t GetLocalSize() const { return mLocalSize; }
+private:
+	cl_kernel mKernel;
+	cl_mem mWorkCounter = nullptr;
+	size_t mGlobalSize = 0;
+	size_t mLocalSize = 0;
+
+	// Source of the non blocking counter reset, has to outlive the enqueued write
+	cl_uint mZero = 0;
+};
@@ -0,0 +1,140 @@
+#include "OpenCLProfiler.h"
+
+#include <algorithm>
+#include <climits>
+#include <iostream>
+
+namespace
+{
+	OpenCLStageTiming& FindStage(OpenCLFrameProfile& profile, const std::string& name)
+	{
+		for (OpenCLStageTiming& stage : profile.mStages)
+		{
+			if (stage.mName == name)
+				return stage;
+		}
+
+		profile.mStages.emplace_back();
+		profile.mStages.back().mName = name;
+		return profile.mStages.back();
+	}
+
+	void PrintProfile(const OpenCLFrameProfile& profile, double scale)
+	{
+		for (const OpenCLStageTiming& stage : profile.mStages)
+		{
+			std::cout << "  " << stage.mName
+					  << "\tCommands: " << stage.mCommandCount
+					  << "\tQueued: " << std::to_string(stage.mQueued_ms * scale)
+					  << "\tSubmitted: " << std::to_string(stage.mSubmitted_ms * scale)
+					  << "\tExecution: " << std::to_string(stage.mExecution_ms * scale) << std::endl;
+		}
+		std::cout << "  Device Time: " << std::to_string(profile.mDevice_ms * scale) << std::endl;
+	}
+}
+
+OpenCLProfiler::OpenCLProfiler(bool enabled)
+	: mEnabled(enabled)
+{
+}
+
+OpenCLProfiler::~OpenCLProfiler()
+{
+	for (TrackedCommand& command : mPending)
+	{
+		if (command.mEvent)
+			clReleaseEvent(command.mEvent);
+	}
+}
+
+cl_event* OpenCLProfiler::Track(const char* stage)
+{
+	if (!mEnabled)
+		return NULL;
+
+	mPending.emplace_back();
+	mPending.back().mStage = stage;
+	return &mPending.back().mEvent;
+}
+
+void OpenCLProfiler::EndFrame()
+{
+	if (!mEnabled)
+		return;
+
+	mLastFrame = OpenCLFrameProfile();
+
+	cl_ulong frameStart = ULLONG_MAX;
+	cl_ulong frameEnd = 0;
+	for (TrackedCommand& command : mPending)
+	{
+		// The enqueue call failed and never created the event
+		if (!command.mEvent)
+			continue;
+
+		cl_ulong queued = 0, submitted = 0, started = 0, ended = 0;
+		cl_int err = clGetEventProfilingInfo(command.mEvent, CL_PROFILING_COMMAND_QUEUED, sizeof(cl_ulong), &queued, NULL);
+		err |= clGetEventProfilingInfo(command.mEvent, CL_PROFILING_COMMAND_SUBMIT, sizeof(cl_ulong), &submitted, NULL);
+		err |= clGetEventProfilingInfo(command.mEvent, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &started, NULL);
+		err |= clGetEventProfilingInfo(command.mEvent, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &ended, NULL);
+		clReleaseEvent(command.mEvent);
+
+		if (err < 0)
+		{
+			perror("Couldn't read the event profiling info");
+			continue;
+		}
+
+		// The timestamps are in nanoseconds
+		OpenCLStageTiming& stage = FindStage(mLastFrame, command.mStage);
+		stage.mCommandCount++;
+		stage.mQueued_ms += (submitted - queued) * 1e-6;
+		stage.mSubmitted_ms += (started - submitted) * 1e-6;
+		stage.mExecution_ms += (ended - started) * 1e-6;
+
+		frameStart = std::min(frameStart, started);
+		frameEnd = std::max(frameEnd, ended);
+	}
+	mPending.clear();
+
+	if (frameEnd > frameStart)
+		mLastFrame.mDevice_ms = (frameEnd - frameStart) * 1e-6;
+
+	if (!mSummaryEnabled)
+		return;
+
+	for (const OpenCLStageTiming& stage : mLastFrame.mStages)
+	{
+		OpenCLStageTiming& total = FindStage(mTotal, stage.mName);
+		total.mCommandCount += stage.mCommandCount;
+		total.mQueued_ms += stage.mQueued_ms;
+		total.mSubmitted_ms += stage.mSubmitted_ms;
+		total.mExecution_ms += stage.mExecution_ms;
+	}
+	mTotal.mDevice_ms += mLastFrame.mDevice_ms;
+	mFrameCount++;
+}
+
+void OpenCLProfiler::PrintFrame() const
+{
+	if (!mEnabled)
+		return;
+
+	std::cout << "Device Profile (ms)" << std::endl;
+	PrintProfile(mLastFrame, 1.0);
+}
+
+void OpenCLProfiler::PrintSummary() const
+{
+	if (!mEnabled || mFrameCount == 0)
+		return;
+
+	std::cout << "Device Profile (ms, average of " << mFrameCount << " frames)" << std::endl;
+	PrintProfile(mTotal, 1.0 / mFrameCount);
+}
+
+void OpenCLProfiler::ResetSummary()
+{
+	mTotal = OpenCLFrameProfile();
+	mFrameCount = 0;
+}
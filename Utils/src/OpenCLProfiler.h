@@ -0,0 +1,119 @@
+#pragma once
+
+#define CL_USE_DEPRECATED_OPENCL_1_2_APIS
+#include "Cl/cl.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+/// <summary>
+/// Device timing of all commands of one stage within a frame, in milliseconds.
+/// </summary>
+struct OpenCLStageTiming
+{
+	std::string mName;
+	int mCommandCount = 0;
+
+	// Queued to submitted, time spent in the host side queue
+	double mQueued_ms = 0.0;
+
+	// Submitted to started, time waiting on the device
+	double mSubmitted_ms = 0.0;
+
+	// Started to ended, time executing on the device
+	double mExecution_ms = 0.0;
+};
+
+/// <summary>
+/// Device timing of a frame.
+/// </summary>
+struct OpenCLFrameProfile
+{
+	std::vector<OpenCLStageTiming> mStages;
+
+	// First command start to last command end
+	double mDevice_ms = 0.0;
+};
+
+/// <summary>
+/// Collects the queued, submitted, start and end timestamps of the tracked commands and aggregates them per frame and stage.
+/// The command queue has to be created with CL_QUEUE_PROFILING_ENABLE.
+/// 
+/// Usage:
+///		clEnqueueNDRangeKernel(queue, kernel, ..., 0, NULL, profiler.Track("Trace"));
+///		clFinish(queue);
+///		profiler.EndFrame();
+/// </summary>
+class OpenCLProfiler
+{
+public:
+	/// <summary>
+	/// Constructor initializing an OpenCLProfiler.
+	/// </summary>
+	/// <param name="enabled">Whether commands are tracked, a disabled profiler adds no overhead</param>
+	OpenCLProfiler(bool enabled);
+
+	/// <summary>
+	/// Destructor releasing the events of an unfinished frame.
+	/// </summary>
+	~OpenCLProfiler();
+
+	OpenCLProfiler(const OpenCLProfiler&) = delete;
+	OpenCLProfiler& operator=(const OpenCLProfiler&) = delete;
+public:
+	/// <summary>
+	/// Retrieves the event slot to pass as the event parameter of an enqueue call.
+	/// </summary>
+	/// <param name="stage">The stage the command is aggregated into</param>
+	/// <returns>The event slot, or NULL when the profiler is disabled</returns>
+	cl_event* Track(const char* stage);
+
+	/// <summary>
+	/// Reads the timestamps of the tracked commands and aggregates them into the frame profile.
+	/// Expects every tracked command to have completed, e.g. after clFinish.
+	/// </summary>
+	void EndFrame();
+
+	/// <summary>
+	/// Prints the stage timings of the last frame.
+	/// </summary>
+	void PrintFrame() const;
+
+	/// <summary>
+	/// Prints the per frame average stage timings of all frames.
+	/// </summary>
+	void PrintSummary() const;
+
+	/// <summary>
+	/// Clears the frames of the summary, e.g. before profiling another configuration.
+	/// </summary>
+	void ResetSummary();
+
+	/// <summary>
+	/// Excludes the following frames from the summary while disabled, e.g. warm-up frames or frames with extra
+	/// instrumentation. The last frame profile is still recorded.
+	/// </summary>
+	/// <param name="enabled">Whether the ended frames are added to the summary</param>
+	inline void SetSummaryEnabled(bool enabled) { mSummaryEnabled = enabled; }
+
+	inline bool IsEnabled() const { return mEnabled; }
+
+	inline const OpenCLFrameProfile& GetLastFrame() const { return mLastFrame; }
+private:
+	struct TrackedCommand
+	{
+		const char* mStage = nullptr;
+		cl_event mEvent = nullptr;
+	};
+private:
+	bool mEnabled;
+
+	// A deque keeps the returned event slots valid while more commands are tracked
+	std::deque<TrackedCommand> mPending;
+
+	OpenCLFrameProfile mLastFrame;
+	OpenCLFrameProfile mTotal;
+	int mFrameCount = 0;
+	bool mSummaryEnabled = true;
+};
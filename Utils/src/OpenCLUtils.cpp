@@ -1,11 +1,152 @@
 #include "OpenCLUtils.h"
 
+#include "Timer.h"
+
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+namespace
+{
+    std::string program_cache_directory = "shader_cache";
+
+    const uint32_t PROGRAM_CACHE_MAGIC = 0x4E424C43; // "CLBN"
+
+    std::string get_device_string(cl_device_id dev, cl_device_info param)
+    {
+        size_t size = 0;
+        if (clGetDeviceInfo(dev, param, 0, NULL, &size) < 0 || size == 0)
+            return "";
+
+        std::string value(size, '\0');
+        clGetDeviceInfo(dev, param, size, &value[0], NULL);
+        value.resize(strlen(value.c_str()));
+        return value;
+    }
+
+    /* FNV-1a */
+    uint64_t hash_string(const std::string& text)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : text)
+        {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    /* The binary is only valid for the exact source, build options, device and driver */
+    std::string get_program_cache_key(cl_device_id dev, const char* source, const char* options)
+    {
+        std::string key;
+        key += get_device_string(dev, CL_DEVICE_NAME) + "\n";
+        key += get_device_string(dev, CL_DEVICE_VERSION) + "\n";
+        key += get_device_string(dev, CL_DRIVER_VERSION) + "\n";
+        key += std::string(options ? options : "") + "\n";
+        key += source;
+        return key;
+    }
+
+    std::string get_program_cache_path(const char* filename, uint64_t key_hash)
+    {
+        char hash_text[17];
+        snprintf(hash_text, sizeof(hash_text), "%016llx", (unsigned long long)key_hash);
+
+        const std::string stem = std::filesystem::path(filename).stem().string();
+        return (std::filesystem::path(program_cache_directory) / (stem + "_" + hash_text + ".bin")).string();
+    }
+
+    cl_program load_program_binary(cl_context ctx, cl_device_id dev, const std::string& path, uint64_t key_hash, const char* options)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return nullptr;
+
+        uint32_t magic = 0;
+        uint64_t stored_hash = 0;
+        uint64_t binary_size = 0;
+        file.read((char*)&magic, sizeof(magic));
+        file.read((char*)&stored_hash, sizeof(stored_hash));
+        file.read((char*)&binary_size, sizeof(binary_size));
+        if (!file || magic != PROGRAM_CACHE_MAGIC || stored_hash != key_hash || binary_size == 0)
+            return nullptr;
+
+        std::vector<unsigned char> binary((size_t)binary_size);
+        file.read((char*)binary.data(), binary.size());
+        if (!file)
+            return nullptr;
+
+        const unsigned char* binary_ptr = binary.data();
+        size_t size = binary.size();
+        cl_int binary_status = CL_SUCCESS;
+        cl_int err = CL_SUCCESS;
+        cl_program program = clCreateProgramWithBinary(ctx, 1, &dev, &size, &binary_ptr, &binary_status, &err);
+        if (err < 0 || binary_status < 0)
+        {
+            if (program)
+                clReleaseProgram(program);
+            return nullptr;
+        }
+
+        /* Binaries still have to be built, which only links them */
+        err = clBuildProgram(program, 0, NULL, options, NULL, NULL);
+        if (err < 0)
+        {
+            clReleaseProgram(program);
+            return nullptr;
+        }
+        return program;
+    }
+
+    void save_program_binary(cl_program program, const std::string& path, uint64_t key_hash)
+    {
+        size_t binary_size = 0;
+        cl_int err = clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t), &binary_size, NULL);
+        if (err < 0 || binary_size == 0)
+            return;
+
+        std::vector<unsigned char> binary(binary_size);
+        unsigned char* binary_ptr = binary.data();
+        err = clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*), &binary_ptr, NULL);
+        if (err < 0)
+            return;
+
+        std::error_code error;
+        std::filesystem::create_directories(program_cache_directory, error);
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+        {
+            perror("Couldn't write the program binary cache");
+            return;
+        }
+
+        const uint64_t size = binary_size;
+        file.write((const char*)&PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+        file.write((const char*)&key_hash, sizeof(key_hash));
+        file.write((const char*)&size, sizeof(size));
+        file.write((const char*)binary.data(), binary.size());
+    }
+}
+
+void OpenCLUtils::set_program_cache_directory(const std::string& directory)
+{
+    program_cache_directory = directory;
+}
+
 cl_device_id OpenCLUtils::create_device()
 {
 	cl_platform_id platform;
@@ -36,6 +177,21 @@ cl_device_id OpenCLUtils::create_device()
 	return dev;
 }
 
+bool OpenCLUtils::is_runtime_available()
+{
+#ifdef _WIN32
+    // Probe the library before the first delay loaded call would fail
+    HMODULE library = LoadLibraryA("OpenCL.dll");
+    if (!library)
+        return false;
+    FreeLibrary(library);
+#endif
+
+    cl_uint platformCount = 0;
+    cl_int err = clGetPlatformIDs(0, NULL, &platformCount);
+    return err == CL_SUCCESS && platformCount > 0;
+}
+
 bool OpenCLUtils::initialize_device_and_context(cl_device_id& device, 
                                                 cl_context& context)
 {
@@ -54,7 +210,7 @@ bool OpenCLUtils::initialize_device_and_context(cl_device_id& device,
 	return true;
 }
 
-cl_program OpenCLUtils::build_program(cl_context ctx, cl_device_id dev, const char* filename)
+cl_program OpenCLUtils::build_program(cl_context ctx, cl_device_id dev, const char* filename, const char* options, bool* from_cache)
 {
     cl_program program;
     FILE* program_handle;
@@ -73,10 +229,32 @@ cl_program OpenCLUtils::build_program(cl_context ctx, cl_device_id dev, const ch
     program_size = ftell(program_handle);
     rewind(program_handle);
     program_buffer = (char*)malloc(program_size + 1);
+    /* Text mode reads fewer bytes than the file size when line endings are converted */
+    program_size = fread(program_buffer, sizeof(char), program_size, program_handle);
     program_buffer[program_size] = '\0';
-    fread(program_buffer, sizeof(char), program_size, program_handle);
     fclose(program_handle);
 
+    if (from_cache)
+        *from_cache = false;
+
+    /* Load the binary of a previous build of the same source, options, device and driver */
+    uint64_t cache_hash = 0;
+    std::string cache_path;
+    if (!program_cache_directory.empty())
+    {
+        cache_hash = hash_string(get_program_cache_key(dev, program_buffer, options));
+        cache_path = get_program_cache_path(filename, cache_hash);
+
+        program = load_program_binary(ctx, dev, cache_path, cache_hash, options);
+        if (program)
+        {
+            if (from_cache)
+                *from_cache = true;
+            free(program_buffer);
+            return program;
+        }
+    }
+
     /* Create program from file
 
     Creates a program from the source code in the add_numbers.cl file.
@@ -99,7 +277,7 @@ cl_program OpenCLUtils::build_program(cl_context ctx, cl_device_id dev, const ch
     define a macro with the option -DMACRO=VALUE and turn off optimization
     with -cl-opt-disable.
     */
-    err = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    err = clBuildProgram(program, 0, NULL, options, NULL, NULL);
     if (err < 0) 
     {
         /* Find size of log and print to std output */
@@ -114,6 +292,9 @@ cl_program OpenCLUtils::build_program(cl_context ctx, cl_device_id dev, const ch
 		return nullptr;
     }
 
+    if (!cache_path.empty())
+        save_program_binary(program, cache_path, cache_hash);
+
     return program;
 }
 
@@ -123,16 +304,23 @@ bool OpenCLUtils::initialize_program(const std::string& filepath,
                                      cl_device_id device,
                                      cl_program& program,
                                      cl_kernel& kernel,
-                                     cl_command_queue& queue)
+                                     cl_command_queue& queue,
+                                     const std::string& options,
+                                     cl_command_queue_properties queueProperties)
 {
 	cl_int err = 0;
 
 	/* Build program */
-	program = build_program(context, device, filepath.c_str());
+	Timer buildTimer(true);
+	bool fromCache = false;
+	program = build_program(context, device, filepath.c_str(), options.empty() ? NULL : options.c_str(), &fromCache);
 	if (!program)
 		return false;
 
-	queue = clCreateCommandQueue(context, device, 0, &err);
+	/* Cold (source) vs warm (binary cache) startup */
+	printf("Program Build Time: %f (%s)\n", buildTimer.Stop_ms(), fromCache ? "binary cache" : "source");
+
+	queue = clCreateCommandQueue(context, device, queueProperties, &err);
 	if (err < 0)
 	{
 		perror("Couldn't create a command queue");
@@ -190,6 +378,22 @@ cl_mem OpenCLUtils::create_output_buffer(cl_context context, size_t dataSize)
                                    NULL, 
                                    &err);
 
+	if (err < 0)
+	{
+		return nullptr;
+	}
+	return buffer;
+}
+
+cl_mem OpenCLUtils::create_device_buffer(cl_context context, size_t dataSize)
+{
+	cl_int err = -1;
+	cl_mem buffer = clCreateBuffer(context,
+                                   CL_MEM_READ_WRITE,
+                                   dataSize, 
+                                   NULL, 
+                                   &err);
+
 	if (err < 0)
 	{
 		return nullptr;
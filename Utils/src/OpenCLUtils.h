@@ -21,6 +21,13 @@ public:
     /// <returns></returns>
     static cl_device_id create_device();
 
+    /// <summary>
+    /// Checks whether an OpenCL runtime with at least one platform is installed.
+    /// The OpenCL library is delay loaded on Windows, so this is safe to call on machines without it.
+    /// </summary>
+    /// <returns>True if a platform is available, otherwise false</returns>
+    static bool is_runtime_available();
+
 	static bool initialize_device_and_context(cl_device_id& device,
                                               cl_context& context);
 
@@ -30,20 +37,42 @@ public:
     /// <param name="ctx"></param>
     /// <param name="dev"></param>
     /// <param name="filename"></param>
+    /// <param name="options">Optional compiler options, e.g. -D defines</param>
+    /// <param name="from_cache">Optionally set to whether the program was loaded from the binary cache</param>
     /// <returns></returns>
-    static cl_program build_program(cl_context ctx, cl_device_id dev, const char* filename);
+    static cl_program build_program(cl_context ctx, cl_device_id dev, const char* filename, const char* options = NULL, bool* from_cache = NULL);
+
+    /// <summary>
+    /// Sets the directory of the program binary cache, an empty directory disables the cache.
+    /// Binaries are keyed by the source, build options, device name, device version and driver version,
+    /// falling back to a source build whenever no valid binary exists. Defaults to "shader_cache".
+    /// </summary>
+    /// <param name="directory">The cache directory</param>
+    static void set_program_cache_directory(const std::string& directory);
 
+    /// <summary>
+    /// Builds the program and creates its kernel and command queue.
+    /// </summary>
+    /// <param name="options">Optional compiler options, e.g. -D defines</param>
+    /// <param name="queueProperties">The command queue properties, e.g. CL_QUEUE_PROFILING_ENABLE</param>
 	static bool initialize_program(const std::string& filepath,
                                    const std::string& kernalName,
                                    cl_context context,
                                    cl_device_id device,
                                    cl_program& program,
                                    cl_kernel& kernel,
-                                   cl_command_queue& queue);
+                                   cl_command_queue& queue,
+                                   const std::string& options = "",
+                                   cl_command_queue_properties queueProperties = 0);
 
     static cl_mem create_input_buffer(cl_context context, void* dataPtr, size_t dataSize);
 
     static cl_mem create_inout_buffer(cl_context context, void* dataPtr, size_t dataSize);
 
     static cl_mem create_output_buffer(cl_context context, size_t dataSize);
+
+    /// <summary>
+    /// Creates a read-write buffer that is only accessed by kernels, e.g. for intermediate results kept across frames.
+    /// </summary>
+    static cl_mem create_device_buffer(cl_context context, size_t dataSize);
 };
\ No newline at end of file
@@ -0,0 +1,60 @@
+#include "PixelFormat.h"
+
+#include <cctype>
+#include <iostream>
+
+namespace
+{
+	const PixelFormat kPixelFormats[] = { PixelFormat::RGBA8, PixelFormat::BGRA8, PixelFormat::RGBA16F, PixelFormat::RGBA32F };
+}
+
+PixelFormat ParsePixelFormat(const CommandLine& commandLine, PixelFormat defaultFormat)
+{
+	if (!commandLine.Has("output-format"))
+		return defaultFormat;
+
+	const std::string name = commandLine.GetString("output-format");
+	for (PixelFormat format : kPixelFormats)
+	{
+		std::string formatName = ToString(format);
+		for (char& c : formatName)
+			c = static_cast<char>(std::tolower(c));
+
+		if (name == formatName)
+			return format;
+	}
+
+	std::cout << "Unknown output format '" << name << "', using " << ToString(defaultFormat) << std::endl;
+	return defaultFormat;
+}
+
+size_t GetPixelSize(PixelFormat format)
+{
+	switch (format)
+	{
+		case PixelFormat::RGBA8:
+		case PixelFormat::BGRA8:
+			return 4;
+		case PixelFormat::RGBA16F:
+			return 8;
+		case PixelFormat::RGBA32F:
+			return 16;
+	}
+	return 4;
+}
+
+const char* ToString(PixelFormat format)
+{
+	switch (format)
+	{
+		case PixelFormat::RGBA8:
+			return "RGBA8";
+		case PixelFormat::BGRA8:
+			return "BGRA8";
+		case PixelFormat::RGBA16F:
+			return "RGBA16F";
+		case PixelFormat::RGBA32F:
+			return "RGBA32F";
+	}
+	return "Unknown";
+}
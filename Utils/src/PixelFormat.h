@@ -0,0 +1,42 @@
+#pragma once
+
+#include "CommandLine.h"
+
+#include <cstddef>
+#include <string>
+
+/// <summary>
+/// Pixel format the trace kernels write the image in, so the consumer gets its format without a conversion pass.
+/// The values match the OUTPUT_FORMAT define of the kernels.
+/// </summary>
+enum class PixelFormat
+{
+	RGBA8	= 0,
+	BGRA8	= 1,
+
+	// Unclamped HDR colors
+	RGBA16F	= 2,
+	RGBA32F	= 3
+};
+
+/// <summary>
+/// Parses the "--output-format rgba8|bgra8|rgba16f|rgba32f" argument.
+/// </summary>
+/// <param name="commandLine">The command line</param>
+/// <param name="defaultFormat">The format used when the argument wasn't passed or is unknown</param>
+/// <returns>The pixel format</returns>
+PixelFormat ParsePixelFormat(const CommandLine& commandLine, PixelFormat defaultFormat);
+
+/// <summary>
+/// Retrieves the size of a pixel in bytes.
+/// </summary>
+/// <param name="format">The pixel format</param>
+/// <returns>The pixel size</returns>
+size_t GetPixelSize(PixelFormat format);
+
+/// <summary>
+/// Retrieves the display name of the format.
+/// </summary>
+/// <param name="format">The pixel format</param>
+/// <returns>The display name</returns>
+const char* ToString(PixelFormat format);
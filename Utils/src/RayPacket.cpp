@@ -0,0 +1,370 @@
+#include "RayPacket.h"
+
+// The float math only needs AVX, which every AVX2 target provides
+#if defined(__AVX__)
+#define RAY_PACKET_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RAY_PACKET_SSE
+#include <emmintrin.h>
+#endif
+
+void RayPacket::SetRay(int lane, const Float3& origin, const Float3& direction)
+{
+	mOriginX[lane] = origin.x;
+	mOriginY[lane] = origin.y;
+	mOriginZ[lane] = origin.z;
+	mDirectionX[lane] = direction.x;
+	mDirectionY[lane] = direction.y;
+	mDirectionZ[lane] = direction.z;
+	mInvDirectionX[lane] = 1.0f / direction.x;
+	mInvDirectionY[lane] = 1.0f / direction.y;
+	mInvDirectionZ[lane] = 1.0f / direction.z;
+}
+
+void PacketHit::Reset(float tMax)
+{
+	for (int lane = 0; lane < kRayPacketWidth; ++lane)
+	{
+		mT[lane] = tMax;
+		mU[lane] = 0.0f;
+		mV[lane] = 0.0f;
+		mPrimitive[lane] = -1;
+	}
+}
+
+namespace
+{
+	/// <summary>
+	/// Single lane, used by the scalar reference implementation.
+	/// </summary>
+	struct Lane1
+	{
+	public:
+		static constexpr int kWidth = 1;
+
+		struct Mask
+		{
+			bool v;
+		};
+	public:
+		Lane1(float x) : v(x) {}
+
+		static inline Lane1 Load(const float* data) { return data[0]; }
+		inline void Store(float* data) const { data[0] = v; }
+	public:
+		float v;
+	};
+
+	inline Lane1 operator+(Lane1 a, Lane1 b) { return a.v + b.v; }
+	inline Lane1 operator-(Lane1 a, Lane1 b) { return a.v - b.v; }
+	inline Lane1 operator*(Lane1 a, Lane1 b) { return a.v * b.v; }
+	inline Lane1 operator/(Lane1 a, Lane1 b) { return a.v / b.v; }
+	inline Lane1::Mask operator<(Lane1 a, Lane1 b) { return { a.v < b.v }; }
+	inline Lane1::Mask operator>(Lane1 a, Lane1 b) { return { a.v > b.v }; }
+	inline Lane1::Mask operator<=(Lane1 a, Lane1 b) { return { a.v <= b.v }; }
+	inline Lane1::Mask operator>=(Lane1 a, Lane1 b) { return { a.v >= b.v }; }
+	inline Lane1::Mask operator&(Lane1::Mask a, Lane1::Mask b) { return { a.v && b.v }; }
+	inline Lane1::Mask operator|(Lane1::Mask a, Lane1::Mask b) { return { a.v || b.v }; }
+	inline Lane1 Min(Lane1 a, Lane1 b) { return std::min(a.v, b.v); }
+	inline Lane1 Max(Lane1 a, Lane1 b) { return std::max(a.v, b.v); }
+	inline Lane1 Sqrt(Lane1 a) { return std::sqrt(a.v); }
+	inline Lane1 Select(Lane1::Mask mask, Lane1 a, Lane1 b) { return mask.v ? a : b; }
+	inline int MaskBits(Lane1::Mask mask) { return mask.v ? 1 : 0; }
+
+#if defined(RAY_PACKET_AVX)
+	struct Lane8
+	{
+	public:
+		static constexpr int kWidth = 8;
+
+		struct Mask
+		{
+			__m256 v;
+		};
+	public:
+		Lane8(__m256 x) : v(x) {}
+		Lane8(float x) : v(_mm256_set1_ps(x)) {}
+
+		static inline Lane8 Load(const float* data) { return _mm256_load_ps(data); }
+		inline void Store(float* data) const { _mm256_store_ps(data, v); }
+	public:
+		__m256 v;
+	};
+
+	inline Lane8 operator+(Lane8 a, Lane8 b) { return _mm256_add_ps(a.v, b.v); }
+	inline Lane8 operator-(Lane8 a, Lane8 b) { return _mm256_sub_ps(a.v, b.v); }
+	inline Lane8 operator*(Lane8 a, Lane8 b) { return _mm256_mul_ps(a.v, b.v); }
+	inline Lane8 operator/(Lane8 a, Lane8 b) { return _mm256_div_ps(a.v, b.v); }
+	inline Lane8::Mask operator<(Lane8 a, Lane8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+	inline Lane8::Mask operator>(Lane8 a, Lane8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+	inline Lane8::Mask operator<=(Lane8 a, Lane8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ) }; }
+	inline Lane8::Mask operator>=(Lane8 a, Lane8 b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ) }; }
+	inline Lane8::Mask operator&(Lane8::Mask a, Lane8::Mask b) { return { _mm256_and_ps(a.v, b.v) }; }
+	inline Lane8::Mask operator|(Lane8::Mask a, Lane8::Mask b) { return { _mm256_or_ps(a.v, b.v) }; }
+	inline Lane8 Min(Lane8 a, Lane8 b) { return _mm256_min_ps(a.v, b.v); }
+	inline Lane8 Max(Lane8 a, Lane8 b) { return _mm256_max_ps(a.v, b.v); }
+	inline Lane8 Sqrt(Lane8 a) { return _mm256_sqrt_ps(a.v); }
+	inline Lane8 Select(Lane8::Mask mask, Lane8 a, Lane8 b) { return _mm256_blendv_ps(b.v, a.v, mask.v); }
+	inline int MaskBits(Lane8::Mask mask) { return _mm256_movemask_ps(mask.v); }
+
+	using PacketLane = Lane8;
+#elif defined(RAY_PACKET_SSE)
+	struct Lane4
+	{
+	public:
+		static constexpr int kWidth = 4;
+
+		struct Mask
+		{
+			__m128 v;
+		};
+	public:
+		Lane4(__m128 x) : v(x) {}
+		Lane4(float x) : v(_mm_set1_ps(x)) {}
+
+		static inline Lane4 Load(const float* data) { return _mm_load_ps(data); }
+		inline void Store(float* data) const { _mm_store_ps(data, v); }
+	public:
+		__m128 v;
+	};
+
+	inline Lane4 operator+(Lane4 a, Lane4 b) { return _mm_add_ps(a.v, b.v); }
+	inline Lane4 operator-(Lane4 a, Lane4 b) { return _mm_sub_ps(a.v, b.v); }
+	inline Lane4 operator*(Lane4 a, Lane4 b) { return _mm_mul_ps(a.v, b.v); }
+	inline Lane4 operator/(Lane4 a, Lane4 b) { return _mm_div_ps(a.v, b.v); }
+	inline Lane4::Mask operator<(Lane4 a, Lane4 b) { return { _mm_cmplt_ps(a.v, b.v) }; }
+	inline Lane4::Mask operator>(Lane4 a, Lane4 b) { return { _mm_cmpgt_ps(a.v, b.v) }; }
+	inline Lane4::Mask operator<=(Lane4 a, Lane4 b) { return { _mm_cmple_ps(a.v, b.v) }; }
+	inline Lane4::Mask operator>=(Lane4 a, Lane4 b) { return { _mm_cmpge_ps(a.v, b.v) }; }
+	inline Lane4::Mask operator&(Lane4::Mask a, Lane4::Mask b) { return { _mm_and_ps(a.v, b.v) }; }
+	inline Lane4::Mask operator|(Lane4::Mask a, Lane4::Mask b) { return { _mm_or_ps(a.v, b.v) }; }
+	inline Lane4 Min(Lane4 a, Lane4 b) { return _mm_min_ps(a.v, b.v); }
+	inline Lane4 Max(Lane4 a, Lane4 b) { return _mm_max_ps(a.v, b.v); }
+	inline Lane4 Sqrt(Lane4 a) { return _mm_sqrt_ps(a.v); }
+	inline Lane4 Select(Lane4::Mask mask, Lane4 a, Lane4 b) { return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v)); }
+	inline int MaskBits(Lane4::Mask mask) { return _mm_movemask_ps(mask.v); }
+
+	using PacketLane = Lane4;
+#else
+	using PacketLane = Lane1;
+#endif
+
+	/// <summary>
+	/// Stores the primitive index into every lane set in the mask.
+	/// </summary>
+	inline void StorePrimitive(int* primitives, int bits, int primitive)
+	{
+		for (; bits != 0; bits &= bits - 1)
+		{
+			int lane = 0;
+			while (((bits >> lane) & 1) == 0)
+				++lane;
+			primitives[lane] = primitive;
+		}
+	}
+
+	template<typename V>
+	int IntersectTrianglesT(const RayPacket& rays, const PacketTriangle* triangles, int count, PacketHit& hit)
+	{
+		int changed = 0;
+		for (int lane = 0; lane < kRayPacketWidth; lane += V::kWidth)
+		{
+			const V ox = V::Load(rays.mOriginX + lane);
+			const V oy = V::Load(rays.mOriginY + lane);
+			const V oz = V::Load(rays.mOriginZ + lane);
+			const V dx = V::Load(rays.mDirectionX + lane);
+			const V dy = V::Load(rays.mDirectionY + lane);
+			const V dz = V::Load(rays.mDirectionZ + lane);
+
+			V hitT = V::Load(hit.mT + lane);
+			V hitU = V::Load(hit.mU + lane);
+			V hitV = V::Load(hit.mV + lane);
+
+			for (int i = 0; i < count; ++i)
+			{
+				const PacketTriangle& tri = triangles[i];
+				const V e1x(tri.mEdge1.x), e1y(tri.mEdge1.y), e1z(tri.mEdge1.z);
+				const V e2x(tri.mEdge2.x), e2y(tri.mEdge2.y), e2z(tri.mEdge2.z);
+
+				// h = cross(d, e2)
+				const V hx = dy * e2z - dz * e2y;
+				const V hy = dz * e2x - dx * e2z;
+				const V hz = dx * e2y - dy * e2x;
+
+				const V a = e1x * hx + e1y * hy + e1z * hz;
+				typename V::Mask valid = (a <= V(-1e-6f)) | (a >= V(1e-6f));
+
+				const V f = V(1.0f) / a;
+				const V sx = ox - V(tri.mVertex0.x);
+				const V sy = oy - V(tri.mVertex0.y);
+				const V sz = oz - V(tri.mVertex0.z);
+
+				const V u = f * (sx * hx + sy * hy + sz * hz);
+				valid = valid & (u >= V(0.0f)) & (u <= V(1.0f));
+
+				// q = cross(s, e1)
+				const V qx = sy * e1z - sz * e1y;
+				const V qy = sz * e1x - sx * e1z;
+				const V qz = sx * e1y - sy * e1x;
+
+				const V v = f * (dx * qx + dy * qy + dz * qz);
+				valid = valid & (v >= V(0.0f)) & (u + v <= V(1.0f));
+
+				const V t = f * (e2x * qx + e2y * qy + e2z * qz);
+				valid = valid & (t > V(1e-6f)) & (t < hitT);
+
+				const int bits = MaskBits(valid);
+				if (bits == 0)
+					continue;
+
+				hitT = Select(valid, t, hitT);
+				hitU = Select(valid, u, hitU);
+				hitV = Select(valid, v, hitV);
+				StorePrimitive(hit.mPrimitive + lane, bits, i);
+				changed |= bits << lane;
+			}
+
+			hitT.Store(hit.mT + lane);
+			hitU.Store(hit.mU + lane);
+			hitV.Store(hit.mV + lane);
+		}
+		return changed;
+	}
+
+	template<typename V>
+	int IntersectSpheresT(const RayPacket& rays, const PacketSphere* spheres, int count, PacketHit& hit)
+	{
+		int changed = 0;
+		for (int lane = 0; lane < kRayPacketWidth; lane += V::kWidth)
+		{
+			const V ox = V::Load(rays.mOriginX + lane);
+			const V oy = V::Load(rays.mOriginY + lane);
+			const V oz = V::Load(rays.mOriginZ + lane);
+			const V dx = V::Load(rays.mDirectionX + lane);
+			const V dy = V::Load(rays.mDirectionY + lane);
+			const V dz = V::Load(rays.mDirectionZ + lane);
+
+			const V a = dx * dx + dy * dy + dz * dz;
+			const V invTwoA = V(0.5f) / a;
+
+			V hitT = V::Load(hit.mT + lane);
+
+			for (int i = 0; i < count; ++i)
+			{
+				const PacketSphere& sphere = spheres[i];
+
+				const V ocx = ox - V(sphere.mCenter.x);
+				const V ocy = oy - V(sphere.mCenter.y);
+				const V ocz = oz - V(sphere.mCenter.z);
+
+				const V b = V(2.0f) * (ocx * dx + ocy * dy + ocz * dz);
+				const V c = ocx * ocx + ocy * ocy + ocz * ocz - V(sphere.mRadius * sphere.mRadius);
+				const V discriminant = b * b - V(4.0f) * a * c;
+				typename V::Mask valid = discriminant >= V(0.0f);
+
+				// Use the closest valid intersection
+				const V sqrtD = Sqrt(Max(discriminant, V(0.0f)));
+				const V t1 = (V(0.0f) - b - sqrtD) * invTwoA;
+				const V t2 = (V(0.0f) - b + sqrtD) * invTwoA;
+				const V t = Select(t1 > V(0.0f), t1, t2);
+				valid = valid & (t > V(0.0f)) & (t < hitT);
+
+				const int bits = MaskBits(valid);
+				if (bits == 0)
+					continue;
+
+				hitT = Select(valid, t, hitT);
+				StorePrimitive(hit.mPrimitive + lane, bits, i);
+				changed |= bits << lane;
+			}
+
+			hitT.Store(hit.mT + lane);
+		}
+		return changed;
+	}
+
+	template<typename V>
+	void IntersectBoxesT(const RayPacket& rays, const PacketBox* boxes, int count, const PacketHit& hit, uint8_t* laneMasks)
+	{
+		for (int i = 0; i < count; ++i)
+			laneMasks[i] = 0;
+
+		for (int lane = 0; lane < kRayPacketWidth; lane += V::kWidth)
+		{
+			const V ox = V::Load(rays.mOriginX + lane);
+			const V oy = V::Load(rays.mOriginY + lane);
+			const V oz = V::Load(rays.mOriginZ + lane);
+			const V ix = V::Load(rays.mInvDirectionX + lane);
+			const V iy = V::Load(rays.mInvDirectionY + lane);
+			const V iz = V::Load(rays.mInvDirectionZ + lane);
+			const V hitT = V::Load(hit.mT + lane);
+
+			for (int i = 0; i < count; ++i)
+			{
+				const PacketBox& box = boxes[i];
+
+				// Slab test against the three axis aligned plane pairs
+				const V t0x = (V(box.mMin.x) - ox) * ix;
+				const V t0y = (V(box.mMin.y) - oy) * iy;
+				const V t0z = (V(box.mMin.z) - oz) * iz;
+				const V t1x = (V(box.mMax.x) - ox) * ix;
+				const V t1y = (V(box.mMax.y) - oy) * iy;
+				const V t1z = (V(box.mMax.z) - oz) * iz;
+
+				const V tEnter = Max(Max(Min(t0x, t1x), Min(t0y, t1y)), Min(t0z, t1z));
+				const V tExit = Min(Min(Max(t0x, t1x), Max(t0y, t1y)), Max(t0z, t1z));
+
+				const typename V::Mask valid = (tExit >= Max(tEnter, V(0.0f))) & (tEnter < hitT);
+				laneMasks[i] |= static_cast<uint8_t>(MaskBits(valid) << lane);
+			}
+		}
+	}
+}
+
+namespace RayPacketMath
+{
+	const char* GetInstructionSet()
+	{
+#if defined(RAY_PACKET_AVX)
+		return "AVX";
+#elif defined(RAY_PACKET_SSE)
+		return "SSE";
+#else
+		return "Scalar";
+#endif
+	}
+
+	int IntersectTriangles(const RayPacket& rays, const PacketTriangle* triangles, int count, PacketHit& hit)
+	{
+		return IntersectTrianglesT<PacketLane>(rays, triangles, count, hit);
+	}
+
+	int IntersectSpheres(const RayPacket& rays, const PacketSphere* spheres, int count, PacketHit& hit)
+	{
+		return IntersectSpheresT<PacketLane>(rays, spheres, count, hit);
+	}
+
+	void IntersectBoxes(const RayPacket& rays, const PacketBox* boxes, int count, const PacketHit& hit, uint8_t* laneMasks)
+	{
+		IntersectBoxesT<PacketLane>(rays, boxes, count, hit, laneMasks);
+	}
+
+	namespace Scalar
+	{
+		int IntersectTriangles(const RayPacket& rays, const PacketTriangle* triangles, int count, PacketHit& hit)
+		{
+			return IntersectTrianglesT<Lane1>(rays, triangles, count, hit);
+		}
+
+		int IntersectSpheres(const RayPacket& rays, const PacketSphere* spheres, int count, PacketHit& hit)
+		{
+			return IntersectSpheresT<Lane1>(rays, spheres, count, hit);
+		}
+
+		void IntersectBoxes(const RayPacket& rays, const PacketBox* boxes, int count, const PacketHit& hit, uint8_t* laneMasks)
+		{
+			IntersectBoxesT<Lane1>(rays, boxes, count, hit, laneMasks);
+		}
+	}
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include "CpuMath.h"
+
+#include <cstdint>
+
+/// <summary>
+/// Number of rays traced together by the packet intersection routines.
+/// </summary>
+constexpr int kRayPacketWidth = 8;
+
+/// <summary>
+/// Packet of rays stored as structure of arrays, one lane per ray.
+/// </summary>
+struct alignas(32) RayPacket
+{
+public:
+	/// <summary>
+	/// Sets a single lane of the packet, precomputing its inverse direction.
+	/// </summary>
+	/// <param name="lane">The lane index</param>
+	/// <param name="origin">The ray origin</param>
+	/// <param name="direction">The ray direction</param>
+	void SetRay(int lane, const Float3& origin, const Float3& direction);
+public:
+	float mOriginX[kRayPacketWidth];
+	float mOriginY[kRayPacketWidth];
+	float mOriginZ[kRayPacketWidth];
+	float mDirectionX[kRayPacketWidth];
+	float mDirectionY[kRayPacketWidth];
+	float mDirectionZ[kRayPacketWidth];
+	float mInvDirectionX[kRayPacketWidth];
+	float mInvDirectionY[kRayPacketWidth];
+	float mInvDirectionZ[kRayPacketWidth];
+};
+
+/// <summary>
+/// Closest hit record of every lane of a RayPacket.
+/// </summary>
+struct alignas(32) PacketHit
+{
+public:
+	/// <summary>
+	/// Resets every lane to a miss limited to the passed distance.
+	/// </summary>
+	/// <param name="tMax">The maximum hit distance</param>
+	void Reset(float tMax = 1e20f);
+public:
+	float mT[kRayPacketWidth];
+	float mU[kRayPacketWidth];
+	float mV[kRayPacketWidth];
+	int mPrimitive[kRayPacketWidth];
+};
+
+/// <summary>
+/// Triangle with precomputed edges for Moller-Trumbore.
+/// </summary>
+struct PacketTriangle
+{
+	Float3 mVertex0;
+	Float3 mEdge1;
+	Float3 mEdge2;
+};
+
+struct PacketSphere
+{
+	Float3 mCenter;
+	float mRadius = 1.0f;
+};
+
+struct PacketBox
+{
+	Float3 mMin;
+	Float3 mMax;
+};
+
+/// <summary>
+/// Host side ray packet intersection routines.
+/// Each routine tests every lane of the packet against a batch of primitives, using AVX (one 8 wide register),
+/// SSE (two 4 wide registers) or plain scalar code depending on the instruction set the library is compiled for.
+/// The Scalar namespace provides the lane by lane reference implementation of the same tests.
+/// </summary>
+namespace RayPacketMath
+{
+	/// <summary>
+	/// Retrieves the instruction set the packet routines were compiled for.
+	/// </summary>
+	/// <returns>"AVX", "SSE" or "Scalar"</returns>
+	const char* GetInstructionSet();
+
+	/// <summary>
+	/// Intersects the packet with a batch of triangles, updating the closest hits.
+	/// The test matches ray_triangle_intersect of the trace kernels (no backface culling).
+	/// </summary>
+	/// <param name="rays">The ray packet</param>
+	/// <param name="triangles">The triangles</param>
+	/// <param name="count">The triangle count</param>
+	/// <param name="hit">The closest hits, primitive indices refer to the passed batch</param>
+	/// <returns>The bit mask of the lanes whose closest hit changed</returns>
+	int IntersectTriangles(const RayPacket& rays, const PacketTriangle* triangles, int count, PacketHit& hit);
+
+	/// <summary>
+	/// Intersects the packet with a batch of spheres, updating the closest hits.
+	/// </summary>
+	/// <param name="rays">The ray packet</param>
+	/// <param name="spheres">The spheres</param>
+	/// <param name="count">The sphere count</param>
+	/// <param name="hit">The closest hits, primitive indices refer to the passed batch</param>
+	/// <returns>The bit mask of the lanes whose closest hit changed</returns>
+	int IntersectSpheres(const RayPacket& rays, const PacketSphere* spheres, int count, PacketHit& hit);
+
+	/// <summary>
+	/// Slab tests the packet against a batch of boxes, limited to the current closest hits.
+	/// </summary>
+	/// <param name="rays">The ray packet</param>
+	/// <param name="boxes">The boxes</param>
+	/// <param name="count">The box count</param>
+	/// <param name="hit">The current closest hits</param>
+	/// <param name="laneMasks">The output bit mask of the hitting lanes per box</param>
+	void IntersectBoxes(const RayPacket& rays, const PacketBox* boxes, int count, const PacketHit& hit, uint8_t* laneMasks);
+
+	namespace Scalar
+	{
+		int IntersectTriangles(const RayPacket& rays, const PacketTriangle* triangles, int count, PacketHit& hit);
+
+		int IntersectSpheres(const RayPacket& rays, const PacketSphere* spheres, int count, PacketHit& hit);
+
+		void IntersectBoxes(const RayPacket& rays, const PacketBox* boxes, int count, const PacketHit& hit, uint8_t* laneMasks);
+	}
+}
@@ -0,0 +1,31 @@
+#include "RenderBackend.h"
+
+#include "OpenCLUtils.h"
+
+#include <iostream>
+
+RenderBackend SelectRenderBackend(const CommandLine& commandLine)
+{
+	const std::string backend = commandLine.GetString("backend", "opencl");
+	if (backend == "cpu")
+		return RenderBackend::Cpu;
+
+	if (!OpenCLUtils::is_runtime_available())
+	{
+		std::cout << "No OpenCL runtime available, falling back to the CPU backend" << std::endl;
+		return RenderBackend::Cpu;
+	}
+	return RenderBackend::OpenCL;
+}
+
+const char* ToString(RenderBackend backend)
+{
+	switch (backend)
+	{
+		case RenderBackend::OpenCL:
+			return "OpenCL";
+		case RenderBackend::Cpu:
+			return "CPU";
+	}
+	return "Unknown";
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "CommandLine.h"
+
+enum class RenderBackend
+{
+	OpenCL,
+	Cpu
+};
+
+/// <summary>
+/// Selects the rendering backend from the "--backend opencl|cpu" argument.
+/// Falls back to the native CPU backend when no OpenCL runtime or platform is available.
+/// </summary>
+/// <param name="commandLine">The command line</param>
+/// <returns>The selected backend</returns>
+RenderBackend SelectRenderBackend(const CommandLine& commandLine);
+
+/// <summary>
+/// Retrieves the display name of the backend.
+/// </summary>
+/// <param name="backend">The backend</param>
+/// <returns>The display name</returns>
+const char* ToString(RenderBackend backend);
@@ -0,0 +1,44 @@
+#include "RenderSettings.h"
+
+#include <cstdio>
+#include <iostream>
+
+namespace
+{
+	Float3 ParseFloat3(const CommandLine& commandLine, const std::string& name, const Float3& defaultValue)
+	{
+		if (!commandLine.Has(name))
+			return defaultValue;
+
+		Float3 value;
+		const std::string text = commandLine.GetString(name);
+		if (std::sscanf(text.c_str(), "%f,%f,%f", &value.x, &value.y, &value.z) != 3)
+		{
+			std::cout << "Invalid --" << name << " '" << text << "', expected x,y,z" << std::endl;
+			return defaultValue;
+		}
+		return value;
+	}
+}
+
+RenderSettings ParseRenderSettings(const CommandLine& commandLine, const RenderSettings& defaults)
+{
+	RenderSettings settings = defaults;
+	settings.mHeadless = defaults.mHeadless || commandLine.Has("headless");
+	settings.mWidth = std::max(1, commandLine.GetInt("width", defaults.mWidth));
+	settings.mHeight = std::max(1, commandLine.GetInt("height", defaults.mHeight));
+	settings.mSamples = std::max(1, commandLine.GetInt("samples", defaults.mSamples));
+	settings.mAccumulate = defaults.mAccumulate && !commandLine.Has("no-accumulate");
+	settings.mMaxSamples = std::max(0, commandLine.GetInt("max-samples", defaults.mMaxSamples));
+
+	// A headless render has no window to close, so it renders a single frame unless told otherwise
+	settings.mFrames = std::max(0, commandLine.GetInt("frames", defaults.mFrames));
+	if (settings.mHeadless && settings.mFrames == 0)
+		settings.mFrames = 1;
+
+	settings.mOutputPath = commandLine.GetString("output", defaults.mOutputPath);
+	settings.mCameraPosition = ParseFloat3(commandLine, "camera-pos", defaults.mCameraPosition);
+	settings.mCameraDirection = ParseFloat3(commandLine, "camera-dir", defaults.mCameraDirection);
+	settings.mFov = commandLine.GetFloat("fov", defaults.mFov);
+	return settings;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "CommandLine.h"
+#include "CpuMath.h"
+
+#include <string>
+
+/// <summary>
+/// Resolution, sampling, camera and output configuration of a render.
+/// </summary>
+struct RenderSettings
+{
+	int mWidth = 1280;
+	int mHeight = 720;
+
+	// Jittered stratified samples per pixel and frame
+	int mSamples = 1;
+
+	// Adds the samples of every frame to a running average until the scene changes
+	bool mAccumulate = true;
+
+	// Samples per pixel after which an unchanged image stops refining, 0 refines forever
+	int mMaxSamples = 1024;
+
+	// Frames to render, 0 renders until the window is closed
+	int mFrames = 0;
+
+	// Renders without creating a window or event loop
+	bool mHeadless = false;
+
+	// Image path written every frame, numbered when rendering more than one frame
+	std::string mOutputPath;
+
+	Float3 mCameraPosition = { 0.0f, 0.0f, 10.0f };
+	Float3 mCameraDirection = { 0.0f, 0.0f, -1.0f };
+	float mFov = 60.0f;
+};
+
+/// <summary>
+/// Parses the render settings from the command line.
+/// Supported arguments: --width, --height, --samples, --no-accumulate, --max-samples, --frames, --headless, --output, 
+/// --camera-pos x,y,z, --camera-dir x,y,z and --fov.
+/// </summary>
+/// <param name="commandLine">The command line</param>
+/// <param name="defaults">The settings used for arguments that were not passed</param>
+/// <returns>The render settings</returns>
+RenderSettings ParseRenderSettings(const CommandLine& commandLine, const RenderSettings& defaults);
@@ -0,0 +1,41 @@
+#include "SceneChangeTracker.h"
+
+namespace
+{
+	/// <summary>
+	/// FNV-1a hash of the data.
+	/// </summary>
+	uint64_t HashBytes(const void* data, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(data);
+
+		uint64_t hash = 14695981039346656037ull;
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+		return hash;
+	}
+
+	size_t GetChangeIndex(SceneChange change)
+	{
+		size_t index = 0;
+		for (uint32_t bits = static_cast<uint32_t>(change); bits > 1; bits >>= 1)
+			++index;
+		return index;
+	}
+}
+
+void SceneChangeTracker::Track(SceneChange change, const void* data, size_t size)
+{
+	// The size is hashed too, so resizing the data always counts as a change
+	const uint64_t hash = HashBytes(data, size) ^ (size * 0x9E3779B97F4A7C15ull);
+
+	const size_t index = GetChangeIndex(change);
+	if (mTracked[index] && mHashes[index] != hash)
+		Mark(change);
+
+	mHashes[index] = hash;
+	mTracked[index] = true;
+}
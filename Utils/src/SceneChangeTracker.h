@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/// <summary>
+/// Categories of scene state that invalidate the rendered frame.
+/// </summary>
+enum class SceneChange : uint32_t
+{
+	Camera		= 1 << 0,
+	Lights		= 1 << 1,
+	Materials	= 1 << 2,
+	Geometry	= 1 << 3
+};
+
+/// <summary>
+/// Tracks changes of the scene state between frames, so unchanged frames are reused instead of re-rendered.
+/// Small scene data is compared by content hash every frame, while edits of large data, like a camera
+/// move or a mesh edit, are marked explicitly by the code making them.
+/// </summary>
+class SceneChangeTracker
+{
+public:
+	/// <summary>
+	/// Marks the scene state as changed.
+	/// </summary>
+	/// <param name="change">The changed state</param>
+	inline void Mark(SceneChange change) { mDirty |= static_cast<uint32_t>(change); }
+
+	/// <summary>
+	/// Compares the data against its content at the previous call and marks the state as changed on a difference.
+	/// The first call only records the content, as the data is expected to be uploaded already.
+	/// </summary>
+	/// <param name="change">The state the data belongs to</param>
+	/// <param name="data">The data</param>
+	/// <param name="size">The data size in bytes</param>
+	void Track(SceneChange change, const void* data, size_t size);
+
+	template<typename T>
+	inline void Track(SceneChange change, const std::vector<T>& data) { Track(change, data.data(), data.size() * sizeof(T)); }
+
+	/// <summary>
+	/// Checks whether the state changed since the last rendered frame.
+	/// </summary>
+	/// <param name="change">The state</param>
+	/// <returns>True if the state changed, otherwise false</returns>
+	inline bool IsDirty(SceneChange change) const { return (mDirty & static_cast<uint32_t>(change)) != 0; }
+
+	/// <summary>
+	/// Checks whether a frame has to be rendered, either because none was rendered yet or because the scene changed.
+	/// </summary>
+	/// <returns>True if a frame has to be rendered, otherwise false</returns>
+	inline bool NeedsRender() const { return !mFrameValid || mDirty != 0; }
+
+	/// <summary>
+	/// Invalidates the last frame without a scene change, e.g. after the render settings changed.
+	/// </summary>
+	inline void Invalidate() { mFrameValid = false; }
+
+	/// <summary>
+	/// Clears the changes once a frame with the current scene state was rendered.
+	/// </summary>
+	inline void FrameRendered() { mDirty = 0; mFrameValid = true; }
+private:
+	static constexpr size_t kChangeCount = 4;
+
+	uint32_t mDirty = 0;
+	bool mFrameValid = false;
+
+	uint64_t mHashes[kChangeCount] = {};
+	bool mTracked[kChangeCount] = {};
+};
@@ -0,0 +1,164 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace
+{
+	// Queue index of the current thread, 0 for threads that are not pool workers
+	thread_local uint32_t sQueueIndex = 0;
+	thread_local const ThreadPool* sOwner = nullptr;
+}
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+	: mQueuedCount(0),
+	mPendingCount(0),
+	mNextQueue(0),
+	mStopping(false)
+{
+	if (threadCount == 0)
+		threadCount = std::max(1u, std::thread::hardware_concurrency());
+
+	for (uint32_t i = 0; i < threadCount; ++i)
+		mQueues.emplace_back(std::make_unique<WorkQueue>());
+
+	for (uint32_t i = 1; i < threadCount; ++i)
+		mWorkers.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mStopping = true;
+	}
+	mWakeCondition.notify_all();
+
+	for (std::thread& worker : mWorkers)
+		worker.join();
+}
+
+void ThreadPool::Submit(Task task)
+{
+	mPendingCount++;
+	Push([this, task = std::move(task)]()
+	{
+		task();
+		mPendingCount--;
+	});
+}
+
+void ThreadPool::Wait()
+{
+	HelpUntilZero(mPendingCount);
+}
+
+void ThreadPool::ParallelFor(int begin, int end, int grainSize, const std::function<void(int, int)>& func)
+{
+	if (begin >= end)
+		return;
+
+	grainSize = std::max(1, grainSize);
+	if (end - begin <= grainSize || GetThreadCount() == 1)
+	{
+		func(begin, end);
+		return;
+	}
+
+	std::atomic<int> remaining(0);
+	for (int chunkBegin = begin + grainSize; chunkBegin < end; chunkBegin += grainSize)
+	{
+		const int chunkEnd = std::min(end, chunkBegin + grainSize);
+
+		remaining++;
+		Push([&func, &remaining, chunkBegin, chunkEnd]()
+		{
+			func(chunkBegin, chunkEnd);
+			remaining--;
+		});
+	}
+
+	// The calling thread takes the first chunk itself
+	func(begin, std::min(end, begin + grainSize));
+
+	HelpUntilZero(remaining);
+}
+
+void ThreadPool::Push(Task task)
+{
+	uint32_t index = sQueueIndex;
+	if (sOwner != this)
+		index = mNextQueue++ % GetThreadCount();
+
+	{
+		std::lock_guard<std::mutex> lock(mQueues[index]->mMutex);
+		mQueues[index]->mTasks.emplace_back(std::move(task));
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mWakeMutex);
+		mQueuedCount++;
+	}
+	mWakeCondition.notify_one();
+}
+
+bool ThreadPool::TryRunTask()
+{
+	const uint32_t queueCount = GetThreadCount();
+	const uint32_t ownIndex = sOwner == this ? sQueueIndex : 0;
+
+	Task task;
+	for (uint32_t i = 0; i < queueCount && !task; ++i)
+	{
+		const uint32_t index = (ownIndex + i) % queueCount;
+		WorkQueue& queue = *mQueues[index];
+
+		std::lock_guard<std::mutex> lock(queue.mMutex);
+		if (queue.mTasks.empty())
+			continue;
+
+		// Newest work from the own queue keeps caches warm, oldest work from others are the largest chunks
+		if (i == 0)
+		{
+			task = std::move(queue.mTasks.back());
+			queue.mTasks.pop_back();
+		}
+		else
+		{
+			task = std::move(queue.mTasks.front());
+			queue.mTasks.pop_front();
+		}
+	}
+
+	if (!task)
+		return false;
+
+	mQueuedCount--;
+	task();
+	return true;
+}
+
+void ThreadPool::HelpUntilZero(const std::atomic<int>& counter)
+{
+	while (counter > 0)
+	{
+		if (!TryRunTask())
+			std::this_thread::yield();
+	}
+}
+
+void ThreadPool::WorkerLoop(uint32_t index)
+{
+	sQueueIndex = index;
+	sOwner = this;
+
+	while (true)
+	{
+		if (TryRunTask())
+			continue;
+
+		std::unique_lock<std::mutex> lock(mWakeMutex);
+		mWakeCondition.wait(lock, [this]() { return mStopping || mQueuedCount > 0; });
+		if (mStopping)
+			return;
+	}
+}
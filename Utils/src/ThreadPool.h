@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Work stealing thread pool.
+/// Each thread owns a task queue, popping its own newest tasks first and stealing the
+/// oldest tasks of other threads when it runs dry. The thread calling Wait or ParallelFor
+/// participates in executing tasks, so a pool of N threads spawns N - 1 workers.
+/// </summary>
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+public:
+	/// <summary>
+	/// Constructor initializing a ThreadPool.
+	/// </summary>
+	/// <param name="threadCount">The total thread count including the calling thread, 0 uses all hardware threads</param>
+	ThreadPool(uint32_t threadCount = 0);
+
+	/// <summary>
+	/// Destructor stopping and joining the worker threads.
+	/// </summary>
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+public:
+	/// <summary>
+	/// Retrieves the total thread count including the calling thread.
+	/// </summary>
+	/// <returns>The thread count</returns>
+	inline uint32_t GetThreadCount() const { return static_cast<uint32_t>(mQueues.size()); }
+
+	/// <summary>
+	/// Submits a task. Tasks submitted from a worker are queued on that worker's own queue.
+	/// </summary>
+	/// <param name="task">The task to execute</param>
+	void Submit(Task task);
+
+	/// <summary>
+	/// Executes tasks on the calling thread until every submitted task has completed.
+	/// </summary>
+	void Wait();
+
+	/// <summary>
+	/// Splits the range into chunks of grainSize and executes them across the pool, 
+	/// returning once every chunk has completed.
+	/// </summary>
+	/// <param name="begin">The range begin</param>
+	/// <param name="end">The range end (exclusive)</param>
+	/// <param name="grainSize">The chunk size</param>
+	/// <param name="func">The chunk function receiving the chunk begin and end</param>
+	void ParallelFor(int begin, int end, int grainSize, const std::function<void(int, int)>& func);
+private:
+	struct WorkQueue
+	{
+		std::mutex mMutex;
+		std::deque<Task> mTasks;
+	};
+
+	void Push(Task task);
+	bool TryRunTask();
+	void HelpUntilZero(const std::atomic<int>& counter);
+	void WorkerLoop(uint32_t index);
+private:
+	std::vector<std::unique_ptr<WorkQueue>> mQueues;
+	std::vector<std::thread> mWorkers;
+
+	std::atomic<int> mQueuedCount;
+	std::atomic<int> mPendingCount;
+	std::atomic<uint32_t> mNextQueue;
+	std::atomic<bool> mStopping;
+
+	std::mutex mWakeMutex;
+	std::condition_variable mWakeCondition;
+};
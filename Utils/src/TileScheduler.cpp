@@ -0,0 +1,169 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+namespace
+{
+	const TileOrder kTileOrders[] = { TileOrder::Scanline, TileOrder::Morton, TileOrder::CenterOut };
+
+	// Interleaves the bits of the tile coordinates, x in the even bits
+	uint32_t MortonCode(uint32_t x, uint32_t y)
+	{
+		uint32_t code = 0;
+		for (uint32_t bit = 0; bit < 16; ++bit)
+			code |= ((x >> bit) & 1u) << (2 * bit) | ((y >> bit) & 1u) << (2 * bit + 1);
+		return code;
+	}
+}
+
+TileScheduler::TileScheduler(int width, int height, int tileSize, TileOrder order)
+{
+	tileSize = std::max(1, tileSize);
+	const int tilesX = (width + tileSize - 1) / tileSize;
+	const int tilesY = (height + tileSize - 1) / tileSize;
+
+	std::vector<uint64_t> keys;
+	for (int ty = 0; ty < tilesY; ++ty)
+	{
+		for (int tx = 0; tx < tilesX; ++tx)
+		{
+			Tile tile;
+			tile.mRegion.mX = tx * tileSize;
+			tile.mRegion.mY = ty * tileSize;
+			tile.mRegion.mWidth = std::min(tileSize, width - tile.mRegion.mX);
+			tile.mRegion.mHeight = std::min(tileSize, height - tile.mRegion.mY);
+
+			uint64_t key = static_cast<uint64_t>(mTiles.size());
+			if (order == TileOrder::Morton)
+			{
+				key = MortonCode(tx, ty);
+			}
+			else if (order == TileOrder::CenterOut)
+			{
+				// Doubled coordinates keep the squared distance of the tile centers integral
+				const int64_t dx = 2 * tile.mRegion.mX + tile.mRegion.mWidth - width;
+				const int64_t dy = 2 * tile.mRegion.mY + tile.mRegion.mHeight - height;
+				key = static_cast<uint64_t>(dx * dx + dy * dy);
+			}
+
+			keys.push_back(key);
+			mTiles.push_back(tile);
+		}
+	}
+
+	std::vector<int> renderOrder(mTiles.size());
+	for (size_t i = 0; i < renderOrder.size(); ++i)
+		renderOrder[i] = static_cast<int>(i);
+	std::stable_sort(renderOrder.begin(), renderOrder.end(), [&keys](int a, int b) { return keys[a] < keys[b]; });
+
+	std::vector<Tile> sorted;
+	sorted.reserve(mTiles.size());
+	for (int index : renderOrder)
+		sorted.push_back(mTiles[index]);
+	mTiles.swap(sorted);
+}
+
+void TileScheduler::SetRegionOfInterest(const TileRegion& region)
+{
+	mRegionOfInterest = region;
+}
+
+void TileScheduler::Invalidate()
+{
+	for (Tile& tile : mTiles)
+		tile.mSamples = 0;
+}
+
+void TileScheduler::InvalidateRegionOfInterest()
+{
+	for (int i = 0; i < GetTileCount(); ++i)
+	{
+		if (IsOfInterest(i))
+			mTiles[i].mSamples = 0;
+	}
+}
+
+const std::vector<int>& TileScheduler::BeginFrame()
+{
+	mFrameTiles.clear();
+	for (int i = 0; i < GetTileCount(); ++i)
+	{
+		if (mTiles[i].mSamples == 0 || IsOfInterest(i))
+			mFrameTiles.push_back(i);
+	}
+	return mFrameTiles;
+}
+
+void TileScheduler::EndFrame(int samples)
+{
+	for (int index : mFrameTiles)
+		mTiles[index].mSamples += samples;
+	mFrameTiles.clear();
+}
+
+int TileScheduler::GetAccumulatedSamples() const
+{
+	int samples = -1;
+	for (int i = 0; i < GetTileCount(); ++i)
+	{
+		if (IsOfInterest(i) && (samples < 0 || mTiles[i].mSamples < samples))
+			samples = mTiles[i].mSamples;
+	}
+	return std::max(0, samples);
+}
+
+bool TileScheduler::IsOfInterest(int index) const
+{
+	return mRegionOfInterest.IsEmpty() || mRegionOfInterest.Overlaps(mTiles[index].mRegion);
+}
+
+TileSettings ParseTileSettings(const CommandLine& commandLine)
+{
+	TileSettings settings;
+	settings.mTileSize = std::max(0, commandLine.GetInt("tile-size", 0));
+
+	if (commandLine.Has("tile-order"))
+	{
+		const std::string name = commandLine.GetString("tile-order");
+		bool found = false;
+		for (TileOrder order : kTileOrders)
+		{
+			if (name == ToString(order))
+			{
+				settings.mOrder = order;
+				found = true;
+			}
+		}
+
+		if (!found)
+			std::cout << "Unknown tile order '" << name << "', using " << ToString(settings.mOrder) << std::endl;
+	}
+
+	if (commandLine.Has("roi"))
+	{
+		TileRegion region;
+		const std::string text = commandLine.GetString("roi");
+		if (std::sscanf(text.c_str(), "%d,%d,%d,%d", &region.mX, &region.mY, &region.mWidth, &region.mHeight) == 4)
+			settings.mRegionOfInterest = region;
+		else
+			std::cout << "Invalid --roi '" << text << "', expected x,y,width,height" << std::endl;
+	}
+	return settings;
+}
+
+const char* ToString(TileOrder order)
+{
+	switch (order)
+	{
+		case TileOrder::Scanline:
+			return "scanline";
+		case TileOrder::Morton:
+			return "morton";
+		case TileOrder::CenterOut:
+			return "center-out";
+	}
+	return "unknown";
+}
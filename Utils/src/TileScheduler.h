@@ -0,0 +1,145 @@
+#pragma once
+
+#include "CommandLine.h"
+
+#include <vector>
+
+/// <summary>
+/// Order the tiles of a frame are dispatched in.
+/// </summary>
+enum class TileOrder
+{
+	Scanline,
+
+	// Z-order curve, consecutive tiles stay close in both axes
+	Morton,
+
+	// Closest to the image center first, where the viewer looks
+	CenterOut
+};
+
+/// <summary>
+/// Pixel rectangle of the image.
+/// </summary>
+struct TileRegion
+{
+	int mX = 0;
+	int mY = 0;
+	int mWidth = 0;
+	int mHeight = 0;
+
+	inline bool IsEmpty() const { return mWidth <= 0 || mHeight <= 0; }
+
+	inline bool Overlaps(const TileRegion& other) const
+	{
+		return mX < other.mX + other.mWidth && other.mX < mX + mWidth &&
+			   mY < other.mY + other.mHeight && other.mY < mY + mHeight;
+	}
+};
+
+/// <summary>
+/// Tile rendering settings.
+/// </summary>
+struct TileSettings
+{
+	// Tile edge length in pixels, 0 dispatches the whole frame at once
+	int mTileSize = 0;
+	TileOrder mOrder = TileOrder::Scanline;
+
+	// Only the tiles overlapping the region are re-rendered once the whole image was rendered, empty for the whole image
+	TileRegion mRegionOfInterest;
+};
+
+/// <summary>
+/// Splits the image into tiles and selects the tiles every frame renders.
+/// Every tile keeps its own accumulated sample count, so a region of interest can be re-rendered and refined
+/// while the rest of the image keeps its samples.
+///
+/// Usage:
+///		for (int tile : scheduler.BeginFrame())
+///			Render(scheduler.GetTile(tile), scheduler.GetTileSamples(tile));
+///		scheduler.EndFrame(samples);
+/// </summary>
+class TileScheduler
+{
+public:
+	/// <summary>
+	/// Constructor initializing a TileScheduler.
+	/// </summary>
+	/// <param name="width">The image width</param>
+	/// <param name="height">The image height</param>
+	/// <param name="tileSize">The tile edge length in pixels, edge tiles are clipped to the image</param>
+	/// <param name="order">The order the tiles of a frame are rendered in</param>
+	TileScheduler(int width, int height, int tileSize, TileOrder order);
+public:
+	/// <summary>
+	/// Restricts the rendered tiles to those overlapping the region. Tiles without samples are still rendered,
+	/// so the rest of the image is completed first.
+	/// </summary>
+	/// <param name="region">The region of interest, an empty region selects the whole image</param>
+	void SetRegionOfInterest(const TileRegion& region);
+
+	/// <summary>
+	/// Drops the samples of every tile, e.g. after the camera moved.
+	/// </summary>
+	void Invalidate();
+
+	/// <summary>
+	/// Drops the samples of the tiles in the region of interest, e.g. after an edit only visible in the region.
+	/// </summary>
+	void InvalidateRegionOfInterest();
+
+	/// <summary>
+	/// Selects the tiles of the next frame: the tiles in the region of interest and every tile without samples.
+	/// </summary>
+	/// <returns>The tile indices in render order</returns>
+	const std::vector<int>& BeginFrame();
+
+	/// <summary>
+	/// Adds the samples to the tiles of the frame.
+	/// </summary>
+	/// <param name="samples">The samples per pixel rendered by the frame</param>
+	void EndFrame(int samples);
+
+	/// <summary>
+	/// Retrieves the accumulated samples of the least refined tile in the region of interest.
+	/// </summary>
+	/// <returns>The accumulated samples per pixel</returns>
+	int GetAccumulatedSamples() const;
+
+	inline const TileRegion& GetTile(int index) const { return mTiles[index].mRegion; }
+
+	inline int GetTileSamples(int index) const { return mTiles[index].mSamples; }
+
+	inline int GetTileCount() const { return static_cast<int>(mTiles.size()); }
+
+	inline bool HasRegionOfInterest() const { return !mRegionOfInterest.IsEmpty(); }
+private:
+	bool IsOfInterest(int index) const;
+private:
+	struct Tile
+	{
+		TileRegion mRegion;
+		int mSamples = 0;
+	};
+private:
+	// Sorted in render order
+	std::vector<Tile> mTiles;
+	std::vector<int> mFrameTiles;
+	TileRegion mRegionOfInterest;
+};
+
+/// <summary>
+/// Parses the tile settings from the command line.
+/// Supported arguments: --tile-size N, --tile-order scanline|morton|center-out and --roi x,y,width,height.
+/// </summary>
+/// <param name="commandLine">The command line</param>
+/// <returns>The tile settings</returns>
+TileSettings ParseTileSettings(const CommandLine& commandLine);
+
+/// <summary>
+/// Retrieves the display name of the order.
+/// </summary>
+/// <param name="order">The tile order</param>
+/// <returns>The display name</returns>
+const char* ToString(TileOrder order);
@@ -0,0 +1,50 @@
+include "dependencies.lua"
+
+project "UtilsTests"
+	kind "ConsoleApp"
+
+	language "C++"
+	cppdialect "C++20"
+
+	staticruntime "on"
+
+	targetdir ("%{wks.location}/Binaries/" .. outputdir .. "/%{prj.name}")
+	objdir ("%{wks.location}/Intermediates/" .. outputdir .. "/%{prj.name}")
+
+	files
+	{
+		"src/**.h",
+		"src/**.cpp"
+	}
+
+	includedirs
+	{
+		"src",
+		"../Utils/src",
+	}
+	
+	libdirs
+	{
+	}
+	
+	links
+	{
+		"Utils"
+	}
+
+	LinkOpenCL()
+	LinkOpenCV4()
+	
+	filter "system:windows"
+		systemversion "latest"
+		-- Delay load OpenCL, the tests only run host code
+		linkoptions { "/DELAYLOAD:OpenCL.dll" }
+		links { "delayimp" }
+	filter "options:avx2"
+		vectorextensions "AVX2"
+	filter "configurations:Debug"
+		symbols "On"
+	filter "configurations:Release"
+		optimize "On"
+	filter "configurations:Dist"
+		optimize "Full"
@@ -0,0 +1,105 @@
+#include "CpuMath.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	int sFailures = 0;
+
+	void Check(bool condition, const char* name, const std::string& detail)
+	{
+		if (condition)
+			return;
+
+		std::cout << "FAILED " << name << ": " << detail << std::endl;
+		++sFailures;
+	}
+
+	/// <summary>
+	/// The stratified sub pixel offsets have to cover the pixel evenly for any sample count, otherwise the resolved image is shifted.
+	/// </summary>
+	void TestStratifiedOffsetMean()
+	{
+		constexpr int kPixels = 20000;
+		for (int samples : { 1, 2, 3, 4, 5, 6, 7, 9, 16 })
+		{
+			double sumX = 0.0;
+			double sumY = 0.0;
+			for (int pixel = 0; pixel < kPixels; ++pixel)
+			{
+				for (int sample = 0; sample < samples; ++sample)
+				{
+					float dx = 0.0f;
+					float dy = 0.0f;
+					CpuMath::StratifiedOffset(sample, samples, CpuMath::SampleSeed(pixel, sample), true, dx, dy);
+					Check(dx >= 0.0f && dx < 1.0f && dy >= 0.0f && dy < 1.0f, "StratifiedOffset range", std::to_string(dx) + ", " + std::to_string(dy));
+					sumX += dx;
+					sumY += dy;
+				}
+			}
+
+			const double meanX = sumX / (static_cast<double>(kPixels) * samples);
+			const double meanY = sumY / (static_cast<double>(kPixels) * samples);
+			Check(std::abs(meanX - 0.5) < 0.01 && std::abs(meanY - 0.5) < 0.01, "StratifiedOffset mean",
+				  std::to_string(samples) + " samples: " + std::to_string(meanX) + ", " + std::to_string(meanY));
+		}
+	}
+
+	/// <summary>
+	/// Every column and row of the sample grid holds exactly one sample.
+	/// </summary>
+	void TestStratifiedOffsetRows()
+	{
+		const float jitterY = (CpuMath::HashUint(0) >> 16) / 65536.0f;
+		for (int samples = 1; samples <= 64; ++samples)
+		{
+			std::vector<int> rows(samples, 0);
+			for (int sample = 0; sample < samples; ++sample)
+			{
+				float dx = 0.0f;
+				float dy = 0.0f;
+				CpuMath::StratifiedOffset(sample, samples, 0, true, dx, dy);
+
+				// The jitter is the same for every sample of the seed, removing it leaves the row index
+				const int row = static_cast<int>(std::lround(dy * samples - jitterY));
+				rows[std::clamp(row, 0, samples - 1)]++;
+			}
+
+			for (int row = 0; row < samples; ++row)
+				Check(rows[row] == 1, "StratifiedOffset rows", std::to_string(samples) + " samples, row " + std::to_string(row));
+		}
+	}
+
+	/// <summary>
+	/// A single sample without accumulation traces the pixel centre, so --samples 1 keeps the unjittered image.
+	/// </summary>
+	void TestSingleSampleCentre()
+	{
+		for (uint32_t seed : { 0u, 1u, 12345u })
+		{
+			float dx = 0.0f;
+			float dy = 0.0f;
+			CpuMath::StratifiedOffset(0, 1, seed, false, dx, dy);
+			Check(dx == 0.5f && dy == 0.5f, "StratifiedOffset centre", std::to_string(dx) + ", " + std::to_string(dy));
+		}
+	}
+}
+
+int main()
+{
+	TestStratifiedOffsetMean();
+	TestStratifiedOffsetRows();
+	TestSingleSampleCentre();
+
+	if (sFailures > 0)
+	{
+		std::cout << sFailures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "All checks passed" << std::endl;
+	return 0;
+}
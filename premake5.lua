@@ -23,6 +23,12 @@ premake.override(premake.vstudio.vc2010.elements, "globals", function(base, prj)
 	return calls
 end)
 
+newoption
+{
+	trigger = "avx2",
+	description = "Compile the host code with AVX2, enabling the 8 wide ray packet routines"
+}
+
 workspace "GPU Ray Tracing"
 	architecture "x64"
 	configurations
@@ -40,6 +46,8 @@ group ""
 	include "SphereTracing"
 	include "TriangleTracing"
 	include "MeshTracing"
+	include "RayPacketBenchmark"
+	include "UtilsTests"
 group ""
 
 